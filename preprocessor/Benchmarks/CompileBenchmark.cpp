@@ -0,0 +1,344 @@
+//
+//  CompileBenchmark.cpp
+//  Map Preprocessor Benchmarks
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "AllocatorStatistics.h"
+#include "Encoder.h"
+#include "PNGCodec.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Sixteen opaque colours, the first being the background.
+constexpr uint32_t colour(uint8_t red, uint8_t green, uint8_t blue) {
+	return 0xff00'0000 | (uint32_t(blue) << 16) | (uint32_t(green) << 8) | red;
+}
+constexpr uint32_t Colours[] = {
+	colour(0x00, 0x00, 0x00),	colour(0x00, 0x00, 0x92),	colour(0x92, 0x00, 0x00),	colour(0x92, 0x00, 0x92),
+	colour(0x00, 0x92, 0x00),	colour(0x00, 0x92, 0x92),	colour(0x92, 0x92, 0x00),	colour(0x92, 0x92, 0x92),
+	colour(0x49, 0x49, 0x49),	colour(0x00, 0x00, 0xff),	colour(0xff, 0x00, 0x00),	colour(0xff, 0x00, 0xff),
+	colour(0x00, 0xff, 0x00),	colour(0x00, 0xff, 0xff),	colour(0xff, 0xff, 0x00),	colour(0xff, 0xff, 0xff),
+};
+constexpr uint32_t Transparent = 0;
+
+/// Writes the synthetic corpus to @c directory: tiles in the styles that real tile sets are made of, from flat
+/// fills and stripes through brickwork to noise, plus sprites from small and ragged to large and solid.
+/// The corpus depends on nothing but the tile size, so is the same on every run.
+void write_synthetic_corpus(const ImageCodec &codec, const std::filesystem::path &directory) {
+	// Colours are skewed towards the base of each tile by counting trailing zeroes in the generator's output,
+	// so each step away is half as likely as the last. std::mt19937's output is fully specified whereas the
+	// standard distributions are not, so this keeps the corpus the same across standard libraries.
+	std::mt19937 random(1234);
+	const auto pick = [&](int base) {
+		return Colours[(base + std::countr_zero(uint32_t(random()) | 0x8000'0000)) & 15];
+	};
+
+	static constexpr int Styles = 8;
+	static constexpr int Tiles = 48;
+	std::filesystem::create_directories(directory / "tiles");
+	for(int index = 0; index < Tiles; index++) {
+		BufferPixelAccessor tile(TileWidth, TileHeight);
+		const int base = index / Styles;
+		const auto first = Colours[(base * 5 + 1) & 15], second = Colours[(base * 3 + 8) & 15];
+		for(int y = 0; y < TileHeight; y++) {
+			for(int x = 0; x < TileWidth; x++) {
+				uint32_t value = Colours[0];
+				switch(index % Styles) {
+					case 0:	value = first;														break;
+					case 1:	value = ((y >> (base & 1)) & 1) ? first : second;					break;
+					case 2:	value = ((x >> 1) & 1) ? first : second;							break;
+					case 3:	value = ((x + y) & 1) ? first : second;								break;
+					case 4: {
+						// Brickwork: a line of mortar every fourth row, with joints offset on alternate courses.
+						const int course = y >> 2;
+						const bool mortar = (y & 3) == 3 || ((x + (course & 1) * 4) & 7) == 7;
+						value = mortar ? second : first;
+					} break;
+					case 5:	value = Colours[(base + (y * 4) / TileHeight) & 15];				break;
+					case 6:	value = (random() & 7) ? Colours[0] : pick(base);					break;
+					case 7:	value = pick(base);													break;
+				}
+				tile.set(size_t(x), size_t(y), value);
+			}
+		}
+		codec.save(directory / "tiles" / (std::to_string(index) + ".png"), tile, 0, 0, TileWidth, TileHeight);
+	}
+
+	// Sprites are ellipses, so that their edges are ragged, other than the last: a large,
+	// solid boss. Clippables are the two smallest.
+	struct Sprite {
+		size_t width, height;
+		bool solid;
+	};
+	static constexpr Sprite Sprites[] = {
+		{16, 16, false}, {16, 24, false}, {24, 16, false}, {32, 32, false}, {64, 48, true},
+	};
+	const auto write_sprite = [&](const std::filesystem::path &path, const Sprite &sprite, int base) {
+		BufferPixelAccessor image(sprite.width, sprite.height);
+		const double rx = double(sprite.width) / 2.0, ry = double(sprite.height) / 2.0;
+		for(size_t y = 0; y < sprite.height; y++) {
+			for(size_t x = 0; x < sprite.width; x++) {
+				const double dx = (double(x) + 0.5 - rx) / rx, dy = (double(y) + 0.5 - ry) / ry;
+				const bool inside = sprite.solid || dx * dx + dy * dy <= 1.0;
+				image.set(x, y, inside ? ((y & 4) ? pick(base) : Colours[(base + 2) & 15]) : Transparent);
+			}
+		}
+		codec.save(path, image, 0, 0, sprite.width, sprite.height);
+	};
+	std::filesystem::create_directories(directory / "sprites");
+	std::filesystem::create_directories(directory / "clippables");
+	for(size_t index = 0; index < std::size(Sprites); index++) {
+		write_sprite(directory / "sprites" / (std::to_string(index) + ".png"), Sprites[index], int(index) * 3);
+	}
+	for(int index = 0; index < 2; index++) {
+		write_sprite(directory / "clippables" / (std::to_string(index) + ".png"), Sprites[0], index * 7 + 1);
+	}
+}
+
+/// Measurements of a corpus, by name; see measure for the names.
+using Metrics = std::map<std::string, double>;
+
+/// Compiles and verifies @c directory, as per the verify command, and @returns its metrics:
+///	* cost.<set> — the cycles taken by every routine in each tile set, and by all sprites or clippables, when
+///		run by verify's Executor; border and display cycles are weighted as per the region compiled for;
+///	* time.tile_ms and time.sprite_ms — the mean time to compile each tile, across all of its sets, and each sprite;
+///	* calls.<name> — calls into the register allocators and RegisterSet::load.
+/// Throws std::runtime_error if any routine fails verification.
+Metrics measure(const ImageCodec &codec, const EncoderOptions &options, const std::filesystem::path &directory) {
+	AllocatorStatistics::reset();
+	Encoder encoder(codec, options);
+	const auto verifications = encoder.verify(directory);
+	const auto counts = AllocatorStatistics::counts();
+
+	Metrics metrics;
+	size_t tiles = 0, sprites = 0;
+	for(const auto &verification: verifications) {
+		if(!verification.error.empty()) {
+			throw std::runtime_error(verification.routine + ": " + verification.error);
+		}
+
+		// Routines are named <set>_<index>.
+		const auto set = verification.routine.substr(0, verification.routine.rfind('_'));
+		if(set == "fetch_column") continue;
+		metrics["cost." + set] += double(
+			options.region.border * verification.border_cycles +
+			options.region.display * verification.display_cycles);
+
+		tiles += set == "full";
+		sprites += set == "sprite" || set == "clippable_full";
+	}
+
+	for(const auto &timing: encoder.timings()) {
+		if(timing.step == "tiles" && tiles) metrics["time.tile_ms"] = 1000.0 * timing.seconds / double(tiles);
+		if(timing.step == "sprites" && sprites) metrics["time.sprite_ms"] = 1000.0 * timing.seconds / double(sprites);
+	}
+
+	metrics["calls.mandatory_values"] = double(counts.mandatory_values);
+	metrics["calls.mandatory_spans"] = double(counts.mandatory_spans);
+	metrics["calls.optional_values"] = double(counts.optional_values);
+	metrics["calls.optional_spans"] = double(counts.optional_spans);
+	metrics["calls.register_loads"] = double(counts.register_loads);
+	return metrics;
+}
+
+/// The number of times each corpus is measured when times are gated, the median time being taken.
+constexpr size_t TimedRepetitions = 9;
+
+/// @returns The largest acceptable increase in @c metric, as a fraction of its baseline, if it is gated at all.
+/// Costs and call counts don't vary between runs, so any change in them is real. Times vary with the machine
+/// and its load, so are gated only if @c gate_times is @c true, which implies that they are medians.
+std::optional<double> tolerance(const std::string &metric, bool gate_times) {
+	if(metric.rfind("cost.", 0) == 0) return 0.005;
+	if(metric.rfind("calls.", 0) == 0) return 0.10;
+	if(gate_times) return 0.25;
+	return std::nullopt;
+}
+
+/// @returns The metrics of the first of @c runs, other than times, which are the medians of all @c runs.
+Metrics median(const std::vector<Metrics> &runs) {
+	auto result = runs.front();
+	for(auto &[metric, value]: result) {
+		if(metric.rfind("time.", 0) != 0) continue;
+
+		std::vector<double> times;
+		for(const auto &run: runs) {
+			times.push_back(run.at(metric));
+		}
+		std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+		value = times[times.size() / 2];
+	}
+	return result;
+}
+
+/// @returns @c value as text: times to the microsecond, costs and counts as whole numbers.
+std::string text(const std::string &metric, double value) {
+	char result[64];
+	snprintf(result, sizeof(result), metric.rfind("time.", 0) == 0 ? "%.3f" : "%.0f", value);
+	return result;
+}
+
+/// Baselines by corpus, then by metric.
+using Baseline = std::map<std::string, Metrics>;
+
+Baseline read_baseline(const std::filesystem::path &path) {
+	Baseline baseline;
+	std::ifstream file(path);
+	std::string line;
+	while(std::getline(file, line)) {
+		if(line.empty() || line[0] == '#') continue;
+
+		std::istringstream fields(line);
+		std::string corpus, metric;
+		double value;
+		if(!(fields >> corpus >> metric >> value)) {
+			throw std::runtime_error("Malformed baseline entry: " + line);
+		}
+		baseline[corpus][metric] = value;
+	}
+	return baseline;
+}
+
+void write_baseline(const std::filesystem::path &path, const Baseline &baseline) {
+	std::ofstream file(path);
+	file <<
+		"# Baseline for compile-benchmark, which compares against it; regenerate with --update.\n"
+		"# Times are from whichever machine last updated it, so are gated only with --gate-times.\n"
+		"#\n"
+		"# corpus metric value\n";
+	for(const auto &[corpus, metrics]: baseline) {
+		for(const auto &[metric, value]: metrics) {
+			file << corpus << ' ' << metric << ' ' << text(metric, value) << '\n';
+		}
+	}
+}
+
+/// Prints @c metrics against @c baseline. @returns The number of regressions beyond tolerance.
+size_t compare(const std::string &corpus, const Metrics &metrics, const Metrics *baseline, bool gate_times) {
+	size_t regressions = 0;
+	for(const auto &[metric, value]: metrics) {
+		const auto reference = baseline ? baseline->find(metric) : Metrics::const_iterator{};
+		if(!baseline || reference == baseline->end()) {
+			printf("%-16s %-24s %14s %14s\n", corpus.c_str(), metric.c_str(), "-", text(metric, value).c_str());
+			continue;
+		}
+
+		const double change = reference->second ? (value - reference->second) / reference->second : (value ? 1.0 : 0.0);
+		const auto limit = tolerance(metric, gate_times);
+		const bool regressed = limit && change > *limit;
+		regressions += regressed;
+		printf("%-16s %-24s %14s %14s %+8.2f%%%s\n",
+			corpus.c_str(), metric.c_str(), text(metric, reference->second).c_str(), text(metric, value).c_str(),
+			100.0 * change,
+			regressed ? "  REGRESSION" : (limit ? "" : "  (not gated)"));
+	}
+	return regressions;
+}
+
+void usage(const char *name) {
+	fprintf(stderr,
+		"Usage: %s [options] [work folder...]\n"
+		"\n"
+		"Compiles and verifies a fixed synthetic corpus of tiles and sprites plus those in any work folders, each\n"
+		"of which is a corpus named after its folder, then compares costs, compile times and allocator calls with\n"
+		"the stored baseline. Exits with failure if any routine fails verification or a cost or call count regresses\n"
+		"by more than its tolerance: 0.5%% for costs and 10%% for calls. Times are reported but not gated unless\n"
+		"--gate-times is given.\n"
+		"\n"
+		"Options:\n"
+		"\t--baseline file\tcompares with file rather than the baseline in the source tree;\n"
+		"\t--gate-times\tmeasures each corpus %zu times and also fails if a median time regresses by more than 25%%;\n"
+		"\t--update\trecords this run as the baseline for every corpus measured;\n"
+		"\t--threads n\tcompiles using n threads rather than the default of 1; times are per thread.\n",
+		name, TimedRepetitions);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	std::filesystem::path baseline_path = COMPILE_BENCHMARK_BASELINE;
+	bool update = false;
+	bool gate_times = false;
+	EncoderOptions options{.threads = 1};
+	std::vector<std::filesystem::path> folders;
+	for(int c = 1; c < argc; c++) {
+		if(!strcmp(argv[c], "--update")) {
+			update = true;
+		} else if(!strcmp(argv[c], "--gate-times")) {
+			gate_times = true;
+		} else if(!strcmp(argv[c], "--baseline") && c + 1 < argc) {
+			baseline_path = argv[++c];
+		} else if(!strcmp(argv[c], "--threads") && c + 1 < argc) {
+			options.threads = size_t(atoi(argv[++c]));
+		} else if(argv[c][0] == '-') {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		} else {
+			folders.push_back(argv[c]);
+		}
+	}
+
+	PNGCodec codec;
+	try {
+		// Each run writes its own copy of the synthetic corpus, so that concurrent runs don't collide.
+		const TemporaryDirectory corpus("compile-benchmark-");
+		const auto &synthetic = corpus.path();
+		write_synthetic_corpus(codec, synthetic);
+
+		// The synthetic corpus differs by tile size, so is named for it.
+		std::vector<std::pair<std::string, std::filesystem::path>> corpora = {
+			{"synthetic-" + std::to_string(TileWidth) + "x" + std::to_string(TileHeight), synthetic},
+		};
+		for(const auto &folder: folders) {
+			corpora.emplace_back(std::filesystem::absolute(folder).lexically_normal().filename().string(), folder);
+		}
+
+		auto baseline = std::filesystem::exists(baseline_path) ? read_baseline(baseline_path) : Baseline{};
+		printf("%-16s %-24s %14s %14s %9s\n", "corpus", "metric", "baseline", "current", "change");
+
+		size_t regressions = 0;
+		for(const auto &[name, directory]: corpora) {
+			std::vector<Metrics> runs;
+			for(size_t run = 0; run < (gate_times ? TimedRepetitions : 1); run++) {
+				runs.push_back(measure(codec, options, directory));
+			}
+			const auto metrics = median(runs);
+			const auto reference = baseline.find(name);
+			regressions += compare(name, metrics, reference == baseline.end() ? nullptr : &reference->second, gate_times);
+			if(update) {
+				baseline[name] = metrics;
+			}
+		}
+
+		if(update) {
+			write_baseline(baseline_path, baseline);
+			printf("Baseline written to %s\n", baseline_path.string().c_str());
+			return EXIT_SUCCESS;
+		}
+		if(regressions) {
+			printf("%zu regression%s\n", regressions, regressions == 1 ? "" : "s");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	} catch(const std::exception &exception) {
+		fprintf(stderr, "%s\n", exception.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,207 @@
+//
+//  PrioritiserBenchmark.cpp
+//  Map Preprocessor Benchmarks
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "MandatoryRegisterAllocator.h"
+#include "Prioritiser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+/// The original scan-based Prioritiser, retained as a reference for both speed and results.
+template <typename IntT>
+class ScanningPrioritiser {
+public:
+	void add_value(Time time, IntT value) {
+		values_.emplace(time, value);
+	}
+
+	std::optional<TimeSpan> span_of(IntT value, Time start = 0) const {
+		TimeSpan result{
+			.begin = std::numeric_limits<Time>::max(),
+			.end = std::numeric_limits<Time>::min(),
+		};
+
+		auto it = values_.lower_bound(start);
+		while(it != values_.end()) {
+			if(it->second == value) {
+				result.begin = std::min(result.begin, it->first);
+				result.end = std::max(result.begin, it->first);
+			}
+			++it;
+		}
+
+		if(result.begin > result.end) {
+			return {};
+		}
+		return result;
+	}
+
+	std::optional<int> priority_at(Time time, Time horizon, IntT value) const {
+		IntT throwaway;
+		const auto priorities = all_priorities(time, horizon, throwaway);
+		const auto entry = priorities.find(value);
+		if(entry == priorities.end()) {
+			return {};
+		}
+		return entry->second.usages_remaining;
+	}
+
+	std::optional<PrioritisedValue<IntT>> prioritised_value_at(Time time, Time horizon) const {
+		IntT top_value = 0;
+		const auto priorities = all_priorities(time, horizon, top_value);
+		if(priorities.empty()) {
+			return {};
+		}
+		return priorities.find(top_value)->second;
+	}
+
+private:
+	std::map<Time, IntT> values_;
+
+	std::unordered_map<IntT, PrioritisedValue<IntT>> all_priorities(Time time, Time horizon, IntT &top_value) const {
+		std::unordered_map<IntT, PrioritisedValue<IntT>> priorities;
+
+		size_t top_count = 0;
+		auto cursor = values_.lower_bound(time);
+		const auto target = values_.upper_bound(horizon);
+		while(cursor != target) {
+			auto &priority = priorities[cursor->second];
+
+			priority.value = cursor->second;
+			priority.active_range.begin = std::min(priority.active_range.begin, cursor->first);
+			priority.active_range.end = std::max(priority.active_range.end, cursor->first + 1);
+
+			++priority.usages_remaining;
+			if(priority.usages_remaining > top_count) {
+				top_count = priority.usages_remaining;
+				top_value = cursor->second;
+			}
+			++cursor;
+		}
+
+		return priorities;
+	}
+};
+
+struct Timings {
+	double priority_at, span_of, top_value;
+};
+
+struct Query {
+	Time time, horizon;
+	uint16_t value;
+};
+
+template <typename FuncT> double seconds(FuncT &&function) {
+	const auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+bool operator ==(const TimeSpan &lhs, const TimeSpan &rhs) {
+	return lhs.begin == rhs.begin && lhs.end == rhs.end;
+}
+
+bool operator ==(const PrioritisedValue<uint16_t> &lhs, const PrioritisedValue<uint16_t> &rhs) {
+	return
+		lhs.value == rhs.value &&
+		lhs.active_range == rhs.active_range &&
+		lhs.usages_remaining == rhs.usages_remaining;
+}
+
+int main() {
+	std::mt19937 random(1234);
+	bool all_matched = true;
+
+	printf("%8s %8s | %12s %12s | %12s %12s | %12s %12s | %10s\n",
+		"length", "values",
+		"priority_at", "(scanning)",
+		"span_of", "(scanning)",
+		"top value", "(scanning)",
+		"spans()");
+
+	for(const int length: {256, 1024, 4096, 16384}) {
+		for(const int distinct: {8, 64}) {
+			// Build a stream with a skewed distribution, as real pixel data has: a few
+			// values dominate, with a long tail.
+			std::geometric_distribution<int> skew(4.0 / distinct);
+			Prioritiser<uint16_t> indexed;
+			ScanningPrioritiser<uint16_t> scanning;
+			MandatoryRegisterAllocator<uint16_t> allocator(std::vector<Register::Name>{
+				Register::Name::BC, Register::Name::DE, Register::Name::IY, Register::Name::IX
+			});
+			for(Time time = 0; time < length; time++) {
+				const uint16_t value = uint16_t(0x1111 * (skew(random) % distinct));
+				indexed.add_value(time, value);
+				scanning.add_value(time, value);
+				allocator.add_value(time, value);
+			}
+
+			std::vector<Query> queries(2048);
+			std::uniform_int_distribution<Time> time_distribution(0, length - 1);
+			for(auto &query: queries) {
+				query.time = time_distribution(random);
+				query.horizon = std::min(length - 1, query.time + time_distribution(random) / 4);
+				query.value = uint16_t(0x1111 * (skew(random) % distinct));
+			}
+
+			std::vector<std::optional<int>> priorities[2];
+			std::vector<std::optional<TimeSpan>> spans[2];
+			std::vector<std::optional<PrioritisedValue<uint16_t>>> tops[2];
+			const auto run = [&](auto &prioritiser, int index) {
+				return Timings{
+					seconds([&] {
+						for(const auto &query: queries) {
+							priorities[index].push_back(prioritiser.priority_at(query.time, query.horizon, query.value));
+						}
+					}),
+					seconds([&] {
+						for(const auto &query: queries) {
+							spans[index].push_back(prioritiser.span_of(query.value, query.time));
+						}
+					}),
+					seconds([&] {
+						for(const auto &query: queries) {
+							tops[index].push_back(prioritiser.prioritised_value_at(query.time, query.horizon));
+						}
+					}),
+				};
+			};
+			const auto indexed_times = run(indexed, 0);
+			const auto scanning_times = run(scanning, 1);
+			const bool matched =
+				priorities[0] == priorities[1] &&
+				spans[0] == spans[1] &&
+				tops[0] == tops[1];
+			all_matched &= matched;
+
+			const double allocation_time = seconds([&] {
+				allocator.spans();
+			});
+
+			const auto microseconds = [&](double time) {
+				return 1'000'000.0 * time / double(queries.size());
+			};
+			printf("%8d %8d | %10.2fus %10.2fus | %10.2fus %10.2fus | %10.2fus %10.2fus | %8.3fs%s\n",
+				length, distinct,
+				microseconds(indexed_times.priority_at), microseconds(scanning_times.priority_at),
+				microseconds(indexed_times.span_of), microseconds(scanning_times.span_of),
+				microseconds(indexed_times.top_value), microseconds(scanning_times.top_value),
+				allocation_time,
+				matched ? "" : "  MISMATCH");
+		}
+	}
+
+	return all_matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
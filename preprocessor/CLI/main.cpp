@@ -0,0 +1,319 @@
+//
+//  main.cpp
+//  Map Preprocessor CLI
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Encoder.h"
+#include "PNGCodec.h"
+#include "RoutineCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+void usage(const char *name) {
+	fprintf(stderr,
+		"Usage: %s [options] <command> <arguments>\n"
+		"\n"
+		"Commands:\n"
+		"\tdissect <image.png> <work folder>\n"
+		"\t\tsplits the bottom 192 lines of the image into unique %dx%d tiles, writing tiles/*.png, map.z80s and\n"
+		"\t\tits compressed form map_dictionary.z80s, if that is smaller;\n"
+		"\tencode <work folder>\n"
+		"\t\tpalettises and compiles tiles/, sprites/ and clippables/, writing palette.z80s, sprites.z80s\n"
+		"\t\tand tiles.z80s;\n"
+		"\tcolumns <work folder>\n"
+		"\t\twrites slivers.z80s, to suit the number of tiles in tiles/;\n"
+		"\tverify <work folder>\n"
+		"\t\tcompiles as per encode, then runs every tile and sprite routine in a simulated SAM, checking\n"
+		"\t\tits output against its source image and reporting cycle counts;\n"
+		"\tbudget <work folder>\n"
+		"\t\tcompiles tiles as per encode, then combines their costs with map.z80s to find the cost of redrawing\n"
+		"\t\tat every scroll position, writing budget.txt and listing any positions that exceed the frame.\n"
+		"\n"
+		"Options:\n"
+		"\t--timings\tprints the time taken by each step to stderr;\n"
+		"\t--threads n\tcompiles using n threads; the default of 0 means one per hardware thread;\n"
+		"\t--cache dir\treuses previously-compiled routines and decoded images from, and adds new ones to, dir;\n"
+		"\t--exact\t\tsearches for the cheapest register allocation per tile rather than using a heuristic;\n"
+		"\t--search-limit n\tlimits that search to n states expanded per tile, after which the heuristic is used;\n"
+		"\t\t\tthe default is 250000;\n"
+		"\t--spills n\tconsiders the n most-spilled values per tile for the index registers, up to %zu;\n"
+		"\t\t\tthe default is 8;\n"
+		"\t--region r\toptimises tiles for running in the border, the display or across the frame, the default;\n"
+		"\t--share-tails\tlets tiles on the same page share identical endings, saving space at the cost of a JP;\n"
+		"\t--assemble\tassembles tiles to a binary per page plus tiles.map, leaving tiles.z80s to include them;\n"
+		"\t--pages list\tplaces tiles only in the listed pages, e.g. 16-23 (the default) or 4,5,16-21.\n",
+		name, TileWidth, TileHeight, MandatoryAllocatorOptions::MaxSpillLimit);
+}
+
+/// Prints any failures in @c verifications plus a summary of cycle counts per group of routines,
+/// e.g. all of full_n or all of sprite_n. @returns @c true if there were no failures.
+bool report(const std::vector<Encoder::Verification> &verifications) {
+	struct Summary {
+		size_t count = 0;
+		size_t border_min = std::numeric_limits<size_t>::max(), border_max = 0, border_total = 0;
+		size_t display_min = std::numeric_limits<size_t>::max(), display_max = 0, display_total = 0;
+	};
+	std::vector<std::pair<std::string, Summary>> groups;
+	size_t failures = 0;
+
+	for(const auto &verification: verifications) {
+		if(!verification.error.empty()) {
+			fprintf(stderr, "%s: %s\n", verification.routine.c_str(), verification.error.c_str());
+			++failures;
+			continue;
+		}
+
+		const auto group = verification.routine.substr(0, verification.routine.rfind('_'));
+		if(groups.empty() || groups.back().first != group) {
+			groups.emplace_back(group, Summary{});
+		}
+		auto &summary = groups.back().second;
+		++summary.count;
+		summary.border_min = std::min(summary.border_min, verification.border_cycles);
+		summary.border_max = std::max(summary.border_max, verification.border_cycles);
+		summary.border_total += verification.border_cycles;
+		summary.display_min = std::min(summary.display_min, verification.display_cycles);
+		summary.display_max = std::max(summary.display_max, verification.display_cycles);
+		summary.display_total += verification.display_cycles;
+	}
+
+	printf("%-20s %6s  %24s  %24s\n", "routines", "count", "border min/mean/max", "display min/mean/max");
+	for(const auto &[group, summary]: groups) {
+		printf("%-20s %6zu  %6zu / %7.1f / %6zu  %6zu / %7.1f / %6zu\n",
+			group.c_str(), summary.count,
+			summary.border_min, double(summary.border_total) / double(summary.count), summary.border_max,
+			summary.display_min, double(summary.display_total) / double(summary.count), summary.display_max);
+	}
+	printf("%zu routines verified, %zu failed\n", verifications.size(), failures);
+	return !failures;
+}
+
+/// Prints every scroll position in @c positions that exceeds the frame, plus the most expensive.
+/// @returns @c true if none did.
+bool report(const std::vector<FrameBudget::Position> &positions) {
+	const FrameBudget::Position *worst = nullptr;
+	size_t overruns = 0;
+	for(const auto &position: positions) {
+		if(!worst || position.windows() > worst->windows()) {
+			worst = &position;
+		}
+		if(position.over_budget()) {
+			printf("column %zu, offset %d: %.0f windows (%.1f%%)\n",
+				position.x / TileBytes, int(position.x % TileBytes) << 1,
+				position.windows(), 100.0 * position.windows() / double(FrameBudget::WindowsPerFrame));
+			++overruns;
+		}
+	}
+
+	if(worst) {
+		printf("Worst is column %zu, offset %d: %.0f of %zu windows (%.1f%%)\n",
+			worst->x / TileBytes, int(worst->x % TileBytes) << 1,
+			worst->windows(), FrameBudget::WindowsPerFrame,
+			100.0 * worst->windows() / double(FrameBudget::WindowsPerFrame));
+	}
+	printf("%zu scroll positions analysed, %zu over budget\n", positions.size(), overruns);
+	return !overruns;
+}
+
+/// @returns The page numbers in @c list, a comma-separated list of numbers and ranges such as 16-23,
+/// or @c std::nullopt if it is malformed.
+std::optional<std::vector<int>> parse_pages(const char *list) {
+	std::vector<int> pages;
+	while(*list) {
+		char *end;
+		const long first = strtol(list, &end, 10);
+		long last = first;
+		if(end == list) return std::nullopt;
+		if(*end == '-') {
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if(end == list || last < first) return std::nullopt;
+		}
+		for(long page = first; page <= last; page++) {
+			pages.push_back(int(page));
+		}
+		if(*end == ',') ++end;
+		else if(*end) return std::nullopt;
+		list = end;
+	}
+	if(pages.empty()) return std::nullopt;
+	return pages;
+}
+
+/// Prints the contents of each page of tiles, and how much of it is free.
+void report(const std::vector<Encoder::TilePage> &pages) {
+	for(const auto &page: pages) {
+		std::string contents;
+		for(const auto &set: page.sets) {
+			contents += (contents.empty() ? "" : ", ") + set;
+		}
+		printf("Page %-7s %-18s %5zu bytes, %5zu free\n", (page.name() + ":").c_str(), contents.c_str(), page.size, page.free);
+	}
+}
+
+/// Prints how tiles are dispatched, and what each costs beyond the single table that suffices for 64.
+void report(const std::optional<TileDispatch> &dispatch) {
+	if(!dispatch) {
+		return;
+	}
+	if(dispatch->banks() == 1) {
+		printf("Tiles: %zu, dispatched through a single table\n", dispatch->tiles());
+		return;
+	}
+
+	const auto right = FrameBudget::cycles(dispatch->select(false, "slot"));
+	const auto left = FrameBudget::cycles(dispatch->select(true, "slot"));
+	printf("Tiles: %zu, dispatched through %zu banks of up to %zu\n",
+		dispatch->tiles(), dispatch->banks(), dispatch->per_bank());
+	printf("Selecting a bank adds %zu cycles per tile in the border, %zu during the display; "
+		"%zu and %zu in the first column drawn\n",
+		right.border, right.display, left.border, left.display);
+}
+
+/// Prints the outcome of compressing the map, if it was.
+void report(const std::optional<MapDictionary> &dictionary) {
+	if(!dictionary) {
+		return;
+	}
+
+	if(!dictionary->saves_space()) {
+		printf("Map: compressed form would be %zu bytes rather than %zu (%.1f:1), so map_dictionary.z80s isn't written\n",
+			dictionary->size(), dictionary->raw_size(),
+			double(dictionary->raw_size()) / double(dictionary->size()));
+		return;
+	}
+
+	const auto cycles = MapDictionary::fetch_cycles();
+	printf("Map: %zu columns from %zu distinct, in %zu pairs; %zu bytes rather than %zu (%.1f:1)\n",
+		dictionary->stream().size(), dictionary->columns().size(), dictionary->pairs().size(),
+		dictionary->size(), dictionary->raw_size(),
+		double(dictionary->raw_size()) / double(dictionary->size()));
+	printf("Fetching a column takes %zu cycles in the border, %zu during the display\n",
+		cycles.border, cycles.display);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	bool print_timings = false;
+	EncoderOptions options;
+	std::unique_ptr<RoutineCache> cache;
+	std::vector<std::string> arguments;
+	for(int c = 1; c < argc; c++) {
+		if(!strcmp(argv[c], "--timings")) {
+			print_timings = true;
+		} else if(!strcmp(argv[c], "--threads") && c + 1 < argc) {
+			options.threads = size_t(atoi(argv[++c]));
+		} else if(!strcmp(argv[c], "--cache") && c + 1 < argc) {
+			cache = std::make_unique<RoutineCache>(argv[++c]);
+			options.cache = cache.get();
+			options.image_cache = std::filesystem::path(argv[c]) / "images";
+		} else if(!strcmp(argv[c], "--exact")) {
+			options.allocation.exact = true;
+		} else if(!strcmp(argv[c], "--search-limit") && c + 1 < argc) {
+			options.allocation.expansion_limit = size_t(strtoull(argv[++c], nullptr, 10));
+		} else if(!strcmp(argv[c], "--spills") && c + 1 < argc) {
+			char *end;
+			const auto spills = strtol(argv[++c], &end, 10);
+			if(*end || spills < 0 || size_t(spills) > MandatoryAllocatorOptions::MaxSpillLimit) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			options.allocation.spill_limit = size_t(spills);
+		} else if(!strcmp(argv[c], "--share-tails")) {
+			options.share_tails = true;
+		} else if(!strcmp(argv[c], "--assemble")) {
+			options.assemble = true;
+		} else if(!strcmp(argv[c], "--pages") && c + 1 < argc) {
+			const auto pages = parse_pages(argv[++c]);
+			if(!pages) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			options.tile_pages = *pages;
+		} else if(!strcmp(argv[c], "--region") && c + 1 < argc) {
+			const std::string region = argv[++c];
+			if(region == "border") {
+				options.region = Region::in_border();
+			} else if(region == "display") {
+				options.region = Region::in_display();
+			} else if(region == "frame") {
+				options.region = Region::across_frame();
+			} else {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		} else {
+			arguments.push_back(argv[c]);
+		}
+	}
+
+	if(arguments.empty()) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const PNGCodec codec;
+	Encoder encoder(codec, options);
+	const auto start = std::chrono::steady_clock::now();
+
+	try {
+		const auto &command = arguments[0];
+		if(command == "dissect" && arguments.size() == 3) {
+			const PNGPixelAccessor image(arguments[1]);
+			encoder.dissect(image, arguments[2]);
+			report(encoder.tile_dispatch());
+			report(encoder.dictionary());
+		} else if(command == "encode" && arguments.size() == 2) {
+			encoder.encode(arguments[1]);
+			report(encoder.tile_dispatch());
+			report(encoder.tile_pages());
+			report(encoder.dictionary());
+		} else if(command == "columns" && arguments.size() == 2) {
+			encoder.write_column_functions(arguments[1]);
+			report(encoder.tile_dispatch());
+		} else if(command == "verify" && arguments.size() == 2) {
+			if(!report(encoder.verify(arguments[1]))) {
+				return EXIT_FAILURE;
+			}
+		} else if(command == "budget" && arguments.size() == 2) {
+			if(!report(encoder.budget(arguments[1]))) {
+				return EXIT_FAILURE;
+			}
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	} catch(const std::exception &exception) {
+		fprintf(stderr, "%s\n", exception.what());
+		return EXIT_FAILURE;
+	}
+
+	if(print_timings) {
+		for(const auto &timing: encoder.timings()) {
+			fprintf(stderr, "%-12s %9.3fs\n", timing.step.c_str(), timing.seconds);
+		}
+		if(cache) {
+			fprintf(stderr, "cache        %zu hits, %zu misses\n", cache->hits(), cache->misses());
+		}
+		fprintf(stderr, "images       %zu hits, %zu misses\n", encoder.images().hits(), encoder.images().misses());
+		const auto end = std::chrono::steady_clock::now();
+		fprintf(stderr, "%-12s %9.3fs\n", "total", std::chrono::duration<double>(end - start).count());
+	}
+
+	return EXIT_SUCCESS;
+}
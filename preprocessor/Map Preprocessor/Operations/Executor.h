@@ -0,0 +1,365 @@
+//
+//  Executor.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+#include "Register.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+	Runs streams of Operations directly, without assembly, against a flat 64kb of memory with the
+	screen at its start, counting cycles as per Operation::machine_cycles.
+
+	Only the subset of Z80 semantics that this program generates is modelled; flags are not.
+	Code doesn't occupy the address space, so self-modification is supported only in the form the
+	generators use: a 16-bit store to label+n where n addresses the 16-bit immediate operand of the first
+	instruction after that label.
+
+	Routines are run until they jump or return to ReturnAddress.
+*/
+class Executor {
+public:
+	static constexpr uint16_t ReturnAddress = 0xfffe;
+
+	/// Mode 4: 256x192 at two pixels per byte, in a 32kb page.
+	static constexpr size_t ScreenSize = 24 * 1024;
+	static constexpr size_t BytesPerLine = 128;
+
+	enum class Contention {
+		/// Every memory access proceeds immediately.
+		None,
+		/// Memory may be accessed once in every four cycles, as in the border.
+		Border,
+		/// Memory may be accessed once in every eight cycles, as during the active display.
+		Display,
+	};
+
+	Executor() {
+		memory_.fill(0);
+		pairs_.fill(0);
+	}
+
+	std::array<uint8_t, 65536> &memory() {	return memory_;	}
+	const std::array<uint8_t, 65536> &memory() const {	return memory_;	}
+
+	uint16_t value(Register::Name reg) const {
+		const auto pair = pairs_[index(Register::pair(reg))];
+		if(Register::size(reg) == 2) return pair;
+		return reg == Register::high_part(Register::pair(reg)) ? pair >> 8 : pair & 0xff;
+	}
+
+	void set_value(Register::Name reg, uint16_t value) {
+		auto &pair = pairs_[index(Register::pair(reg))];
+		if(Register::size(reg) == 2) {
+			pair = value;
+		} else if(reg == Register::high_part(Register::pair(reg))) {
+			pair = uint16_t((pair & 0x00ff) | (value << 8));
+		} else {
+			pair = uint16_t((pair & 0xff00) | (value & 0xff));
+		}
+	}
+
+	/// Runs @c program from its first operation until it returns, in the manner of a Z80 CALL:
+	/// ReturnAddress is pushed to the stack first. @returns The number of cycles taken.
+	size_t call(const std::vector<Operation> &program, Contention contention) {
+		push(ReturnAddress);
+		return run(program, contention);
+	}
+
+	/// Runs @c program from its first operation until it jumps or returns to ReturnAddress.
+	/// @returns The number of cycles taken.
+	size_t run(std::vector<Operation> program, Contention contention) {
+		std::unordered_map<std::string, size_t> labels;
+		for(size_t c = 0; c < program.size(); c++) {
+			if(program[c].type == Operation::Type::LABEL) {
+				labels[std::get<Label>(program[c].destination->value).str()] = c;
+			}
+		}
+
+		const size_t window = [&]() -> size_t {
+			switch(contention) {
+				default:
+				case Contention::None:		return 1;
+				case Contention::Border:	return 4;
+				case Contention::Display:	return 8;
+			}
+		}();
+
+		// Anything pushed by a CALL within the program is an index into it, marked by the top bit.
+		static constexpr uint16_t CallMarker = 0x8000;
+		const auto jump = [&](uint16_t address) -> std::optional<size_t> {
+			if(address == ReturnAddress) return std::nullopt;
+			if(!(address & CallMarker)) {
+				throw std::runtime_error("Jump to unknown address");
+			}
+			return size_t(address & ~CallMarker);
+		};
+
+		size_t cycles = 0;
+		size_t steps = 0;
+		std::optional<size_t> cursor = 0;
+		while(cursor) {
+			if(*cursor >= program.size()) {
+				throw std::runtime_error("Ran off the end of the program");
+			}
+			if(++steps > MaxSteps) {
+				throw std::runtime_error("Program did not terminate");
+			}
+
+			const auto &operation = program[*cursor];
+			cycles += operation.machine_cycles().duration(window);
+			auto next = *cursor + 1;
+
+			switch(operation.type) {
+				case Operation::Type::LABEL:
+				case Operation::Type::BLANK_LINE:
+				case Operation::Type::NONE:
+				case Operation::Type::DS_ALIGN:
+				case Operation::Type::NOP:
+				break;
+
+				case Operation::Type::LD:
+					if(operation.destination->type == Operand::Type::LabelIndirect) {
+						patch(program, labels, operation);
+					} else {
+						write(*operation.destination, read(*operation.source));
+					}
+				break;
+
+				case Operation::Type::INC:
+					write(*operation.destination, read(*operation.destination) + 1);
+				break;
+				case Operation::Type::DEC:
+					write(*operation.destination, read(*operation.destination) - 1);
+				break;
+
+				case Operation::Type::RRCA: {
+					const auto a = value(Register::Name::A);
+					set_value(Register::Name::A, uint8_t((a >> 1) | (a << 7)));
+				} break;
+				case Operation::Type::RLCA: {
+					const auto a = value(Register::Name::A);
+					set_value(Register::Name::A, uint8_t((a << 1) | (a >> 7)));
+				} break;
+				case Operation::Type::CPL:
+					set_value(Register::Name::A, value(Register::Name::A) ^ 0xff);
+				break;
+
+				// Other than ADD HL, rr these are modelled as unary, with the destination being the operand.
+				case Operation::Type::ADD:
+					if(operation.source) {
+						write(*operation.destination, read(*operation.destination) + read(*operation.source));
+					} else {
+						set_value(Register::Name::A, uint8_t(value(Register::Name::A) + read(*operation.destination)));
+					}
+				break;
+				case Operation::Type::SUB:
+					set_value(Register::Name::A, uint8_t(value(Register::Name::A) - read(*operation.destination)));
+				break;
+				case Operation::Type::OR:
+					set_value(Register::Name::A, value(Register::Name::A) | read(*operation.destination));
+				break;
+				case Operation::Type::XOR:
+					set_value(Register::Name::A, value(Register::Name::A) ^ read(*operation.destination));
+				break;
+				case Operation::Type::AND:
+					set_value(Register::Name::A, value(Register::Name::A) & read(*operation.destination));
+				break;
+
+				case Operation::Type::SET7:
+					write(*operation.destination, read(*operation.destination) | 0x80);
+				break;
+				case Operation::Type::RES7:
+					write(*operation.destination, read(*operation.destination) & 0x7f);
+				break;
+
+				case Operation::Type::EX_DE_HL: {
+					const auto de = value(Register::Name::DE);
+					set_value(Register::Name::DE, value(Register::Name::HL));
+					set_value(Register::Name::HL, de);
+				} break;
+
+				case Operation::Type::LDI: {
+					const auto hl = value(Register::Name::HL);
+					const auto de = value(Register::Name::DE);
+					memory_[de] = memory_[hl];
+					set_value(Register::Name::HL, uint16_t(hl + 1));
+					set_value(Register::Name::DE, uint16_t(de + 1));
+					set_value(Register::Name::BC, uint16_t(value(Register::Name::BC) - 1));
+				} break;
+
+				case Operation::Type::PUSH:
+					push(read(*operation.destination));
+				break;
+
+				case Operation::Type::JP:
+					if(operation.destination->type == Operand::Type::Label) {
+						next = resolve(labels, std::get<Label>(operation.destination->value).str()).first;
+					} else {
+						const auto target = jump(std::get<uint16_t>(operation.destination->value));
+						if(!target) {
+							cursor = std::nullopt;
+							continue;
+						}
+						next = *target;
+					}
+				break;
+
+				case Operation::Type::CALL:
+					push(uint16_t(next | CallMarker));
+					next = resolve(labels, std::get<Label>(operation.destination->value).str()).first;
+				break;
+
+				case Operation::Type::RET: {
+					const auto target = jump(pop());
+					if(!target) {
+						cursor = std::nullopt;
+						continue;
+					}
+					next = *target;
+				} break;
+			}
+
+			cursor = next;
+		}
+
+		return cycles;
+	}
+
+private:
+	static constexpr size_t MaxSteps = 1'000'000;
+
+	std::array<uint8_t, 65536> memory_;
+	std::array<uint16_t, 7> pairs_;
+
+	static size_t index(Register::Name pair) {
+		switch(pair) {
+			case Register::Name::AF:	return 0;
+			case Register::Name::BC:	return 1;
+			case Register::Name::DE:	return 2;
+			case Register::Name::HL:	return 3;
+			case Register::Name::IX:	return 4;
+			case Register::Name::IY:	return 5;
+			case Register::Name::SP:	return 6;
+			default: throw std::runtime_error("Not a register pair");
+		}
+	}
+
+	uint16_t read(const Operand &operand) const {
+		switch(operand.type) {
+			case Operand::Type::Direct:
+				return value(std::get<Register::Name>(operand.value));
+			case Operand::Type::Indirect:
+				return memory_[value(std::get<Register::Name>(operand.value))];
+			case Operand::Type::Immediate:
+				if(const auto *value8 = std::get_if<uint8_t>(&operand.value)) {
+					return *value8;
+				}
+				return std::get<uint16_t>(operand.value);
+			default:
+				throw std::runtime_error("Unsupported source operand " + operand.text());
+		}
+	}
+
+	void write(const Operand &operand, uint16_t value) {
+		switch(operand.type) {
+			case Operand::Type::Direct:
+				set_value(std::get<Register::Name>(operand.value), value);
+			break;
+			case Operand::Type::Indirect:
+				memory_[this->value(std::get<Register::Name>(operand.value))] = uint8_t(value);
+			break;
+			default:
+				throw std::runtime_error("Unsupported destination operand " + operand.text());
+		}
+	}
+
+	void push(uint16_t value) {
+		auto sp = this->value(Register::Name::SP);
+		memory_[--sp] = uint8_t(value >> 8);
+		memory_[--sp] = uint8_t(value);
+		set_value(Register::Name::SP, sp);
+	}
+
+	uint16_t pop() {
+		auto sp = value(Register::Name::SP);
+		const uint16_t low = memory_[sp++];
+		const uint16_t high = memory_[sp++];
+		set_value(Register::Name::SP, sp);
+		return uint16_t(low | (high << 8));
+	}
+
+	/// Resolves a label reference such as @c name, @c name+1, @c @+name+1 (the next @name, plus one)
+	/// or @c @-name (the previous @name). The generators emit each local label only once
+	/// per routine, so direction is ignored.
+	/// @returns The index of the label and the offset.
+	static std::pair<size_t, int> resolve(
+		const std::unordered_map<std::string, size_t> &labels,
+		const std::string &reference
+	) {
+		const bool is_local =
+			reference.size() > 2 && reference[0] == '@' && (reference[1] == '+' || reference[1] == '-');
+		const size_t start = is_local ? 2 : 0;
+		const auto plus = reference.find('+', start);
+		std::string name = reference.substr(start, plus == std::string::npos ? std::string::npos : plus - start);
+		if(is_local) {
+			name = "@" + name;
+		}
+		int offset = 0;
+		if(plus != std::string::npos) {
+			offset = std::stoi(reference.substr(plus + 1));
+		}
+
+		const auto label = labels.find(name);
+		if(label == labels.end()) {
+			throw std::runtime_error("Unknown label " + reference);
+		}
+		return {label->second, offset};
+	}
+
+	void patch(
+		std::vector<Operation> &program,
+		const std::unordered_map<std::string, size_t> &labels,
+		const Operation &store
+	) {
+		const auto [label, offset] = resolve(labels, std::get<Label>(store.destination->value).str());
+		const auto source = std::get<Register::Name>(store.source->value);
+
+		auto target = label + 1;
+		while(target < program.size() && program[target].machine_cycles().count == 0) {
+			++target;
+		}
+		if(target == program.size()) {
+			throw std::runtime_error("Store to label with no following instruction");
+		}
+
+		// Find the 16-bit immediate operand of the target, and check that the offset addresses it.
+		auto &operation = program[target];
+		const bool has_prefix =
+			(operation.destination && operation.destination->is_index()) ||
+			(operation.source && operation.source->is_index());
+		std::optional<Operand> *immediate = nullptr;
+		for(auto *operand: {&operation.source, &operation.destination}) {
+			if(*operand && (*operand)->type == Operand::Type::Immediate && std::holds_alternative<uint16_t>((*operand)->value)) {
+				immediate = operand;
+				break;
+			}
+		}
+		if(!immediate || Register::size(source) != 2 || offset != 1 + has_prefix) {
+			throw std::runtime_error("Unsupported self-modification of " + operation.text());
+		}
+		(*immediate)->value = value(source);
+	}
+};
@@ -0,0 +1,66 @@
+//
+//  Label.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+/*!
+	An interned label name, as used by operands.
+
+	Each distinct name is stored once, in a table that lives as long as the program, so a Label is
+	just a pointer: copying one costs no allocation and two compare equal exactly if they point to
+	the same entry. Generated code repeats names such as '@+return+1' thousands of times over.
+
+	Safe to create from multiple threads at once.
+*/
+class Label {
+public:
+	Label() : name_(&intern({})) {}
+	explicit Label(std::string_view name) : name_(&intern(name)) {}
+
+	const std::string &str() const {
+		return *name_;
+	}
+
+	bool operator ==(const Label &rhs) const {
+		return name_ == rhs.name_;
+	}
+
+private:
+	const std::string *name_;
+
+	struct Hash {
+		using is_transparent = void;
+		size_t operator()(std::string_view name) const {
+			return std::hash<std::string_view>()(name);
+		}
+	};
+
+	static const std::string &intern(std::string_view name) {
+		static std::shared_mutex mutex;
+		static std::unordered_set<std::string, Hash, std::equal_to<>> names;
+
+		{
+			std::shared_lock lock(mutex);
+			const auto existing = names.find(name);
+			if(existing != names.end()) {
+				return *existing;
+			}
+		}
+
+		// Elements of an unordered_set never move once inserted, so references remain valid.
+		std::unique_lock lock(mutex);
+		return *names.emplace(name).first;
+	}
+};
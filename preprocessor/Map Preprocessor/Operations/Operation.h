@@ -7,31 +7,39 @@
 
 #pragma once
 
+#include "Label.h"
 #include "Register.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
 #include <optional>
+#include <string>
 #include <variant>
+#include <vector>
 
 /// Provides a generic model of a Z80 instruction operand, to only the fidelity currently required by this program.
 struct Operand {
-	enum class Type {
+	enum class Type: uint8_t {
 		Direct,
 		Indirect,
 		Immediate,
 		Label,
 		LabelIndirect,
 	} type;
-	std::variant<Register::Name, uint16_t, uint8_t, std::string> value;
+	std::variant<Register::Name, uint16_t, uint8_t, Label> value;
 
 	static Operand label(const char *name) {
 		return Operand{
 			.type = Type::Label,
-			.value = std::string(name)
+			.value = ::Label(name)
 		};
 	}
 	static Operand label_indirect(const char *name) {
 		return Operand{
 			.type = Type::LabelIndirect,
-			.value = std::string(name)
+			.value = ::Label(name)
 		};
 	}
 	static Operand direct(Register::Name name) {
@@ -61,11 +69,12 @@ struct Operand {
 		return false;
 	}
 
-	size_t index_cost() const {
+	/// @returns @c true if this is an index register or half of one, i.e. its use requires a prefix byte.
+	bool is_index() const {
 		if(const auto* reg = std::get_if<Register::Name>(&value)) {
-			return Register::is_index_pair(*reg) ? 1 : 0;
+			return Register::is_index_pair(Register::pair(*reg));
 		}
-		return 0;
+		return false;
 	}
 
 	size_t size() const {
@@ -75,28 +84,118 @@ struct Operand {
 		return 0;
 	}
 
-	NSString *text() const {
+	std::string text() const {
+		std::string result;
+		append_text(result);
+		return result;
+	}
+
+	/// Appends this operand's text to @c output; unlike text() this usually needs no allocation.
+	void append_text(std::string &output) const {
 		switch(type) {
 			case Type::Direct:
-				return [NSString stringWithFormat:@"%s", Register::name(std::get<Register::Name>(value))];
+				output += Register::name(std::get<Register::Name>(value));
+			break;
 			case Type::Indirect:
-				return [NSString stringWithFormat:@"(%s)", Register::name(std::get<Register::Name>(value))];
+				output += '(';
+				output += Register::name(std::get<Register::Name>(value));
+				output += ')';
+			break;
 			case Type::Label:
-				return [NSString stringWithFormat:@"%s", std::get<std::string>(value).c_str()];
+				output += std::get<::Label>(value).str();
+			break;
 			case Type::LabelIndirect:
-				return [NSString stringWithFormat:@"(%s)", std::get<std::string>(value).c_str()];
-			case Type::Immediate:
+				output += '(';
+				output += std::get<::Label>(value).str();
+				output += ')';
+			break;
+			case Type::Immediate: {
+				char text[8];
 				if(const uint8_t *value8 = std::get_if<uint8_t>(&value)) {
-					return [NSString stringWithFormat:@"0x%02x", *value8];
+					snprintf(text, sizeof(text), "0x%02x", *value8);
+				} else {
+					snprintf(text, sizeof(text), "0x%04x", std::get<uint16_t>(value));
 				}
-				return [NSString stringWithFormat:@"0x%04x", std::get<uint16_t>(value)];
+				output += text;
+			} break;
 		}
 	}
 };
 
+/*!
+	Describes when code is expected to run, as relative amounts of time spent in the border — where the CPU
+	may access memory once in every four cycles — and during the active display, where it may do so only once
+	in every eight.
+
+	Costs are correspondingly weighted sums of cycle counts, so are comparable only with other costs for the
+	same Region.
+*/
+struct Region {
+	unsigned border = 1;
+	unsigned display = 0;
+
+	static constexpr Region in_border() {	return Region{.border = 1, .display = 0};	}
+	static constexpr Region in_display() {	return Region{.border = 0, .display = 1};	}
+
+	/// Weights the two by their shares of a frame: 192 lines of 256 display cycles,
+	/// against the 70,656 other cycles of the 312 lines × 384.
+	static constexpr Region across_frame() {	return Region{.border = 23, .display = 16};	}
+};
+
+/*!
+	The machine cycles of a single Z80 instruction, as a sequence of spans each of which either begins with
+	a memory access or is wholly internal.
+*/
+struct MachineCycles {
+	struct Cycle {
+		uint8_t length;
+		bool accesses_memory;
+	};
+	std::array<Cycle, 8> cycles{};
+	size_t count = 0;
+
+	/// Appends an opcode fetch, including refresh.
+	void fetch() {			append(4, true);		}
+	/// Appends a memory read or write of @c length cycles.
+	void access(uint8_t length) {	append(length, true);	}
+	/// Appends @c length cycles of internal activity, without memory access.
+	void internal(uint8_t length) {	append(length, false);	}
+
+	/// @returns The total number of cycles in the absence of contention.
+	size_t length() const {
+		size_t result = 0;
+		for(size_t c = 0; c < count; c++) {
+			result += cycles[c].length;
+		}
+		return result;
+	}
+
+	/// @returns The number of cycles from one memory window to that after the final cycle,
+	/// given that memory can be accessed only once every @c window cycles.
+	size_t duration(size_t window) const {
+		const auto align = [&](size_t time) {
+			return (time + window - 1) / window * window;
+		};
+		size_t time = 0;
+		for(size_t c = 0; c < count; c++) {
+			if(cycles[c].accesses_memory) {
+				time = align(time);
+			}
+			time += cycles[c].length;
+		}
+		return align(time);
+	}
+
+private:
+	void append(uint8_t length, bool accesses_memory) {
+		assert(count < cycles.size());
+		cycles[count++] = Cycle{.length = length, .accesses_memory = accesses_memory};
+	}
+};
+
 /// Provides a generic model of a Z80 operation, along with basic costing logic.
 struct Operation {
-	enum class Type {
+	enum class Type: uint8_t {
 		LD,
 		INC, DEC,
 		RRCA, RLCA, CPL,
@@ -110,6 +209,8 @@ struct Operation {
 		RES7,
 
 		EX_DE_HL,
+		LDI,
+		NOP,
 
 		BLANK_LINE,
 		NONE,
@@ -175,137 +276,290 @@ struct Operation {
 		};
 	}
 
-	NSString *text() const {
-		NSMutableString *text = [[NSMutableString alloc] init];
+	std::string text() const {
+		std::string result;
+		append_text(result);
+		return result;
+	}
+
+	/// Appends this operation's text to @c output; unlike text() this usually needs no allocation.
+	void append_text(std::string &output) const {
 		switch(type) {
-			case Type::LD:		[text appendString:@"ld"];			break;
-			case Type::INC:		[text appendString:@"inc"];			break;
-			case Type::DEC:		[text appendString:@"dec"];			break;
-			case Type::ADD:		[text appendString:@"add"];			break;
-			case Type::SUB:		[text appendString:@"sub"];			break;
-			case Type::OR:		[text appendString:@"or"];			break;
-			case Type::XOR:		[text appendString:@"xor"];			break;
-			case Type::AND:		[text appendString:@"and"];			break;
-			case Type::PUSH:	[text appendString:@"push"];		break;
-			case Type::JP:		[text appendString:@"jp"];			break;
-			case Type::CALL:	[text appendString:@"call"];		break;
-
-			case Type::SET7:	[text appendString:@"set 7,"];		break;
-			case Type::RES7:	[text appendString:@"res 7,"];		break;
+			case Type::LD:		output += "ld";		break;
+			case Type::INC:		output += "inc";	break;
+			case Type::DEC:		output += "dec";	break;
+			case Type::ADD:		output += "add";	break;
+			case Type::SUB:		output += "sub";	break;
+			case Type::OR:		output += "or";		break;
+			case Type::XOR:		output += "xor";	break;
+			case Type::AND:		output += "and";	break;
+			case Type::PUSH:	output += "push";	break;
+			case Type::JP:		output += "jp";		break;
+			case Type::CALL:	output += "call";	break;
+
+			case Type::SET7:	output += "set 7,";	break;
+			case Type::RES7:	output += "res 7,";	break;
 
 			case Type::NONE:
-			case Type::BLANK_LINE:	return @"";
-			case Type::RRCA:		return @"rrca";
-			case Type::RLCA:		return @"rlca";
-			case Type::CPL:			return @"cpl";
-			case Type::RET:			return @"ret";
-			case Type::EX_DE_HL:	return @"ex de, hl";
-
-			case Type::DS_ALIGN:	[text appendString:@"DS ALIGN"];	break;
-			case Type::LABEL:		return [NSString stringWithFormat:@"%@:", destination->text()];
+			case Type::BLANK_LINE:						return;
+			case Type::RRCA:		output += "rrca";		return;
+			case Type::RLCA:		output += "rlca";		return;
+			case Type::CPL:			output += "cpl";		return;
+			case Type::RET:			output += "ret";		return;
+			case Type::EX_DE_HL:	output += "ex de, hl";	return;
+			case Type::LDI:			output += "ldi";		return;
+			case Type::NOP:			output += "nop";		return;
+
+			case Type::DS_ALIGN:	output += "DS ALIGN";	break;
+			case Type::LABEL:
+				destination->append_text(output);
+				output += ':';
+			return;
 		}
 
 		if(destination) {
-			[text appendFormat:@" %@", destination->text()];
+			output += ' ';
+			destination->append_text(output);
 		}
 		if(source) {
-			[text appendFormat:@", %@", source->text()];
+			output += ", ";
+			source->append_text(output);
 		}
-		return text;
 	}
 
-	/// Provides a SAM-centric costing of the included operation;
-	/// usually this will be the number of memory windows covered,
-	/// during the 75% of the display that requires only 4-cycle alignment.
-	size_t cost() const {
+	/// @returns The number of bytes this operation assembles to.
+	size_t size() const {
+		size_t result = 1;
 		switch(type) {
+			case Type::DS_ALIGN:
+			case Type::LABEL:
+			case Type::BLANK_LINE:
+			case Type::NONE:
+			return 0;
+
+			case Type::SET7:
+			case Type::RES7:
+			case Type::LDI:
+				++result;	// CB or ED prefix.
+			break;
+
 			case Type::LD: {
+				// LD (nn), rr and LD rr, (nn) other than for HL, IX and IY have an ED prefix.
+				const auto &reg = destination->type == Operand::Type::LabelIndirect ? *source : *destination;
+				if(
+					(destination->type == Operand::Type::LabelIndirect || source->type == Operand::Type::LabelIndirect) &&
+					reg.size() == 2 && !reg.is_index_pair() && std::get<Register::Name>(reg.value) != Register::Name::HL
+				) {
+					++result;
+				}
+			} break;
 
-				// Register to register loads must be 8-bit.
+			default: break;
+		}
+
+		for(const auto &operand: {destination, source}) {
+			if(!operand) continue;
+			switch(operand->type) {
+				case Operand::Type::Immediate:
+					result += std::holds_alternative<uint8_t>(operand->value) ? 1 : 2;
+				break;
+				case Operand::Type::Label:
+				case Operand::Type::LabelIndirect:
+					result += 2;
+				break;
+				case Operand::Type::Indirect:
+					result += operand->is_index() && type != Type::JP;	// Displacement; JP (IX) and JP (IY) have none.
+				break;
+				case Operand::Type::Direct: break;
+			}
+		}
+		if((destination && destination->is_index()) || (source && source->is_index())) {
+			++result;	// DD or FD prefix.
+		}
+		return result;
+	}
+
+	/// @returns The machine cycles this operation performs.
+	MachineCycles machine_cycles() const {
+		MachineCycles cycles;
+		// Anything involving an index register has a DD or FD prefix.
+		const auto prefix = [&] {
+			if((destination && destination->is_index()) || (source && source->is_index())) {
+				cycles.fetch();
+			}
+		};
+
+		switch(type) {
+			case Type::LD:
+				prefix();
+				cycles.fetch();
+
+				// LD (nn), r/rr and LD r/rr, (nn).
 				if(
-					destination->type == Operand::Type::Direct &&
-					source->type == Operand::Type::Direct
+					destination->type == Operand::Type::LabelIndirect ||
+					source->type == Operand::Type::LabelIndirect
 				) {
-					if(source->is_index_pair() || destination->is_index_pair()) {
-						return 2;
+					const auto &reg = destination->type == Operand::Type::LabelIndirect ? *source : *destination;
+					const auto pair = std::get<Register::Name>(reg.value);
+					if(pair == Register::Name::BC || pair == Register::Name::DE || pair == Register::Name::SP) {
+						cycles.fetch();	// ED prefix.
 					}
-					return 1;
+					cycles.access(3);
+					cycles.access(3);
+					for(size_t c = 0; c < reg.size(); c++) {
+						cycles.access(3);
+					}
+					break;
 				}
 
-				// LD (HL), n.
+				// LD (HL), n / LD (IX+d), n.
 				if(
 					destination->type == Operand::Type::Indirect &&
 					source->type == Operand::Type::Immediate
 				) {
-					return 3 + destination->index_cost();
+					if(destination->is_index()) {
+						cycles.access(3);
+						cycles.access(3);
+						cycles.internal(2);
+					} else {
+						cycles.access(3);
+					}
+					cycles.access(3);
+					break;
 				}
 
-				// LD (HL), r.
+				// LD (HL), r / LD r, (HL), and their IX+d equivalents.
 				if(
-					destination->type == Operand::Type::Indirect &&
-					source->type == Operand::Type::Direct
+					destination->type == Operand::Type::Indirect ||
+					source->type == Operand::Type::Indirect
 				) {
-					return 2 + destination->index_cost();
+					if(destination->is_index() || source->is_index()) {
+						cycles.access(3);
+						cycles.internal(5);
+					}
+					cycles.access(3);
+					break;
 				}
 
-				// LD (nn), r/rr.
-				if(
-					destination->type == Operand::Type::LabelIndirect &&
-					source->type == Operand::Type::Direct
-				) {
-					return 3 + destination->size() + destination->index_cost();
+				// LD r, n / LD rr, nn.
+				if(source->type == Operand::Type::Immediate) {
+					for(size_t c = 0; c < destination->size(); c++) {
+						cycles.access(3);
+					}
+					break;
 				}
 
-				// Hopefully that leaves only LD r,n and LR r,nn, at least
+				// Hopefully that leaves only LD r, r' and LD SP, HL/IX/IY, at least
 				// as far as this project is concerned.
-				if(
-					destination->type == Operand::Type::Direct &&
-					source->type == Operand::Type::Immediate
-				) {
-					return destination->index_cost() + destination->size() + 1;
+				if(destination->size() == 2) {
+					cycles.internal(2);
 				}
-			} break;
+			break;
 
 			case Type::INC:
 			case Type::DEC:
-				return destination->index_cost() + destination->size();
+				prefix();
+				cycles.fetch();
+				if(destination->type == Operand::Type::Indirect) {
+					cycles.access(3);
+					cycles.internal(1);
+					cycles.access(3);
+				} else if(destination->size() == 2) {
+					cycles.internal(2);
+				}
+			break;
+
+			case Type::PUSH:
+				prefix();
+				cycles.fetch();
+				cycles.internal(1);
+				cycles.access(3);
+				cycles.access(3);
 			break;
 
-			case Type::PUSH:	return 3 + destination->index_cost();
+			// These are modelled as unary, i.e. the destination is the operand, other than ADD HL, rr.
 			case Type::SUB:
 			case Type::XOR:
 			case Type::OR:
 			case Type::AND:
-			case Type::ADD:		return 1 + destination->size();
+			case Type::ADD:
+				prefix();
+				cycles.fetch();
+				if(destination->type == Operand::Type::Immediate) {
+					cycles.access(3);
+				} else if(destination->size() == 2) {
+					cycles.internal(7);
+				}
+			break;
 
 			case Type::EX_DE_HL:
 			case Type::RLCA:
 			case Type::RRCA:
-			case Type::CPL:		return 1;
+			case Type::CPL:
+			case Type::NOP:
+				cycles.fetch();
+			break;
+
+			case Type::LDI:
+				cycles.fetch();	// ED prefix.
+				cycles.fetch();
+				cycles.access(3);
+				cycles.access(5);
+			break;
 
 			case Type::RES7:
-			case Type::SET7:	return 2;
+			case Type::SET7:
+				cycles.fetch();	// CB prefix.
+				cycles.fetch();
+			break;
 
 			case Type::JP:
-			case Type::RET:		return 3;
+				// JP (HL) and its index equivalents are just the fetch.
+				prefix();
+				cycles.fetch();
+				if(destination->type != Operand::Type::Indirect) {
+					cycles.access(3);
+					cycles.access(3);
+				}
+			break;
+
+			case Type::RET:
+				cycles.fetch();
+				cycles.access(3);
+				cycles.access(3);
+			break;
 
-			case Type::CALL:	return 5;
+			case Type::CALL:
+				cycles.fetch();
+				cycles.access(3);
+				cycles.access(3);
+				cycles.internal(1);
+				cycles.access(3);
+				cycles.access(3);
+			break;
 
 			case Type::DS_ALIGN:
 			case Type::LABEL:
 			case Type::BLANK_LINE:
-			case Type::NONE:	return 0;
+			case Type::NONE:
+			break;
 		}
 
-		assert(false);
-		return 99;
+		return cycles;
+	}
+
+	/// Provides a SAM-centric costing of the included operation: the time it takes to execute
+	/// in @c region, with each memory access delayed until the next available window.
+	size_t cost(Region region) const {
+		const auto cycles = machine_cycles();
+		return region.border * cycles.duration(4) + region.display * cycles.duration(8);
 	}
 };
 
-size_t cost(const std::vector<Operation> &operations) {
+inline size_t cost(const std::vector<Operation> &operations, Region region) {
 	size_t result = 0;
 	for(const auto &operation: operations) {
-		result += operation.cost();
+		result += operation.cost(region);
 	}
 	return result;
 }
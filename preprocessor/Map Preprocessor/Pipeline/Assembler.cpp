@@ -0,0 +1,509 @@
+//
+//  Assembler.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Assembler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+using Name = Register::Name;
+
+/// @returns The three-bit code for @c reg as the operand of an 8-bit instruction; index halves
+/// take the place of H and L.
+uint8_t register8(Name reg) {
+	switch(reg) {
+		case Name::B:	return 0;
+		case Name::C:	return 1;
+		case Name::D:	return 2;
+		case Name::E:	return 3;
+		case Name::H:	case Name::IXh:	case Name::IYh:	return 4;
+		case Name::L:	case Name::IXl:	case Name::IYl:	return 5;
+		case Name::A:	return 7;
+		default: throw std::runtime_error(std::string("Not an 8-bit register: ") + Register::name(reg));
+	}
+}
+
+/// @returns The two-bit code for @c pair as the operand of a 16-bit instruction, in which the fourth
+/// pair is SP or, if @c is_push, AF. Index pairs take the place of HL.
+uint8_t register16(Name pair, bool is_push = false) {
+	switch(pair) {
+		case Name::BC:	return 0;
+		case Name::DE:	return 1;
+		case Name::HL:	case Name::IX:	case Name::IY:	return 2;
+		case Name::SP:	if(!is_push) return 3;	break;
+		case Name::AF:	if(is_push) return 3;	break;
+		default: break;
+	}
+	throw std::runtime_error(std::string("Not a usable register pair: ") + Register::name(pair));
+}
+
+/// Appends the machine code for @c operation to @c bytes. If it has a label operand then the offset
+/// of the 16-bit field for it is stored to @c reference; that field is left as zero.
+void encode(const Operation &operation, std::vector<uint8_t> &bytes, std::optional<size_t> &reference) {
+	using Type = Operation::Type;
+	const auto fail = [&] {
+		throw std::runtime_error("Cannot assemble " + operation.text());
+	};
+	const auto reg = [&](const std::optional<Operand> &operand) {
+		if(!operand || (operand->type != Operand::Type::Direct && operand->type != Operand::Type::Indirect)) {
+			fail();
+		}
+		return std::get<Name>(operand->value);
+	};
+
+	// All operands must agree on their index prefix, if any. A prefixed instruction can't also use (HL).
+	// If it has a displacement then its other operand may be H or L but not an index half; otherwise
+	// the prefix turns H and L into index halves, so they can't be named alongside.
+	uint8_t prefix = 0;
+	bool uses_hl_pointer = false, uses_h_or_l = false, uses_index_half = false, has_displacement = false;
+	for(const auto *operand: {&operation.destination, &operation.source}) {
+		if(!*operand) continue;
+		const auto *name = std::get_if<Name>(&(*operand)->value);
+		if(!name) continue;
+
+		const auto pair = Register::pair(*name);
+		if(pair == Name::IX || pair == Name::IY) {
+			const uint8_t operand_prefix = pair == Name::IX ? 0xdd : 0xfd;
+			if(prefix && prefix != operand_prefix) fail();
+			prefix = operand_prefix;
+			has_displacement |= (*operand)->type == Operand::Type::Indirect;
+			uses_index_half |= Register::size(*name) == 1;
+		} else if(*name == Name::H || *name == Name::L) {
+			uses_h_or_l = true;
+		} else if(*name == Name::HL && (*operand)->type == Operand::Type::Indirect) {
+			uses_hl_pointer = true;
+		}
+	}
+	if(prefix && (uses_hl_pointer || (uses_h_or_l && !has_displacement))) fail();
+	if(has_displacement && uses_index_half) fail();
+
+	const auto immediate = [&](const Operand &operand, size_t size) {
+		switch(operand.type) {
+			case Operand::Type::Immediate:
+				if(const auto *value8 = std::get_if<uint8_t>(&operand.value)) {
+					if(size != 1) fail();
+					bytes.push_back(*value8);
+				} else {
+					if(size != 2) fail();
+					const auto value16 = std::get<uint16_t>(operand.value);
+					bytes.push_back(uint8_t(value16));
+					bytes.push_back(uint8_t(value16 >> 8));
+				}
+			break;
+			case Operand::Type::Label:
+			case Operand::Type::LabelIndirect:
+				if(size != 2) fail();
+				reference = bytes.size();
+				bytes.push_back(0);
+				bytes.push_back(0);
+			break;
+			default: fail();
+		}
+	};
+	const auto opcode = [&](uint8_t value) {
+		if(prefix) bytes.push_back(prefix);
+		bytes.push_back(value);
+		if(has_displacement) bytes.push_back(0);
+	};
+
+	const auto &destination = operation.destination;
+	const auto &source = operation.source;
+	switch(operation.type) {
+		case Type::NONE:
+		case Type::BLANK_LINE:
+		case Type::LABEL:
+		case Type::DS_ALIGN:
+		break;
+
+		case Type::LD:
+			if(!destination || !source) fail();
+
+			// LD (nn), r/rr.
+			if(destination->type == Operand::Type::LabelIndirect) {
+				const auto from = reg(source);
+				if(from == Name::A) {
+					opcode(0x32);
+				} else if(Register::is_index_pair_or_hl(from)) {
+					opcode(0x22);
+				} else {
+					bytes.push_back(0xed);
+					opcode(uint8_t(0x43 | (register16(from) << 4)));
+				}
+				immediate(*destination, 2);
+				break;
+			}
+
+			// LD r/rr, (nn).
+			if(source->type == Operand::Type::LabelIndirect) {
+				const auto to = reg(destination);
+				if(to == Name::A) {
+					opcode(0x3a);
+				} else if(Register::is_index_pair_or_hl(to)) {
+					opcode(0x2a);
+				} else {
+					bytes.push_back(0xed);
+					opcode(uint8_t(0x4b | (register16(to) << 4)));
+				}
+				immediate(*source, 2);
+				break;
+			}
+
+			// LD (rr), r / LD (rr), n.
+			if(destination->type == Operand::Type::Indirect) {
+				const auto pair = reg(destination);
+				if(pair == Name::BC || pair == Name::DE) {
+					if(source->type != Operand::Type::Direct || reg(source) != Name::A) fail();
+					opcode(pair == Name::BC ? 0x02 : 0x12);
+				} else if(source->type == Operand::Type::Direct) {
+					opcode(uint8_t(0x70 | register8(reg(source))));
+				} else {
+					opcode(0x36);
+					immediate(*source, 1);
+				}
+				break;
+			}
+
+			// LD r, (rr).
+			if(source->type == Operand::Type::Indirect) {
+				const auto pair = reg(source);
+				if(pair == Name::BC || pair == Name::DE) {
+					if(reg(destination) != Name::A) fail();
+					opcode(pair == Name::BC ? 0x0a : 0x1a);
+				} else {
+					opcode(uint8_t(0x46 | (register8(reg(destination)) << 3)));
+				}
+				break;
+			}
+
+			// LD r, n / LD rr, nn.
+			if(source->type == Operand::Type::Immediate || source->type == Operand::Type::Label) {
+				const auto to = reg(destination);
+				if(Register::size(to) == 1) {
+					opcode(uint8_t(0x06 | (register8(to) << 3)));
+					immediate(*source, 1);
+				} else {
+					opcode(uint8_t(0x01 | (register16(to) << 4)));
+					immediate(*source, 2);
+				}
+				break;
+			}
+
+			// LD SP, HL/IX/IY and LD r, r'.
+			if(reg(destination) == Name::SP) {
+				if(!Register::is_index_pair_or_hl(reg(source))) fail();
+				opcode(0xf9);
+			} else {
+				opcode(uint8_t(0x40 | (register8(reg(destination)) << 3) | register8(reg(source))));
+			}
+		break;
+
+		case Type::INC:
+		case Type::DEC: {
+			const bool is_dec = operation.type == Type::DEC;
+			const auto target = reg(destination);
+			if(destination->type == Operand::Type::Indirect) {
+				if(!Register::is_index_pair_or_hl(target)) fail();
+				opcode(is_dec ? 0x35 : 0x34);
+			} else if(Register::size(target) == 1) {
+				opcode(uint8_t((is_dec ? 0x05 : 0x04) | (register8(target) << 3)));
+			} else {
+				opcode(uint8_t((is_dec ? 0x0b : 0x03) | (register16(target) << 4)));
+			}
+		} break;
+
+		case Type::ADD:
+			// ADD HL, rr and its index equivalents.
+			if(source) {
+				const auto to = reg(destination), from = reg(source);
+				if(!Register::is_index_pair_or_hl(to) || (Register::is_index_pair_or_hl(from) && from != to)) fail();
+				opcode(uint8_t(0x09 | (register16(from) << 4)));
+				break;
+			}
+		[[fallthrough]];
+		case Type::SUB:
+		case Type::AND:
+		case Type::XOR:
+		case Type::OR: {
+			// Otherwise these are modelled as unary, with the destination being the operand.
+			const uint8_t base = [&] {
+				switch(operation.type) {
+					default:
+					case Type::ADD:	return 0x80;
+					case Type::SUB:	return 0x90;
+					case Type::AND:	return 0xa0;
+					case Type::XOR:	return 0xa8;
+					case Type::OR:	return 0xb0;
+				}
+			}();
+			if(!destination) fail();
+			switch(destination->type) {
+				case Operand::Type::Immediate:
+					opcode(base | 0x46);
+					immediate(*destination, 1);
+				break;
+				case Operand::Type::Indirect:
+					if(!Register::is_index_pair_or_hl(reg(destination))) fail();
+					opcode(base | 0x06);
+				break;
+				default:
+					opcode(base | register8(reg(destination)));
+				break;
+			}
+		} break;
+
+		case Type::SET7:
+		case Type::RES7: {
+			// Index forms place the displacement between the CB prefix and the opcode.
+			const uint8_t base = operation.type == Type::SET7 ? 0xf8 : 0xb8;
+			const auto target = reg(destination);
+			if(prefix) {
+				if(destination->type != Operand::Type::Indirect) fail();
+				bytes.insert(bytes.end(), {prefix, 0xcb, 0x00, uint8_t(base | 6)});
+			} else if(destination->type == Operand::Type::Indirect) {
+				if(target != Name::HL) fail();
+				bytes.insert(bytes.end(), {0xcb, uint8_t(base | 6)});
+			} else {
+				bytes.insert(bytes.end(), {0xcb, uint8_t(base | register8(target))});
+			}
+		} break;
+
+		case Type::PUSH:
+			opcode(uint8_t(0xc5 | (register16(reg(destination), true) << 4)));
+		break;
+
+		case Type::JP:
+			if(!destination) fail();
+			if(destination->type == Operand::Type::Indirect) {
+				// JP (HL) and its index equivalents, which take no displacement.
+				if(!Register::is_index_pair_or_hl(reg(destination))) fail();
+				if(prefix) bytes.push_back(prefix);
+				bytes.push_back(0xe9);
+			} else {
+				bytes.push_back(0xc3);
+				immediate(*destination, 2);
+			}
+		break;
+
+		case Type::CALL:
+			if(!destination) fail();
+			bytes.push_back(0xcd);
+			immediate(*destination, 2);
+		break;
+
+		case Type::RET:			bytes.push_back(0xc9);					break;
+		case Type::EX_DE_HL:	bytes.push_back(0xeb);					break;
+		case Type::LDI:			bytes.insert(bytes.end(), {0xed, 0xa0});	break;
+		case Type::RRCA:		bytes.push_back(0x0f);					break;
+		case Type::RLCA:		bytes.push_back(0x07);					break;
+		case Type::CPL:			bytes.push_back(0x2f);					break;
+		case Type::NOP:			bytes.push_back(0x00);					break;
+	}
+}
+
+}
+
+std::vector<uint8_t> Assembler::encode(const Operation &operation) {
+	std::vector<uint8_t> bytes;
+	std::optional<size_t> reference;
+	::encode(operation, bytes, reference);
+	return bytes;
+}
+
+size_t Assembler::size(const std::vector<Operation> &operations) {
+	std::vector<uint8_t> bytes;
+	std::optional<size_t> reference;
+	for(const auto &operation: operations) {
+		::encode(operation, bytes, reference);
+	}
+	return bytes.size();
+}
+
+void Assembler::begin_page(int number, uint16_t origin, size_t span) {
+	for(const auto &page: pages_) {
+		if(number < page.number + int(page.span) && page.number < number + int(span)) {
+			throw std::runtime_error("Page " + std::to_string(number) + " is assembled more than once");
+		}
+	}
+	pages_.push_back(Page{.number = number, .origin = origin, .span = span});
+}
+
+void Assembler::define(const std::string &name, uint16_t value) {
+	if(!globals_.emplace(name, value).second) {
+		throw std::runtime_error("Label " + name + " is defined more than once");
+	}
+	global_order_.push_back(name);
+}
+
+uint16_t Assembler::address() const {
+	return uint16_t(pages_.back().origin + pages_.back().bytes.size());
+}
+
+Assembler &Assembler::operator <<(const std::vector<Operation> &operations) {
+	if(pages_.empty()) {
+		throw std::logic_error("Operations assembled before any page was begun");
+	}
+	auto &bytes = pages_.back().bytes;
+	const auto start = address();
+
+	for(const auto &operation: operations) {
+		++sequence_;
+		switch(operation.type) {
+			case Operation::Type::LABEL: {
+				const auto &name = std::get<Label>(operation.destination->value).str();
+				if(!name.empty() && name[0] == '@') {
+					locals_[name].push_back(Definition{.sequence = sequence_, .value = address()});
+				} else {
+					define(name, address());
+				}
+			} continue;
+
+			case Operation::Type::DS_ALIGN: {
+				const auto alignment = std::get<uint16_t>(operation.destination->value);
+				while(address() % alignment) {
+					bytes.push_back(0);
+				}
+			} continue;
+
+			default: break;
+		}
+
+		const auto offset = bytes.size();
+		std::optional<size_t> reference;
+		::encode(operation, bytes, reference);
+		if(bytes.size() - offset != operation.size()) {
+			throw std::logic_error("Size of " + operation.text() + " disagrees with its encoding");
+		}
+		if(reference) {
+			const auto &operand =
+				operation.destination && (
+					operation.destination->type == Operand::Type::Label ||
+					operation.destination->type == Operand::Type::LabelIndirect
+				) ? *operation.destination : *operation.source;
+			fixups_.push_back(Fixup{
+				.page = pages_.size() - 1,
+				.offset = *reference,
+				.sequence = sequence_,
+				.reference = std::get<Label>(operand.value),
+			});
+		}
+	}
+
+	if(!operations.empty() && operations.front().type == Operation::Type::LABEL) {
+		routines_.push_back(Routine{
+			.name = std::get<Label>(operations.front().destination->value).str(),
+			.page = pages_.back().number,
+			.address = start,
+			.size = size_t(address() - start),
+		});
+	}
+	return *this;
+}
+
+uint16_t Assembler::resolve(const Fixup &fixup) const {
+	const auto &reference = fixup.reference.str();
+	const bool is_local =
+		reference.size() > 2 && reference[0] == '@' && (reference[1] == '+' || reference[1] == '-');
+	const size_t start = is_local ? 2 : 0;
+	const auto sign = reference.find_first_of("+-", start);
+	const auto name = (is_local ? "@" : "") + reference.substr(start, sign == std::string::npos ? std::string::npos : sign - start);
+	const int offset = sign == std::string::npos ? 0 : std::stoi(reference.substr(sign));
+
+	if(!is_local) {
+		const auto global = globals_.find(name);
+		if(global == globals_.end()) {
+			throw std::runtime_error("Unknown label " + reference);
+		}
+		return uint16_t(global->second + offset);
+	}
+
+	const auto local = locals_.find(name);
+	if(local != locals_.end()) {
+		const auto &definitions = local->second;
+		const auto next = std::upper_bound(
+			definitions.begin(), definitions.end(), fixup.sequence,
+			[](size_t sequence, const Definition &definition) {
+				return sequence < definition.sequence;
+			});
+		if(reference[1] == '+' && next != definitions.end()) {
+			return uint16_t(next->value + offset);
+		}
+		if(reference[1] == '-' && next != definitions.begin()) {
+			return uint16_t(std::prev(next)->value + offset);
+		}
+	}
+	throw std::runtime_error("Unknown label " + reference);
+}
+
+void Assembler::link() {
+	for(const auto &page: pages_) {
+		if(page.end() > page.span * PageSize) {
+			throw std::runtime_error(
+				"Page " + std::to_string(page.number) + " overflows by " +
+				std::to_string(page.end() - page.span * PageSize) + " bytes");
+		}
+	}
+
+	for(const auto &fixup: fixups_) {
+		const auto value = resolve(fixup);
+		auto &bytes = pages_[fixup.page].bytes;
+		bytes[fixup.offset] = uint8_t(value);
+		bytes[fixup.offset + 1] = uint8_t(value >> 8);
+	}
+	fixups_.clear();
+}
+
+std::string Assembler::symbol_source() const {
+	std::string source;
+	char line[128];
+	for(const auto &name: global_order_) {
+		snprintf(line, sizeof(line), "\t%s: EQU 0x%04x\n", name.c_str(), globals_.at(name));
+		source += line;
+	}
+	return source;
+}
+
+void Assembler::write(const std::filesystem::path &directory, const std::string &stem) const {
+	const auto write_file = [](const std::filesystem::path &path, const char *data, size_t size) {
+		std::ofstream file(path, std::ios::binary);
+		file.write(data, std::streamsize(size));
+		if(!file) {
+			throw std::runtime_error(path.string() + ": could not be written");
+		}
+	};
+
+	std::string map;
+	char line[160];
+	for(const auto &page: pages_) {
+		write_file(
+			directory / (stem + "_" + std::to_string(page.number) + ".bin"),
+			reinterpret_cast<const char *>(page.bytes.data()), page.bytes.size());
+		snprintf(line, sizeof(line), "page %d%s: %zu bytes from 0x%04x, %zu free\n",
+			page.number, page.span > 1 ? ("-" + std::to_string(page.number + int(page.span) - 1)).c_str() : "",
+			page.bytes.size(), page.origin, page.free());
+		map += line;
+	}
+
+	map += "\nlabels:\n";
+	for(const auto &name: global_order_) {
+		snprintf(line, sizeof(line), "\t0x%04x %s\n", globals_.at(name), name.c_str());
+		map += line;
+	}
+
+	map += "\nroutines:\n";
+	for(const auto &routine: routines_) {
+		snprintf(line, sizeof(line), "\t%d:0x%04x %5zu %s\n",
+			routine.page, routine.address, routine.size, routine.name.c_str());
+		map += line;
+	}
+
+	write_file(directory / (stem + ".map"), map.data(), map.size());
+}
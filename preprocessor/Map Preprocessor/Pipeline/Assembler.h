@@ -0,0 +1,116 @@
+//
+//  Assembler.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+	Assembles Operations directly to machine code, as an alternative to writing source for an external
+	assembler; output is a series of 16kb pages plus the addresses of everything placed in them.
+
+	Labels follow pyz80's conventions: a label beginning with '@' is local and may be defined any number
+	of times, with @c @+name referring to the next definition and @c @-name to the previous. Any other label
+	must be defined exactly once, either by a LABEL or via define. References may add or subtract a constant,
+	as in @c @+return+1.
+
+	Operations may refer to labels that haven't yet been defined; all references are resolved by link.
+*/
+class Assembler {
+public:
+	static constexpr size_t PageSize = 16 * 1024;
+
+	/// Begins page @c number, assembled to run at @c origin; subsequent operations are placed there.
+	/// Its contents may run on into the @c span - 1 pages that follow, as if each were paged in directly above it.
+	void begin_page(int number, uint16_t origin = 0, size_t span = 1);
+
+	/// Defines the global label @c name as @c value, as per EQU.
+	void define(const std::string &name, uint16_t value);
+
+	/// Appends @c operations to the current page; if the first is a label then they're also recorded as a routine.
+	Assembler &operator <<(const std::vector<Operation> &operations);
+
+	/// Resolves every label reference; throws if any can't be, or if any page has overflowed.
+	void link();
+
+	struct Page {
+		int number;
+		uint16_t origin;
+		/// The number of consecutive pages, from @c number, that this may fill.
+		size_t span = 1;
+		std::vector<uint8_t> bytes;
+
+		/// @returns The address just beyond the page's contents, relative to the start of the page.
+		size_t end() const {
+			return origin % PageSize + bytes.size();
+		}
+		size_t free() const {
+			return end() < span * PageSize ? span * PageSize - end() : 0;
+		}
+	};
+	const std::vector<Page> &pages() const {
+		return pages_;
+	}
+
+	/// A contiguous group of operations as passed to operator <<, named for its leading label.
+	struct Routine {
+		std::string name;
+		int page;
+		uint16_t address;
+		size_t size;
+	};
+	const std::vector<Routine> &routines() const {
+		return routines_;
+	}
+
+	/// Writes each page to @c [stem]_[page].bin within @c directory, including anything that runs on
+	/// beyond it, and a map of all pages,
+	/// global labels and routines to @c [stem].map.
+	void write(const std::filesystem::path &directory, const std::string &stem) const;
+
+	/// @returns Source that reproduces every global label and definition as an EQU.
+	std::string symbol_source() const;
+
+	/// @returns The machine code for @c operation, with any label operand left as zero.
+	static std::vector<uint8_t> encode(const Operation &operation);
+
+	/// @returns The number of bytes that @c operations assemble to, given that they contain no DS ALIGN.
+	static size_t size(const std::vector<Operation> &operations);
+
+private:
+	std::vector<Page> pages_;
+	std::vector<Routine> routines_;
+
+	struct Definition {
+		size_t sequence;
+		uint16_t value;
+	};
+	std::unordered_map<std::string, uint16_t> globals_;
+	std::vector<std::string> global_order_;
+	std::unordered_map<std::string, std::vector<Definition>> locals_;
+
+	/// A 16-bit field that awaits the value of a label.
+	struct Fixup {
+		size_t page;
+		size_t offset;
+		size_t sequence;
+		Label reference;
+	};
+	std::vector<Fixup> fixups_;
+
+	/// Counts every operation appended, to order references relative to local labels.
+	size_t sequence_ = 0;
+
+	uint16_t address() const;
+	uint16_t resolve(const Fixup &fixup) const;
+};
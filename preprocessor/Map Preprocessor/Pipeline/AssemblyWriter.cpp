@@ -0,0 +1,73 @@
+//
+//  AssemblyWriter.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "AssemblyWriter.h"
+
+#include <stdexcept>
+
+void append_source(std::string &code, const Operation &operation) {
+	switch(operation.type) {
+		case Operation::Type::NONE: return;
+		case Operation::Type::BLANK_LINE: break;
+		case Operation::Type::LABEL: code += '\t';	break;
+		default: code += "\t\t";	break;
+	}
+	operation.append_text(code);
+	code += '\n';
+
+	if(operation.type == Operation::Type::RET) {
+		code += '\n';
+	}
+}
+
+AssemblyWriter::AssemblyWriter(const std::filesystem::path &path) : path_(path), file_(std::fopen(path.c_str(), "wb")) {
+	if(!file_) {
+		throw std::runtime_error(path.string() + ": could not be written");
+	}
+	buffer_.reserve(Capacity + 256);
+}
+
+AssemblyWriter::~AssemblyWriter() {
+	if(file_) {
+		flush();
+		std::fclose(file_);
+	}
+}
+
+AssemblyWriter &AssemblyWriter::operator <<(std::string_view text) {
+	buffer_ += text;
+	if(buffer_.size() >= Capacity) {
+		flush();
+	}
+	return *this;
+}
+
+AssemblyWriter &AssemblyWriter::operator <<(const std::vector<Operation> &operations) {
+	for(const auto &operation: operations) {
+		append_source(buffer_, operation);
+		if(buffer_.size() >= Capacity) {
+			flush();
+		}
+	}
+	return *this;
+}
+
+void AssemblyWriter::flush() {
+	if(!buffer_.empty() && std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+		failed_ = true;
+	}
+	buffer_.clear();
+}
+
+void AssemblyWriter::close() {
+	flush();
+	const bool closed = !std::fclose(file_);
+	file_ = nullptr;
+	if(failed_ || !closed) {
+		throw std::runtime_error(path_.string() + ": could not be written");
+	}
+}
@@ -0,0 +1,50 @@
+//
+//  AssemblyWriter.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Appends @c operation to @c code as a line of source: labels are indented by one tab and
+/// everything else by two; NONEs are omitted and each RET is followed by a blank line.
+void append_source(std::string &code, const Operation &operation);
+
+/*!
+	Writes generated source to a file through a fixed-size buffer, so that a file is never held
+	in memory as a whole; operations are formatted straight into that buffer.
+*/
+class AssemblyWriter {
+public:
+	/// Opens @c path for writing, replacing anything already there; throws if it can't be opened.
+	AssemblyWriter(const std::filesystem::path &path);
+	~AssemblyWriter();
+
+	AssemblyWriter(const AssemblyWriter &) = delete;
+	AssemblyWriter &operator =(const AssemblyWriter &) = delete;
+
+	AssemblyWriter &operator <<(std::string_view text);
+	AssemblyWriter &operator <<(const std::vector<Operation> &operations);
+
+	/// Writes anything still buffered and closes the file; throws if anything couldn't be written.
+	void close();
+
+private:
+	static constexpr size_t Capacity = 64 * 1024;
+
+	std::filesystem::path path_;
+	std::FILE *file_;
+	std::string buffer_;
+	bool failed_ = false;
+
+	void flush();
+};
@@ -0,0 +1,1841 @@
+//
+//  Encoder.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Encoder.h"
+
+#include "Assembler.h"
+#include "AssemblyWriter.h"
+#include "Executor.h"
+#include "MapDictionary.h"
+#include "OptionalRegisterAllocator.h"
+#include "PaletteOrder.h"
+#include "Palettiser.h"
+#include "TileRegisterAllocator.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+/// The most tiles and sprites compiled to choose the palette order from.
+constexpr size_t PaletteOrderTiles = 32;
+constexpr size_t PaletteOrderSprites = 8;
+
+std::string format(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list measure;
+	va_copy(measure, args);
+	const int length = vsnprintf(nullptr, 0, format, measure);
+	va_end(measure);
+
+	std::string result(size_t(length), '\0');
+	vsnprintf(result.data(), result.size() + 1, format, args);
+	va_end(args);
+	return result;
+}
+
+std::string stringify(const std::vector<Operation> &operations) {
+	std::string code;
+	for(const auto &operation: operations) {
+		append_source(code, operation);
+	}
+	return code;
+}
+
+void write_file(const std::filesystem::path &path, const std::string &contents) {
+	std::ofstream file(path, std::ios::binary);
+	file << contents;
+	if(!file) {
+		throw std::runtime_error(path.string() + ": could not be written");
+	}
+}
+
+std::string read_file(const std::filesystem::path &path) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file) {
+		throw std::runtime_error(path.string() + ": could not be read");
+	}
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/// The position of a tile's top-left corner within a source image.
+struct TileOrigin {
+	int x, y;
+};
+
+/// @returns A 64-bit hash of the tile at @c origin in @c accessor, with each row read right to left
+/// if @c mirrored is @c true. Pixels are mixed in a pair at a time, by multiplication and shift.
+uint64_t tile_hash(const PixelAccessor &accessor, TileOrigin origin, bool mirrored) {
+	uint64_t result = 0;
+	for(int y = 0; y < TileHeight; y++) {
+		const uint32_t *const row = accessor.pixels(size_t(origin.x), size_t(origin.y + y));
+		for(int x = 0; x < TileWidth; x += 2) {
+			const uint64_t pair = mirrored ?
+				uint64_t(row[TileWidth - 1 - x]) | (uint64_t(row[TileWidth - 2 - x]) << 32) :
+				uint64_t(row[x]) | (uint64_t(row[x + 1]) << 32);
+			result = (result ^ pair) * 0x9e3779b97f4a7c15;
+			result ^= result >> 29;
+		}
+	}
+	return result;
+}
+
+/// @returns @c true if the tile at @c lhs is identical to that at @c rhs, mirrored horizontally
+/// if @c mirrored is @c true.
+bool tiles_equal(const PixelAccessor &accessor, TileOrigin lhs, TileOrigin rhs, bool mirrored) {
+	for(int y = 0; y < TileHeight; y++) {
+		const uint32_t *const lhs_row = accessor.pixels(size_t(lhs.x), size_t(lhs.y + y));
+		const uint32_t *const rhs_row = accessor.pixels(size_t(rhs.x), size_t(rhs.y + y));
+		for(int x = 0; x < TileWidth; x++) {
+			if(lhs_row[x] != rhs_row[mirrored ? TileWidth - 1 - x : x]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// @returns @c values as the operands of a DB, in hex.
+template <typename Container> std::string hex_bytes(const Container &values) {
+	std::string result;
+	for(const auto value: values) {
+		result += format(result.empty() ? "0x%02x" : ", 0x%02x", value);
+	}
+	return result;
+}
+
+/// @returns Source for the tile map described by @c columns, each entry of which is a tile index
+/// shifted left by two, followed by the table of differences between each column and the one before it.
+std::string map_source(const std::vector<MapDictionary::Column> &columns) {
+	std::string map;
+	map += "\tmap:\n";
+	for(auto &column : columns) {
+		map += "\t\tdb " + hex_bytes(column) + "\n";
+	}
+
+	map += "\n\tdiffs:\n";
+	for(auto c_it = columns.begin() + 1; c_it != columns.end(); ++c_it) {
+		const auto c_before = c_it - 1;
+
+		const int diffs = [&]() {
+			int total = 0;
+			for(size_t c = 0; c < c_it->size(); c++) {
+				total += (*c_it)[c] != (*c_before)[c];
+			}
+			return total;
+		}();
+
+		const auto flags = MapDictionary::diff(*c_before, *c_it);
+		map += format("\t\tdb %s\t; %d total\n", hex_bytes(flags).c_str(), diffs);
+	}
+
+	return map;
+}
+
+/// @returns Source for @c dictionary: its tables plus the routine that fetches from them.
+std::string dictionary_source(const MapDictionary &dictionary) {
+	const auto cycles = MapDictionary::fetch_cycles();
+	static constexpr size_t DiffSize = sizeof(MapDictionary::Diff);
+	static constexpr size_t Padding = MapDictionary::PairSize - DiffSize - 1;
+	std::string source = format(
+		"\t; The map and diffs tables, compressed: %zu bytes rather than %zu.\n"
+		"\t;\n"
+		"\t; map_columns holds each distinct column of %zu tiles; map_pairs holds each distinct combination of\n"
+		"\t; a column with its differences from the column before, as %zu bytes of differences then a\n"
+		"\t; map_columns index%s; map_stream holds a map_pairs index per map column.\n"
+		"\t;\n"
+		"\t; fetch_column: HL = column number, DE = address of a %zu-byte buffer, which receives the\n"
+		"\t; %zu bytes of differences followed by the column. BC and HL are corrupted; A is preserved.\n"
+		"\t; It takes %zu cycles in the border, %zu during the display.\n\n",
+		dictionary.size(), dictionary.raw_size(),
+		FrameBudget::Rows, DiffSize, Padding ? " and padding" : "",
+		DiffSize + FrameBudget::Rows, DiffSize,
+		cycles.border, cycles.display);
+
+	source += "\tmap_columns:\n";
+	for(const auto &column: dictionary.columns()) {
+		source += "\t\tdb " + hex_bytes(column) + "\n";
+	}
+
+	source += "\n\tmap_pairs:\n";
+	for(const auto &pair: dictionary.pairs()) {
+		source += format("\t\tdb %s, %d", hex_bytes(pair.diff).c_str(), pair.column);
+		for(size_t c = 0; c < Padding; c++) {
+			source += ", 0";
+		}
+		source += "\n";
+	}
+
+	source += "\n\tmap_stream:\n";
+	const auto &stream = dictionary.stream();
+	for(size_t c = 0; c < stream.size(); c += 16) {
+		source += "\t\tdb ";
+		for(size_t index = c; index < std::min(c + 16, stream.size()); index++) {
+			source += format(index == c ? "%d" : ", %d", stream[index]);
+		}
+		source += "\n";
+	}
+
+	source += "\n";
+	source += stringify(MapDictionary::fetch_routine());
+	return source;
+}
+
+/// @returns All PNGs in @c directory, sorted by name so that output is stable across hosts.
+std::vector<std::filesystem::path> image_files(const std::filesystem::path &directory) {
+	std::vector<std::filesystem::path> result;
+	if(!std::filesystem::is_directory(directory)) {
+		return result;
+	}
+	for(const auto &entry: std::filesystem::directory_iterator(directory)) {
+		const auto name = entry.path().filename().string();
+		if(name.size() >= 3 && name.compare(name.size() - 3, 3, "png") == 0) {
+			result.push_back(entry.path());
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+/// @returns The integer with which the file name of @c path begins, e.g. 12 for 12.png.
+int file_index(const std::filesystem::path &path) {
+	return atoi(path.filename().string().c_str());
+}
+
+/// @returns The number of tile indices implied by @c files, i.e. one more than the highest.
+size_t tile_count(const std::vector<std::filesystem::path> &files) {
+	size_t count = 0;
+	for(const auto &file: files) {
+		count = std::max(count, size_t(file_index(file)) + 1);
+	}
+	return count;
+}
+
+/// Screen bytes that a routine is expected to write, by address.
+using Footprint = std::map<size_t, uint8_t>;
+
+/// @returns The footprint of a tile routine for @c slice entered with @c hl, as derived directly
+/// from the tile's pixels; see the header comment in write_tiles for the entry conditions.
+Footprint tile_footprint(const PalettedPixelAccessor &contents, int slice, size_t hl) {
+	// Tiles are stored rotated by 180 degrees, ready for output via the stack.
+	const auto pixel = [&](int x, int y) {
+		return contents.pixel(size_t(TileWidth - 1 - x), size_t(TileHeight - 1 - y)) & 0xf;
+	};
+	const int first = std::max(slice, 0);
+	const int last = TileBytes - 1 + std::min(slice, 0);
+	const int last_offset = (slice & 1) ? 0 : -1;
+
+	Footprint footprint;
+	for(int y = 0; y < TileHeight; y++) {
+		for(int column = first; column <= last; column++) {
+			const auto address =
+				int(hl) + last_offset - (last - column) - (TileHeight - 1 - y) * int(Executor::BytesPerLine);
+			footprint[size_t(address)] = uint8_t((pixel(column * 2, y) << 4) | pixel(column * 2 + 1, y));
+		}
+	}
+	return footprint;
+}
+
+/// @returns The footprint of a sprite routine entered with @c hl, i.e. every byte with at least one
+/// opaque pixel, with any transparent pixel written as colour 0.
+Footprint sprite_footprint(const PalettedPixelAccessor &contents, size_t hl) {
+	Footprint footprint;
+	for(size_t y = 0; y < contents.height(); y++) {
+		for(size_t x = 0; x < contents.width(); x += 2) {
+			const auto left = contents.pixel(x, y);
+			const auto right = contents.pixel(x + 1, y);
+			if(PalettedPixelAccessor::is_transparent(left) && PalettedPixelAccessor::is_transparent(right)) {
+				continue;
+			}
+
+			uint8_t value = 0;
+			if(!PalettedPixelAccessor::is_transparent(left)) value |= left << 4;
+			if(!PalettedPixelAccessor::is_transparent(right)) value |= right;
+			footprint[hl + y * Executor::BytesPerLine + (x >> 1)] = value;
+		}
+	}
+	return footprint;
+}
+
+/// @returns A description of the first difference between the screen in @c executor and one
+/// that was filled with @c fill before @c footprint was written, or an empty string if there is none.
+std::string compare_screen(const Executor &executor, uint8_t fill, const Footprint &footprint) {
+	for(size_t address = 0; address < Executor::ScreenSize; address++) {
+		const auto expected = footprint.find(address);
+		const uint8_t wanted = expected == footprint.end() ? fill : expected->second;
+		const uint8_t found = executor.memory()[address];
+		if(found != wanted) {
+			return format(
+				"byte %zu of line %zu is 0x%02x rather than 0x%02x",
+				address % Executor::BytesPerLine, address / Executor::BytesPerLine, found, wanted
+			);
+		}
+	}
+	return "";
+}
+
+/// Runs a routine twice, once with the screen cleared and memory contended as in the border, once with
+/// the screen filled and memory contended as in the display, so that every byte the routine should write
+/// is seen to change. @c setup prepares registers and returns the expected footprint; @c check tests the
+/// registers at exit, returning a description of any problem.
+template <typename SetupT, typename CheckT>
+Encoder::Verification run_routine(
+	const std::string &name,
+	const std::vector<Operation> &routine,
+	bool is_called,
+	SetupT &&setup,
+	CheckT &&check
+) {
+	Encoder::Verification result{.routine = name};
+	for(const auto contention: {Executor::Contention::Border, Executor::Contention::Display}) {
+		const uint8_t fill = contention == Executor::Contention::Border ? 0x00 : 0xff;
+		Executor executor;
+		std::fill(executor.memory().begin(), executor.memory().begin() + Executor::ScreenSize, fill);
+		const Footprint footprint = setup(executor);
+
+		size_t cycles = 0;
+		try {
+			cycles = is_called ? executor.call(routine, contention) : executor.run(routine, contention);
+		} catch(const std::runtime_error &error) {
+			result.error = error.what();
+			return result;
+		}
+
+		result.error = compare_screen(executor, fill, footprint);
+		if(result.error.empty()) {
+			result.error = check(executor);
+		}
+		if(!result.error.empty()) {
+			return result;
+		}
+
+		(contention == Executor::Contention::Border ? result.border_cycles : result.display_cycles) = cycles;
+	}
+	return result;
+}
+
+/// @returns The indices of the tile sets on @c page, lowest first and each only once.
+std::vector<size_t> page_sets(const PagePlan::Page &page) {
+	std::vector<size_t> sets;
+	for(const auto set: {page.left, page.right}) {
+		if(set && std::find(sets.begin(), sets.end(), *set) == sets.end()) {
+			sets.push_back(*set);
+		}
+	}
+	std::sort(sets.begin(), sets.end());
+	return sets;
+}
+
+}
+
+template <typename FuncT> void Encoder::timed(const char *step, FuncT &&function) {
+	const auto start = std::chrono::steady_clock::now();
+	function();
+	const auto end = std::chrono::steady_clock::now();
+	timings_.push_back(Timing{
+		.step = step,
+		.seconds = std::chrono::duration<double>(end - start).count(),
+	});
+}
+
+template <typename CompileT>
+std::vector<std::vector<Operation>> Encoder::cached(const CacheKey &key, CompileT &&compile) {
+	if(!options_.cache) {
+		return compile();
+	}
+	if(auto routines = options_.cache->find(key)) {
+		return std::move(*routines);
+	}
+	auto routines = compile();
+	options_.cache->store(key, routines);
+	return routines;
+}
+
+// MARK: - Conversion.
+
+void Encoder::dissect(const PixelAccessor &accessor, const std::filesystem::path &directory) {
+	timings_.clear();
+	dictionary_.reset();
+
+	static constexpr size_t Rows = FrameBudget::Rows;
+	std::vector<MapDictionary::Column> columns((accessor.width() + TileWidth - 1) / TileWidth);
+
+	// Select vertical range.
+	const int bottom = static_cast<int>(accessor.height());
+	const int top = bottom - int(Rows) * TileHeight;
+
+	// Hash every tile in that range; columns are independent so are hashed in parallel.
+	std::vector<std::array<uint64_t, Rows>> hashes(columns.size());
+	timed("hash", [&] {
+		WorkStealingPool(options_.threads).parallel_for(columns.size(), [&](size_t column) {
+			for(size_t row = 0; row < Rows; row++) {
+				const TileOrigin origin{.x = int(column) * TileWidth, .y = top + int(row) * TileHeight};
+				hashes[column][row] = tile_hash(accessor, origin, false);
+			}
+		});
+	});
+
+	// Find unique tiles, populating the tile map. Hash matches are confirmed by comparing pixels, and tiles are
+	// numbered in order of first appearance, reading down each column in turn. Indices become map bytes only
+	// once it's known how many tiles there are, which determines how they're dispatched.
+	std::vector<std::array<size_t, Rows>> indices(columns.size());
+	std::vector<TileOrigin> origins;
+	std::vector<std::pair<size_t, size_t>> mirrors;
+	timed("dissect", [&] {
+		std::filesystem::create_directories(directory / "tiles");
+		std::unordered_map<uint64_t, std::vector<size_t>> tiles;
+		const auto find = [&](uint64_t hash, TileOrigin origin, bool mirrored) -> std::optional<size_t> {
+			const auto bucket = tiles.find(hash);
+			if(bucket != tiles.end()) {
+				for(const auto index: bucket->second) {
+					if(tiles_equal(accessor, origins[index], origin, mirrored)) {
+						return index;
+					}
+				}
+			}
+			return std::nullopt;
+		};
+
+		for(size_t column = 0; column < columns.size(); column++) {
+			for(size_t row = 0; row < Rows; row++) {
+				const TileOrigin origin{.x = int(column) * TileWidth, .y = top + int(row) * TileHeight};
+				const auto hash = hashes[column][row];
+
+				auto index = find(hash, origin, false);
+				if(!index) {
+					index = origins.size();
+					if(const auto original = find(tile_hash(accessor, origin, true), origin, true)) {
+						mirrors.emplace_back(*index, *original);
+					}
+
+					origins.push_back(origin);
+					tiles[hash].push_back(*index);
+				}
+				indices[column][row] = *index;
+			}
+		}
+
+		tile_dispatch_ = TileDispatch::for_tiles(origins.size());
+		for(size_t column = 0; column < columns.size(); column++) {
+			for(size_t row = 0; row < Rows; row++) {
+				columns[column][row] = tile_dispatch_->byte(indices[column][row]);
+			}
+		}
+	});
+
+	timed("save", [&] {
+		WorkStealingPool(options_.threads).parallel_for(origins.size(), [&](size_t index) {
+			codec_.save(
+				directory / "tiles" / format("%d.png", int(index)),
+				accessor,
+				origins[index].x, origins[index].y,
+				TileWidth, TileHeight);
+		});
+	});
+
+	// Note mirrored tiles; each still needs its own routine, as there's no way to mirror one as it is drawn,
+	// but they indicate where an artist might economise.
+	std::string map;
+	for(const auto &[index, original]: mirrors) {
+		map += format("\t; Tile %d is tile %d mirrored horizontally.\n", int(index), int(original));
+	}
+	if(!mirrors.empty()) {
+		map += "\n";
+	}
+	map += map_source(columns);
+
+	// Write the map twice: once as the source for any later remapping by encode, and once
+	// for use as-is.
+	write_file(directory / "source_map.z80s", map);
+	write_file(directory / "map.z80s", map);
+	write_dictionary(columns, directory);
+}
+
+void Encoder::write_dictionary(const std::vector<MapDictionary::Column> &columns, const std::filesystem::path &directory) {
+	const auto path = directory / "map_dictionary.z80s";
+	dictionary_ = MapDictionary::compress(columns);
+	if(dictionary_ && dictionary_->saves_space()) {
+		write_file(path, dictionary_source(*dictionary_));
+	} else {
+		std::filesystem::remove(path);
+	}
+}
+
+std::vector<Operation> Encoder::tile_declaration_pair(
+	const std::string *right,
+	const std::string *left,
+	const std::vector<uint8_t> &routines
+) {
+	const auto dispatch = TileDispatch::for_tiles(routines.size());
+	std::vector<Operation> operations;
+	for(const auto *name: {right, left}) {
+		if(!name) continue;
+
+		// Bank n's table is offset by n bytes, so that its entries are where its map bytes point.
+		for(size_t bank = 0; bank < dispatch.banks(); bank++) {
+			operations.push_back(Operation::ds_align(256));
+			if(!bank && (name != right || left != right)) {
+				operations.push_back(Operation::label(format("tiles_%s", name->c_str()).c_str()));
+			}
+			for(size_t c = 0; c < bank; c++) {
+				operations.push_back(Operation::nullary(Operation::Type::NOP));
+			}
+
+			const size_t begin = bank * dispatch.per_bank();
+			const size_t end = std::min(begin + dispatch.per_bank(), routines.size());
+			for(size_t c = begin; c < end; c++) {
+				if(c != begin) {
+					operations.push_back(Operation::nullary(Operation::Type::NOP));
+				}
+				operations.push_back(Operation::jp(format("@+%s_%d", name->c_str(), int(routines[c])).c_str()));
+			}
+			operations.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+			operations.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+		}
+	}
+	return operations;
+}
+
+std::vector<Operation> Encoder::tile(
+	const std::string &name,
+	int slice,
+	uint8_t index,
+	const TileEvents &events,
+	bool permit_ix
+) {
+	auto allocation = options_.allocation;
+	allocation.region = options_.region;
+	TileRegisterAllocator<TileWidth, TileHeight> allocator(events, permit_ix, allocation);
+
+	std::vector<Operation> trial;
+	trial.push_back(Operation::label(format("@%s_%d", name.c_str(), index).c_str()));
+	trial.push_back(Operation::ld(Operand::label_indirect("@+return+1"), Operand::direct(Register::Name::DE)));
+	if(permit_ix) {
+		trial.push_back(
+			Operation::ld(
+				Operand::label_indirect("@+reload_ix+2"),
+				Operand::direct(Register::Name::IX)
+			)
+		);
+	}
+	trial.push_back(Operation::ld(Register::Name::SP, Register::Name::HL));
+
+	RegisterSet set;
+	int stack_count = 0;
+	for(size_t offset = 1; offset <= events.size(); offset++) {
+		const auto &event = events[offset - 1];
+		switch(event.type) {
+			case TileEvent::Type::Stop:	break;
+
+			case TileEvent::Type::Up2:
+				trial.push_back(Operation::unary(Operation::Type::DEC, Register::Name::H));
+				trial.push_back(Operation::ld(Register::Name::SP, Register::Name::HL));
+				trial.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+				stack_count = 0;
+			break;
+			case TileEvent::Type::Down2:
+				trial.push_back(Operation::unary(Operation::Type::INC, Register::Name::H));
+				trial.push_back(Operation::ld(Register::Name::SP, Register::Name::HL));
+				trial.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+				stack_count = 0;
+			break;
+			case TileEvent::Type::Up1: {
+				const bool might_be_at_screen_edge = !(slice&1) && (slice <= 0);
+				if(might_be_at_screen_edge) {
+					trial.push_back(Operation::unary(Operation::Type::DEC, Register::Name::HL));
+					trial.push_back(Operation::unary(Operation::Type::RES7, Register::Name::L));
+					trial.push_back(Operation::unary(Operation::Type::INC, Register::Name::L));
+				} else {
+					trial.push_back(Operation::unary(Operation::Type::RES7, Register::Name::L));
+				}
+				// To consider: if an extra 8kb is available for a duplicate set of the full-size tiles,
+				// use those for everywhere except the rightmost column and implement them as `res 7`.
+
+				trial.push_back(Operation::ld(Register::Name::SP, Register::Name::HL));
+				trial.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+				stack_count = 0;
+			} break;
+
+			case TileEvent::Type::OutputWord: {
+				stack_count += 2;
+				const auto action = allocator.next_word(offset, event.content);
+				switch(action.type) {
+					case RegisterEvent::Type::Load:
+						trial.push_back(set.load(action.reg, action.value));
+						[[fallthrough]];
+					case RegisterEvent::Type::Reuse:
+						trial.push_back(Operation::unary(Operation::Type::PUSH, Register::pair(action.reg)));
+					break;
+
+					case RegisterEvent::Type::UseConstant:
+						throw 0;	// Impossible.
+					break;
+				}
+			} break;
+			case TileEvent::Type::OutputByte: {
+				const auto action = allocator.next_byte(offset, uint8_t(event.content));
+				switch(action.type) {
+					case RegisterEvent::Type::Load:
+						trial.push_back(set.load(action.reg, action.value));
+						[[fallthrough]];
+					case RegisterEvent::Type::Reuse:
+						trial.push_back(
+							Operation::ld(
+								Operand::indirect(Register::Name::HL),
+								Operand::direct(action.reg)
+							)
+						);
+					break;
+
+					case RegisterEvent::Type::UseConstant:
+						trial.push_back(
+							Operation::ld(
+								Operand::indirect(Register::Name::HL),
+								Operand::immediate<uint8_t>(uint8_t(action.value))
+							)
+						);
+					break;
+				}
+			} break;
+		}
+	}
+
+	if(permit_ix) {
+		trial.push_back(Operation::label("@reload_ix"));
+		trial.push_back(
+			Operation::ld(
+				Operand::direct(Register::Name::IX),
+				Operand::immediate<uint16_t>(0x1234)
+			)
+		);
+	}
+	trial.push_back(Operation::label("@return"));
+	trial.push_back(Operation::jp(0x1234));
+	trial.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+	return trial;
+}
+
+Encoder::Assets Encoder::load_assets(const std::filesystem::path &directory) {
+	// Get list of all PNGs.
+	const auto tile_files = image_files(directory / "tiles");
+	const auto sprite_files = image_files(directory / "sprites");
+	const auto clippable_files = image_files(directory / "clippables");
+
+	// Tile indices are stored in a byte, so check first that there aren't too many.
+	tile_dispatch_ = TileDispatch::for_tiles(tile_count(tile_files));
+
+	std::vector<std::filesystem::path> all_files = tile_files;
+	all_files.insert(all_files.end(), sprite_files.begin(), sprite_files.end());
+	all_files.insert(all_files.end(), clippable_files.begin(), clippable_files.end());
+
+	// Decode everything up front; all later uses of each image are then served from memory.
+	timed("load", [&] {
+		for(const auto &file: all_files) {
+			images_.load(file);
+		}
+	});
+
+	// Build palette based on tiles and sprites.
+	Palettiser palettiser;
+	Assets assets;
+	timed("palettise", [&] {
+		for(const auto &file: all_files) {
+			const auto accessor = images_.load(file);
+			palettiser.add_colours(*accessor);
+		}
+		assets.palette = palettiser.palette();
+	});
+
+	// Prepare lists of tiles and sprites for future dicing and writing. Of tiles that are distinct in
+	// the source but identical once palettised, only the lowest-numbered is kept.
+	const auto decode = [&] {
+		assets.tiles.clear();
+		assets.tile_routines.clear();
+		assets.sprites.clear();
+
+		std::vector<TileSerialiser<TileWidth, TileHeight>> tiles;
+		// Tiles are keyed by a fixed-size copy of their pixels; dissect writes them at exactly the tile size.
+		using TilePixels = std::array<uint8_t, TileWidth * TileHeight>;
+		const auto pixels = [](const auto &tile) {
+			const auto &all_pixels = tile.contents().all_pixels();
+			TilePixels result;
+			std::copy_n(all_pixels.begin(), result.size(), result.begin());
+			return result;
+		};
+		std::map<TilePixels, uint8_t> lowest;
+		for(const auto &file: tile_files) {
+			const auto accessor = images_.load(file);
+			if(accessor->width() != TileWidth || accessor->height() != TileHeight) {
+				throw std::runtime_error(
+					format("%s: tile is %zux%zu pixels rather than %dx%d",
+						file.string().c_str(), accessor->width(), accessor->height(), TileWidth, TileHeight));
+			}
+			const auto &tile = tiles.emplace_back(
+				file_index(file),
+				*accessor,
+				assets.palette);
+			const auto existing = lowest.try_emplace(pixels(tile), tile.index()).first;
+			existing->second = std::min(existing->second, tile.index());
+		}
+
+		for(auto &tile: tiles) {
+			while(assets.tile_routines.size() <= tile.index()) {
+				assets.tile_routines.push_back(uint8_t(assets.tile_routines.size()));
+			}
+			const auto routine = lowest[pixels(tile)];
+			assets.tile_routines[tile.index()] = routine;
+			if(routine == tile.index()) {
+				assets.tiles.push_back(std::move(tile));
+			}
+		}
+
+		for(const auto &file: sprite_files) {
+			const auto accessor = images_.load(file);
+			assets.sprites.emplace_back(
+				file_index(file),
+				*accessor,
+				assets.palette,
+				SpriteSerialiser::Order::RowsFirstDownward);
+		}
+		for(const auto &file: clippable_files) {
+			const auto accessor = images_.load(file);
+			assets.sprites.emplace_back(
+				file_index(file),
+				*accessor,
+				assets.palette,
+				SpriteSerialiser::Order::ColumnsFirstRightward);
+		}
+	};
+	timed("decode", decode);
+
+	// Pick palette indices to suit the code generated. Loads are sampled from the full tile set and
+	// the sprites as compiled with the palette as it stands; the colour most common in the tiles is
+	// taken to be the background and is always given index 0.
+	//
+	// Compiling everything here would nearly double the cost of an uncached run, so only an evenly-spaced
+	// selection of tiles and sprites is compiled; loads are similar enough from one to the next for
+	// that to lead to much the same order.
+	timed("order", [&] {
+		const auto sample = [](const auto &all, size_t limit) {
+			std::remove_cvref_t<decltype(all)> result;
+			const size_t count = std::min(all.size(), limit);
+			for(size_t c = 0; c < count; c++) {
+				result.push_back(all[c * all.size() / count]);
+			}
+			return result;
+		};
+
+		std::array<size_t, 16> frequencies{};
+		for(const auto &tile: assets.tiles) {
+			for(const auto pixel: tile.contents().all_pixels()) {
+				if(pixel < frequencies.size()) ++frequencies[pixel];
+			}
+		}
+		const auto background =
+			uint8_t(std::max_element(frequencies.begin(), frequencies.end()) - frequencies.begin());
+
+		PaletteOrder order;
+		std::vector<TileSet> sets{TileSet{.name = "full", .slice = 0}};
+		compile_sets(sample(assets.tiles, PaletteOrderTiles), sets);
+		for(const auto &routine: sets.front().routines) {
+			order.add(routine);
+		}
+		for(const auto &routine: compile_sprites(sample(assets.sprites, PaletteOrderSprites)).routines) {
+			order.add(routine);
+		}
+		assets.palette.reorder(order.search(background, options_.region));
+	});
+	timed("decode", decode);
+
+	return assets;
+}
+
+void Encoder::encode(const std::filesystem::path &directory) {
+	timings_.clear();
+	dictionary_.reset();
+	const auto assets = load_assets(directory);
+
+	// Rewrite the map in terms of the tiles actually compiled, so that the differences
+	// between columns are those that remain after palettisation.
+	if(std::filesystem::exists(directory / "source_map.z80s")) {
+		timed("map", [&] {
+			auto map = FrameBudget::parse_map(read_file(directory / "source_map.z80s"));
+			for(auto &column: map.columns) {
+				for(auto &tile: column) {
+					const size_t index = tile_dispatch_->index(tile);
+					if(index >= assets.tile_routines.size()) {
+						throw std::runtime_error("Map refers to tile " + std::to_string(index) + " which doesn't exist");
+					}
+					tile = tile_dispatch_->byte(assets.tile_routines[index]);
+				}
+			}
+			write_file(directory / "map.z80s", map_source(map.columns));
+			write_dictionary(map.columns, directory);
+		});
+	}
+
+	// Write palette, in Sam format.
+	write_palette(assets.palette.sam_palette, directory / "palette.z80s");
+
+	// Compile all.
+	timed("sprites", [&] {
+		write_sprites(compile_sprites(assets.sprites), directory);
+	});
+	timed("tiles", [&] {
+		write_tiles(compile_tiles(assets.tiles, assets.tile_routines.size()), assets.tile_routines, directory);
+	});
+}
+
+std::vector<Encoder::Verification> Encoder::verify(const std::filesystem::path &directory) {
+	timings_.clear();
+	const auto assets = load_assets(directory);
+	std::optional<FrameBudget::Map> map;
+	if(std::filesystem::exists(directory / "map.z80s")) {
+		map = FrameBudget::parse_map(read_file(directory / "map.z80s"));
+	}
+
+	CompiledSprites sprites;
+	timed("sprites", [&] {
+		sprites = compile_sprites(assets.sprites);
+	});
+	CompiledTiles tiles;
+	timed("tiles", [&] {
+		tiles = compile_tiles(assets.tiles, assets.tile_routines.size());
+	});
+
+	std::vector<Verification> results;
+	timed("verify", [&] {
+		// Tiles are drawn with the bottom line odd, as required for the move between the two halves
+		// of each tile to be a RES 7, L. Those slices that might end at the right edge of the screen
+		// are also tested there, where HL points to the start of the following line.
+		static constexpr size_t BottomLine = 101;
+		static constexpr uint16_t PreservedIX = 0x3c5a;
+		for(const auto &set: tiles.sets) {
+			for(size_t index = 0; index < assets.tiles.size(); index++) {
+				const auto routine = tiles.tails.linked(set.routines[index]);
+				std::vector<size_t> entries = {BottomLine * Executor::BytesPerLine + Executor::BytesPerLine / 2};
+				if(!(set.slice & 1) && set.slice <= 0) {
+					entries.push_back((BottomLine + 1) * Executor::BytesPerLine);
+				}
+
+				for(const auto hl: entries) {
+					const auto &tile = assets.tiles[index];
+					auto result = run_routine(
+						format("%s_%d", set.name.c_str(), tile.index()),
+						routine,
+						false,
+						[&](Executor &executor) {
+							executor.set_value(Register::Name::HL, uint16_t(hl));
+							executor.set_value(Register::Name::DE, Executor::ReturnAddress);
+							executor.set_value(Register::Name::IX, PreservedIX);
+							return tile_footprint(tile.contents(), set.slice, hl);
+						},
+						[&](const Executor &executor) -> std::string {
+							if(executor.value(Register::Name::IX) != PreservedIX) {
+								return "IX was not preserved";
+							}
+							if(executor.value(Register::Name::HL) != hl - Executor::BytesPerLine) {
+								return "HL was not left one line above its entry value";
+							}
+							return "";
+						}
+					);
+
+					// Report timings only for the first entry point, but errors from either.
+					if(hl == entries.front() || !result.error.empty()) {
+						results.push_back(std::move(result));
+					}
+				}
+			}
+		}
+
+		// Sprites are drawn centred horizontally, a little way down the screen.
+		static constexpr uint16_t StackTop = 0xff00;
+		for(size_t index = 0; index < assets.sprites.size(); index++) {
+			const auto &sprite = assets.sprites[index];
+			const auto &routine = sprites.routines[index];
+			const size_t hl =
+				16 * Executor::BytesPerLine + (Executor::BytesPerLine - sprite.contents().width() / 2) / 2;
+			auto name = std::get<Label>(routine.front().destination->value).str();
+			if(name[0] == '@') {
+				name.erase(0, 1);
+			}
+			results.push_back(run_routine(
+				name,
+				routine,
+				true,
+				[&](Executor &executor) {
+					executor.set_value(Register::Name::HL, uint16_t(hl));
+					executor.set_value(Register::Name::SP, StackTop);
+					return sprite_footprint(sprite.contents(), hl);
+				},
+				[&](const Executor &executor) -> std::string {
+					if(executor.value(Register::Name::SP) != StackTop) {
+						return "SP was not restored";
+					}
+					return "";
+				}
+			));
+		}
+
+		// The map is fetched column by column from its dictionary form, if it has a worthwhile one, into a buffer
+		// on screen.
+		if(map) {
+			const auto dictionary = MapDictionary::compress(map->columns);
+			if(!dictionary || !dictionary->saves_space()) return;
+
+			static constexpr MapDictionary::Layout layout{.stream = 0x8000, .pairs = 0x6000, .columns = 0x6800};
+			static constexpr uint16_t Buffer = 0x1000;
+			static constexpr uint16_t BufferEnd = Buffer + sizeof(MapDictionary::Diff) + sizeof(MapDictionary::Column);
+			const auto fetch = MapDictionary::fetch_routine(layout);
+			for(size_t column = 0; column < map->columns.size(); column++) {
+				results.push_back(run_routine(
+					format("fetch_column_%zu", column),
+					fetch,
+					true,
+					[&](Executor &executor) {
+						auto &memory = executor.memory();
+						std::copy(dictionary->stream().begin(), dictionary->stream().end(), memory.begin() + layout.stream);
+						for(size_t index = 0; index < dictionary->pairs().size(); index++) {
+							const auto &pair = dictionary->pairs()[index];
+							const size_t entry = layout.pairs + index * MapDictionary::PairSize;
+							std::copy(pair.diff.begin(), pair.diff.end(), memory.begin() + entry);
+							memory[entry + pair.diff.size()] = pair.column;
+						}
+						for(size_t index = 0; index < dictionary->columns().size(); index++) {
+							const auto &source = dictionary->columns()[index];
+							std::copy(source.begin(), source.end(), memory.begin() + layout.columns + index * source.size());
+						}
+
+						executor.set_value(Register::Name::HL, uint16_t(column));
+						executor.set_value(Register::Name::DE, Buffer);
+						executor.set_value(Register::Name::SP, 0xff00);
+
+						// The first column has no predecessor, so all of it is marked as different.
+						const auto diff = column ?
+							MapDictionary::diff(map->columns[column - 1], map->columns[column]) :
+							MapDictionary::all_rows();
+						Footprint footprint;
+						for(size_t index = 0; index < diff.size(); index++) {
+							footprint[Buffer + index] = diff[index];
+						}
+						for(size_t row = 0; row < map->columns[column].size(); row++) {
+							footprint[Buffer + diff.size() + row] = map->columns[column][row];
+						}
+						return footprint;
+					},
+					[&](const Executor &executor) -> std::string {
+						if(executor.value(Register::Name::DE) != BufferEnd) {
+							return "DE was not left at the end of the buffer";
+						}
+						return "";
+					}
+				));
+			}
+		}
+	});
+
+	return results;
+}
+
+std::vector<FrameBudget::Position> Encoder::budget(const std::filesystem::path &directory) {
+	timings_.clear();
+	const auto map = FrameBudget::parse_map(read_file(directory / "map.z80s"));
+	const auto assets = load_assets(directory);
+
+	CompiledTiles tiles;
+	timed("tiles", [&] {
+		tiles = compile_tiles(assets.tiles, assets.tile_routines.size());
+	});
+
+	std::vector<FrameBudget::Position> positions;
+	timed("budget", [&] {
+		std::unordered_map<std::string, std::vector<std::optional<FrameBudget::Cycles>>> costs;
+		for(const auto &set: tiles.sets) {
+			std::vector<std::optional<FrameBudget::Cycles>> compiled(assets.tile_routines.size());
+			for(size_t index = 0; index < assets.tiles.size(); index++) {
+				compiled[assets.tiles[index].index()] = FrameBudget::cycles(tiles.tails.linked(set.routines[index]));
+			}
+
+			// Tiles that were merged with another during palettisation cost whatever that one does.
+			auto &set_costs = costs[set.name];
+			for(const auto routine: assets.tile_routines) {
+				set_costs.push_back(compiled[routine]);
+			}
+		}
+		positions = FrameBudget(std::move(costs), *tile_dispatch_, options_.region).analyse(map);
+	});
+
+	// Tabulate as a percentage of the frame: a row per map column, a column per 2-pixel step within it.
+	std::string table =
+		format("; Worst-case cost of redrawing after a scroll, as a percentage of the %zu memory windows in a frame.\n",
+			FrameBudget::WindowsPerFrame) +
+		"; Rows are the map column at the left of the display; columns are pixel offsets within it.\n"
+		"; Overruns are marked with a !.\n"
+		";\n"
+		";  column";
+	for(int offset = 0; offset < TileWidth; offset += 2) {
+		table += format("  %5d", offset);
+	}
+	for(const auto &position: positions) {
+		if(!(position.x % TileBytes)) {
+			table += format("\n%9zu", position.x / TileBytes);
+		}
+		table += format(" %5.1f%c",
+			100.0 * position.windows() / double(FrameBudget::WindowsPerFrame),
+			position.over_budget() ? '!' : ' ');
+	}
+	table += "\n";
+	write_file(directory / "budget.txt", table);
+
+	return positions;
+}
+
+Encoder::CompiledTiles Encoder::compile_tiles(const std::vector<TileSerialiser<TileWidth, TileHeight>> &tiles, size_t entries) {
+	// Tile sets are compiled in the order: full; then each left_n, right_(TileBytes-n) pair for n = TileBytes-1
+	// down to 1.
+	std::vector<TileSet> sets;
+	sets.push_back(TileSet{.name = "full", .slice = 0});
+	for(int left_size = TileBytes - 1; left_size > 0; left_size--) {
+		sets.push_back(TileSet{.name = format("left_%d", left_size), .slice = left_size - TileBytes});
+		sets.push_back(TileSet{.name = format("right_%d", TileBytes - left_size), .slice = left_size});
+	}
+	compile_sets(tiles, sets);
+
+	// Plan pages by the measured size of every set, before any tails are shared. Sharing can only
+	// shrink a page, and is possible only once it's known which routines share a page.
+	std::vector<PagePlan::Set> measured;
+	for(const auto &set: sets) {
+		size_t size = 0;
+		for(const auto &routine: set.routines) {
+			size += Assembler::size(routine);
+		}
+		measured.push_back(PagePlan::Set{
+			.name = set.name,
+			.slot = set.slice ? (set.slice < 0 ? PagePlan::Slot::Left : PagePlan::Slot::Right) : PagePlan::Slot::Both,
+			.tiles = entries,
+			.size = size,
+		});
+	}
+
+	CompiledTiles compiled{.sets = std::move(sets), .plan = PagePlan::pack(measured, options_.tile_pages)};
+	if(options_.share_tails) {
+		for(const auto &page: compiled.plan.pages()) {
+			std::vector<std::vector<Operation> *> routines;
+			for(const auto set: page_sets(page)) {
+				for(auto &routine: compiled.sets[set].routines) {
+					routines.push_back(&routine);
+				}
+			}
+			compiled.tails.share(routines);
+		}
+	}
+	return compiled;
+}
+
+void Encoder::compile_sets(const std::vector<TileSerialiser<TileWidth, TileHeight>> &tiles, std::vector<TileSet> &sets) {
+	WorkStealingPool pool(options_.threads);
+
+	// Serialise every (set, tile) once, for use by both of its trials. Each job works on its own copy
+	// of the tile because the serialisers are stateful, but copies share their pixels so cost no allocation.
+	std::vector<TileEvents> events(sets.size() * tiles.size());
+	pool.parallel_for(events.size(), [&](size_t job) {
+		auto source = tiles[job % tiles.size()];
+		source.set_slice(sets[job / tiles.size()].slice);
+		events[job] = source.events();
+	});
+
+	// Compile every (set, tile, with or without IX) trial in parallel. Results are stored by job
+	// index so that the output is the same as a serial run regardless of scheduling.
+	const size_t jobs_per_set = tiles.size() * 2;
+	std::vector<std::vector<Operation>> trials(sets.size() * jobs_per_set);
+	pool.parallel_for(trials.size(), [&](size_t job) {
+		const size_t set_index = job / jobs_per_set;
+		const size_t tile_index = (job % jobs_per_set) >> 1;
+		const auto &set = sets[set_index];
+		const auto &source = tiles[tile_index];
+		const bool permit_ix = job & 1;
+
+		// Tile routines are cached without their opening label, so that a tile's code
+		// can be reused whatever its index and set name.
+		CacheKey key;
+		key.append(std::string("tile"));
+		key.append(uint8_t(TileWidth));
+		key.append(uint8_t(TileHeight));
+		key.append(set.slice);
+		key.append(uint8_t(permit_ix));
+		key.append(uint64_t(options_.allocation.spill_limit));
+		key.append(options_.region.border);
+		key.append(options_.region.display);
+		if(options_.allocation.exact) {
+			key.append(std::string("exact"));
+			key.append(uint64_t(options_.allocation.expansion_limit));
+			key.append(uint64_t(options_.allocation.state_limit));
+		}
+		key.append(source.contents().all_pixels().data(), source.contents().all_pixels().size());
+		auto body = cached(key, [&] {
+			auto trial = tile(set.name, set.slice, source.index(), events[set_index * tiles.size() + tile_index], permit_ix);
+			trial.erase(trial.begin());
+			return std::vector<std::vector<Operation>>{trial};
+		});
+
+		auto &trial = trials[job];
+		trial.push_back(Operation::label(format("@%s_%d", set.name.c_str(), source.index()).c_str()));
+		trial.insert(trial.end(), body[0].begin(), body[0].end());
+	});
+
+	// Keep whichever of each pair of trials has the lower cost, preferring the one without IX.
+	for(size_t set = 0; set < sets.size(); set++) {
+		for(size_t tile = 0; tile < tiles.size(); tile++) {
+			auto &sans_ix = trials[set * jobs_per_set + tile * 2];
+			auto &plus_ix = trials[set * jobs_per_set + tile * 2 + 1];
+			sets[set].routines.push_back(
+				std::move(cost(plus_ix, options_.region) < cost(sans_ix, options_.region) ? plus_ix : sans_ix)
+			);
+		}
+	}
+}
+
+void Encoder::write_tiles(
+	const CompiledTiles &tiles,
+	const std::vector<uint8_t> &routines,
+	const std::filesystem::path &directory
+) {
+	// Assemble every page whether or not binaries are wanted, to establish exactly how full each is;
+	// that also catches any overflow, or any reference to a label that doesn't exist.
+	const auto &sets = tiles.sets;
+	const auto name = [&](const std::optional<size_t> &set) {
+		return set ? &sets[*set].name : nullptr;
+	};
+	const auto page_symbols = [&](const PagePlan::Page &page) {
+		std::vector<std::pair<std::string, uint16_t>> symbols;
+		for(const auto set: {page.right, page.left == page.right ? std::nullopt : page.left}) {
+			if(set) {
+				symbols.emplace_back(format("tiles_%s_page", sets[*set].name.c_str()), uint16_t(page.number + 0b00100000));
+			}
+		}
+		return symbols;
+	};
+
+	Assembler assembler;
+	for(const auto &page: tiles.plan.pages()) {
+		assembler.begin_page(page.number, page.origin, page.span);
+		for(const auto &[symbol, value]: page_symbols(page)) {
+			assembler.define(symbol, value);
+		}
+		assembler << tile_declaration_pair(name(page.right), name(page.left), routines);
+		for(const auto set: page_sets(page)) {
+			for(const auto &routine: sets[set].routines) {
+				assembler << routine;
+			}
+		}
+	}
+	assembler.link();
+
+	tile_pages_.clear();
+	for(size_t c = 0; c < assembler.pages().size(); c++) {
+		const auto &page = assembler.pages()[c];
+		TilePage usage{.number = page.number, .span = page.span, .size = page.bytes.size(), .free = page.free()};
+		for(const auto set: page_sets(tiles.plan.pages()[c])) {
+			usage.sets.push_back(sets[set].name);
+		}
+		tile_pages_.push_back(usage);
+	}
+
+	AssemblyWriter code(directory / "tiles.z80s");
+	code <<
+		"\t; The following tile outputters are automatically generated.\n"
+		"\t;\n"
+		"\t; Input:\n"
+		"\t;	* for tiles that are an even number of byes wide, HL points to one after the lower right corner of the "
+				"output location;\n"
+		"\t;	* for tiles that are an odd number of bytes wide, HL points to the lower right corner of the output "
+				"location;\n"
+		"\t;	* DE is a link register, indicating where the function should return to.\n"
+		"\t;\n"
+		"\t; Rules:\n"
+		"\t;	* IX should be preserved; and\n"
+		"\t;	* SP is overtly available for any use the outputter prefers.\n"
+		"\t;\n"
+		"\t; At exit:\n"
+		"\t;	* HL will be 1 line earlier than it was at input.\n"
+		"\t; i.e. if stacking tiles from bottom to top, the caller will need to subtract a\n"
+		"\t; further " + std::to_string(TileHeight - 1) + "*128 from HL before calling the next outputter.\n"
+		"\t;\n"
+		"\t; Each set of tiles is preceded by a long sequence of JP statements that jump to each tile in turn;\n"
+		"\t; this is the means by which dynamic branching happens elsewhere — the map is stored as the low byte\n"
+		"\t; of JP that branches into the tile to be drawn. Although slightly circuitous, this proved to be the\n"
+		"\t; fastest way of implementing that step subject to the bounds of my imagination.\n"
+		"\t;\n";
+	if(const auto dispatch = TileDispatch::for_tiles(routines.size()); dispatch.banks() > 1) {
+		code << format(
+			"\t; There are too many tiles for a single table, so each set has %zu tables of each kind, one per bank\n"
+			"\t; of %zu tiles. Bank n's table begins n bytes into its 256, so the map byte is still the low byte of\n"
+			"\t; the JP; its low two bits are the bank, which the slivers use to select the high byte.\n"
+			"\t;\n",
+			dispatch.banks(), dispatch.per_bank());
+	}
+	if(tiles.tails.saved()) {
+		code << format(
+			"\t; Routines that end alike on the same page share a single copy of that ending, saving %zu bytes.\n"
+			"\t;\n",
+			tiles.tails.saved());
+	}
+	code << "\t; Pages:\n";
+	for(const auto &page: tile_pages_) {
+		std::string contents;
+		for(const auto &set: page.sets) {
+			contents += (contents.empty() ? "" : " and ") + set;
+		}
+		code << format("\t;	* %s holds %s: %zu bytes, leaving %zu free.\n", page.name().c_str(), contents.c_str(), page.size, page.free);
+	}
+	code << "\n";
+
+	if(options_.assemble) {
+		assembler.write(directory, "tiles");
+
+		code <<
+			"\t; The outputters themselves have been assembled already; what follows places each page's binary\n"
+			"\t; and declares every label that's visible from outside. See tiles.map for a full layout.\n"
+			"\n";
+		for(const auto &page: assembler.pages()) {
+			code << format("\tORG %d\n\tDUMP %d, %d\n\tMDAT \"tiles_%d.bin\"\n\n", page.origin, page.number, page.origin, page.number);
+		}
+		code << assembler.symbol_source();
+		code.close();
+		return;
+	}
+
+	for(const auto &page: tiles.plan.pages()) {
+		code << format("\tORG %d\n\tDUMP %d, %d\n", page.origin, page.number, page.origin);
+		for(const auto &[symbol, value]: page_symbols(page)) {
+			code << format("\t%s: EQU %d + 0b00100000\n", symbol.c_str(), page.number);
+		}
+		code << tile_declaration_pair(name(page.right), name(page.left), routines);
+		for(const auto set: page_sets(page)) {
+			for(const auto &routine: sets[set].routines) {
+				code << routine;
+			}
+		}
+	}
+
+	code.close();
+}
+
+void Encoder::append_clippable_dispatch_group(
+	const std::vector<ColumnCapture> &columns,
+	std::vector<Operation> &operations,
+	const std::vector<Operation> &source_operations,
+	int index
+) {
+	operations.push_back(Operation::ds_align(256));
+	operations.push_back(
+		Operation::label(format("clippable_%d", index).c_str())
+	);
+
+	operations.push_back(Operation::nullary(Operation::Type::EX_DE_HL));
+	operations.push_back(Operation::jp(format("@-clippable_full_%d", index).c_str()));
+	operations.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+
+	// Write late starts.
+	int x = 1;
+	for(const auto &column: columns) {
+		RegisterSet state;
+		operations.push_back(Operation::ds_align(16));
+		operations.push_back(Operation::nullary(Operation::Type::EX_DE_HL));
+
+		// Job here is to establish state...
+
+		// Update HL to point to the start of this line.
+		const uint16_t target = uint16_t((column.initial_y * 128) + x);
+		operations.push_back(state.load(Register::Name::BC, target));
+		operations.push_back(Operation::add(Register::Name::HL, Register::Name::BC));
+
+		// Write out captured registers.
+		for(auto reg: {Register::Name::A, Register::Name::BC, Register::Name::DE}) {
+			if(Register::size(reg) == 1) {
+				if(const auto value = column.registers.value<uint8_t>(reg)) {
+					operations.push_back(state.load(reg, *value));
+				}
+				continue;
+			}
+
+			if(const auto value = column.registers.value<uint16_t>(reg)) {
+				operations.push_back(state.load(reg, *value));
+				continue;
+			}
+
+			const auto high = Register::high_part(reg);
+			const auto low = Register::low_part(reg);
+			if(const auto value = column.registers.value<uint8_t>(high)) {
+				operations.push_back(state.load(high, *value));
+			}
+			if(const auto value = column.registers.value<uint8_t>(low)) {
+				operations.push_back(state.load(low, *value));
+			}
+		}
+
+		// Jump to proper destination.
+		operations.push_back(Operation::jp(
+			format("@-clippable_%d_column%d", index, x).c_str()
+		));
+		operations.push_back(Operation::nullary(Operation::Type::BLANK_LINE));
+
+		// Track columns.
+		++x;
+	}
+
+	// Write early stops.
+	x = 7;
+	auto col = columns.crbegin();
+	while(col != columns.crend()) {
+		const auto &column = *col;
+		++col;
+		operations.push_back(Operation::ds_align(16));
+		operations.push_back(Operation::nullary(Operation::Type::EX_DE_HL));
+
+		// Insert an early RET.
+		operations.push_back(Operation::ld(
+			Operand::direct(Register::Name::A),
+			Operand::immediate<uint8_t>(0xc9)
+		));
+		operations.push_back(Operation::ld(
+			Operand::label_indirect(
+				format("@-clippable_%d_column%d", index, x).c_str()
+			),
+			Operand::direct(Register::Name::A)
+		));
+
+		// Call into the main routine.
+		operations.push_back(Operation::call(
+			format("@-clippable_full_%d", index).c_str()
+		));
+
+		// Return the original value at the label, which is a huge hassle because I can think of no way to
+		// get the assembler to substitute the proper opcode for me.
+		//
+		// Luckily it should always be a LD (HL), <something>.
+		const auto &operation = source_operations[column.next_operation];
+		assert(operation.type == Operation::Type::LD);
+		assert(
+			operation.destination &&
+			operation.source &&
+			operation.destination->type == Operand::Type::Indirect &&
+			std::get<Register::Name>(operation.destination->value) == Register::Name::HL
+		);
+		const auto opcode = [&]{
+			if(operation.source->type == Operand::Type::Immediate) {
+				return 0x36;
+			}
+			assert(operation.source->type == Operand::Type::Direct);
+			switch (std::get<Register::Name>(operation.source->value)) {
+				case Register::Name::A:	return 0x77;
+				case Register::Name::B:	return 0x70;
+				case Register::Name::C:	return 0x71;
+				case Register::Name::D:	return 0x72;
+				case Register::Name::E:	return 0x73;
+
+				default:
+					assert(false);
+					return 0x00;
+			}
+		}();
+
+		operations.push_back(Operation::ld(
+			Operand::direct(Register::Name::A),
+			Operand::immediate<uint8_t>(uint8_t(opcode))
+		));
+		operations.push_back(Operation::ld(
+			Operand::label_indirect(
+				format("@-clippable_%d_column%d", index, x).c_str()
+			),
+			Operand::direct(Register::Name::A)
+		));
+
+		// Return.
+		operations.push_back(Operation::nullary(Operation::Type::RET));
+		--x;
+	}
+}
+
+std::vector<Operation> Encoder::sprite(SpriteSerialiser sprite, std::vector<Operation> &dispatch, bool stack_runs) {
+	using Name = Register::Name;
+	using Type = Operation::Type;
+
+	const bool is_clippable = sprite.order() != SpriteSerialiser::Order::RowsFirstDownward;
+	stack_runs &= !is_clippable;
+
+	// Serialise.
+	std::vector<SpriteEvent> events;
+	sprite.reset();
+	while(true) {
+		const auto event = sprite.next();
+		if(event.type == SpriteEvent::Type::Stop) {
+			break;
+		}
+		events.push_back(event);
+	}
+
+	// Runs output via the stack, as [start, end) event indices.
+	using Runs = std::map<size_t, size_t>;
+	using Allocations = std::vector<Allocation<uint8_t>>;
+
+	// Obtains register allocations for every byte other than those in @c pushed, which don't need them.
+	const auto allocate_registers = [&](const Runs &pushed) {
+		OptionalRegisterAllocator<uint8_t> register_allocator(
+			std::vector<Register::Name>{Register::Name::A, Register::Name::D, Register::Name::E}
+		);
+		auto run = pushed.begin();
+		for(size_t time = 0; time < events.size(); time++) {
+			if(run != pushed.end() && time == run->second) ++run;
+			if(run != pushed.end() && time >= run->first) continue;
+
+			if(events[time].type == SpriteEvent::Type::OutputByte) {
+				register_allocator.add_value(Time(time), events[time].content.output);
+			}
+		}
+		return register_allocator.spans();
+	};
+
+	// Everything that is forked when trying alternative encodings of a run.
+	struct State {
+		RegisterSet registers;
+		Allocations::const_iterator allocation;
+
+		/// The register most recently allocated to each value, if any, which is used in preference to any other
+		/// that happens to hold the same value, so that allocations are always used.
+		std::array<std::optional<Name>, 256> allocated;
+
+		/// The address in HL, relative to the sprite's origin.
+		uint16_t hl = 0;
+
+		/// The address to which HL should move before the next output, if it has yet to; moves are made lazily so
+		/// that a run output via the stack can move straight to its end.
+		std::optional<uint16_t> destination;
+	};
+
+	struct Generated {
+		std::vector<Operation> operations;
+		std::vector<ColumnCapture> column_captures;
+		Runs pushed;
+	};
+
+	// Generates code using @c allocations. If @c forced is non-null then exactly the runs in it are output
+	// via the stack; otherwise each run of sufficient length is output via the stack if that's cheaper.
+	const auto generate = [&](const Allocations &allocations, const Runs *forced) {
+		Generated result;
+		auto &operations = result.operations;
+
+		// Applies a new allocation if one pops into existence at @c time.
+		const auto allocate = [&](std::vector<Operation> &target, State &state, size_t time) {
+			if(state.allocation != allocations.end() && state.allocation->time == Time(time)) {
+				target.push_back(state.registers.load(state.allocation->reg, state.allocation->value));
+				state.allocated[state.allocation->value] = state.allocation->reg;
+				++state.allocation;
+			}
+		};
+
+		// Moves HL to @c address.
+		const auto move = [&](std::vector<Operation> &target, State &state, uint16_t address) {
+			state.destination.reset();
+			if(address == state.hl) return;
+
+			target.push_back(state.registers.load(Name::BC, uint16_t(address - state.hl)));
+			target.push_back(Operation::add(Name::HL, Name::BC));
+			target.push_back(Operation::nullary(Type::BLANK_LINE));
+			state.hl = address;
+		};
+
+		// Writes a single byte to (HL), from a register if any holds it.
+		const auto output = [](std::vector<Operation> &target, const State &state, uint8_t value) {
+			auto source = state.allocated[value];
+			if(!source || state.registers.value<uint8_t>(*source) != value) {
+				source = state.registers.find(value);
+			}
+
+			if(source) {
+				target.push_back(Operation::ld(Operand::indirect(Name::HL), Operand::direct(*source)));
+			} else {
+				target.push_back(Operation::ld(Operand::indirect(Name::HL), Operand::immediate<uint8_t>(value)));
+			}
+		};
+
+		// Outputs the run of bytes from @c begin to @c end through HL, one at a time.
+		const auto direct_output = [&](std::vector<Operation> &target, State &state, size_t begin, size_t end) {
+			move(target, state, state.destination.value_or(state.hl));
+			for(size_t time = begin; time < end; time++) {
+				allocate(target, state, time);
+				if(time != begin) {
+					target.push_back(Operation::unary(Type::INC, Name::L));
+					++state.hl;
+				}
+				output(target, state, events[time].content.output);
+			}
+		};
+
+		// Outputs the run of bytes from @c begin to @c end via the stack. HL moves directly to just beyond
+		// the run, or to its final byte if the run is of odd length, which is then written through HL; SP
+		// follows and the rest is pushed from right to left. All allocations within the run are made first,
+		// as later output may depend on them.
+		const auto stack_output = [&](std::vector<Operation> &target, State &state, size_t begin, size_t end) {
+			for(size_t time = begin; time < end; time++) {
+				allocate(target, state, time);
+			}
+
+			const bool is_odd = (end - begin) & 1;
+			const size_t last = is_odd ? end - 1 : end;
+			move(target, state, uint16_t(state.destination.value_or(state.hl) + (last - begin)));
+			if(is_odd) {
+				output(target, state, events[last].content.output);
+			}
+			target.push_back(Operation::ld(Name::SP, Name::HL));
+
+			for(size_t index = last; index > begin; index -= 2) {
+				const auto word = uint16_t(events[index - 2].content.output | (events[index - 1].content.output << 8));
+				if(state.registers.value<uint16_t>(Name::DE) == word) {
+					target.push_back(Operation::unary(Type::PUSH, Name::DE));
+				} else {
+					target.push_back(state.registers.load(Name::BC, word));
+					target.push_back(Operation::unary(Type::PUSH, Name::BC));
+				}
+			}
+		};
+
+		operations.push_back(
+			Operation::label(
+				format("%s_%d", is_clippable ? "@clippable_full" : "sprite", sprite.index()).c_str()
+			)
+		);
+
+		bool moved = true;
+		std::optional<size_t> current_x;
+		size_t last_move[2]{};
+		State state{.allocation = allocations.begin()};
+		for(size_t time = 0; time < events.size(); time++) {
+			const auto &event = events[time];
+
+			// Consider whole runs of output at once, if the stack might be used for them.
+			if(stack_runs && moved && event.type == SpriteEvent::Type::OutputByte) {
+				size_t end = time;
+				while(end < events.size() && events[end].type == SpriteEvent::Type::OutputByte) {
+					++end;
+				}
+
+				const bool is_candidate = forced ? forced->contains(time) : end - time >= MinimumStackRun;
+				if(is_candidate) {
+					auto stacked_state = state;
+					std::vector<Operation> stacked;
+					stack_output(stacked, stacked_state, time, end);
+
+					auto direct_state = state;
+					std::vector<Operation> direct;
+					if(!forced) {
+						direct_output(direct, direct_state, time, end);
+					}
+
+					if(forced || cost(stacked, options_.region) < cost(direct, options_.region)) {
+						operations.insert(operations.end(), stacked.begin(), stacked.end());
+						state = stacked_state;
+						result.pushed.emplace(time, end);
+					} else {
+						operations.insert(operations.end(), direct.begin(), direct.end());
+						state = direct_state;
+					}
+					moved = false;
+					time = end - 1;
+					continue;
+				}
+			}
+
+			if(event.type == SpriteEvent::Type::Move) {
+				moved = true;
+				state.destination = uint16_t((event.content.move.y * 128) + event.content.move.x);
+				last_move[0] = event.content.move.x;
+				last_move[1] = event.content.move.y;
+				continue;
+			}
+
+			if(state.destination) {
+				move(operations, state, *state.destination);
+			}
+			allocate(operations, state, time);
+
+			if(!moved) {
+				switch(sprite.order()) {
+					case SpriteSerialiser::Order::RowsFirstDownward:
+						operations.push_back(Operation::unary(Operation::Type::INC, Register::Name::L));
+						++state.hl;
+					break;
+					case SpriteSerialiser::Order::ColumnsFirstRightward:
+					case SpriteSerialiser::Order::ColumnsFirstLeftward:
+						operations.push_back(Operation::unary(Operation::Type::INC, Register::Name::H));
+						state.hl += 256;
+					break;
+				}
+			} else {
+				// If this is a clippable object and this x/y is the first on a new column,
+				// label loation and capture current register state.
+				if(is_clippable && current_x && *current_x != last_move[0]) {
+					operations.push_back(
+						Operation::label(
+							format("@clippable_%d_column%zu", sprite.index(), last_move[0]).c_str()
+						)
+					);
+
+					// TODO: mark end of column separately from start of next, to cut off a few
+					// redundant operations when arranging an early exit.
+					result.column_captures.push_back(ColumnCapture{
+						.registers = state.registers,
+						.initial_y = last_move[1],
+						.next_operation = operations.size(),
+					});
+				}
+				current_x = last_move[0];
+			}
+			moved = false;
+
+			output(operations, state, event.content.output);
+		}
+		return result;
+	};
+
+	// If any runs are output via the stack, their bytes don't need registers; so allocate again without them,
+	// keeping the same runs, in order not to load registers that are never read.
+	auto generated = generate(allocate_registers({}), nullptr);
+	if(!generated.pushed.empty()) {
+		const auto pushed = generated.pushed;
+		generated = generate(allocate_registers(pushed), &pushed);
+	}
+	auto &operations = generated.operations;
+	const auto &column_captures = generated.column_captures;
+	const bool used_stack = !generated.pushed.empty();
+
+	// SP is borrowed only if some run was output through it, in which case it is restored before returning.
+	if(used_stack) {
+		operations.insert(
+			operations.begin() + 1,
+			Operation::ld(Operand::label_indirect("@+restore_sp+1"), Operand::direct(Name::SP)));
+		operations.push_back(Operation::label("@restore_sp"));
+		operations.push_back(Operation::ld(Operand::direct(Name::SP), Operand::immediate<uint16_t>(0x1234)));
+	}
+	operations.push_back(Operation::nullary(Operation::Type::RET));
+
+	//
+	// If this was a clippable sprite, create a dispatch group.
+	//
+	if(is_clippable) {
+		append_clippable_dispatch_group(
+			column_captures,
+			dispatch,
+			operations,
+			sprite.index());
+	}
+	return operations;
+}
+
+Encoder::CompiledSprites Encoder::compile_sprites(const std::vector<SpriteSerialiser> &sprites) {
+	CompiledSprites compiled;
+	for(const auto &sprite: sprites) {
+		CacheKey key;
+		key.append(std::string("sprite"));
+		key.append(uint8_t(TileWidth));
+		key.append(uint8_t(TileHeight));
+		key.append(uint8_t(sprite.index()));
+		key.append(uint8_t(sprite.order()));
+		key.append(uint32_t(sprite.contents().width()));
+		key.append(sprite.contents().all_pixels().data(), sprite.contents().all_pixels().size());
+		key.append(options_.region.border);
+		key.append(options_.region.display);
+
+		auto routines = cached(key, [&] {
+			std::vector<Operation> dispatch;
+			auto operations = this->sprite(sprite, dispatch, false);
+
+			// Saving and restoring SP costs the whole sprite, so use the stack only if that's cheaper overall.
+			if(sprite.order() == SpriteSerialiser::Order::RowsFirstDownward) {
+				std::vector<Operation> stacked_dispatch;
+				auto stacked = this->sprite(sprite, stacked_dispatch, true);
+				if(cost(stacked, options_.region) < cost(operations, options_.region)) {
+					operations = std::move(stacked);
+				}
+			}
+			return std::vector<std::vector<Operation>>{operations, dispatch};
+		});
+		compiled.routines.push_back(std::move(routines[0]));
+		compiled.dispatch.insert(compiled.dispatch.end(), routines[1].begin(), routines[1].end());
+	}
+	return compiled;
+}
+
+void Encoder::write_sprites(const CompiledSprites &sprites, const std::filesystem::path &directory) {
+	AssemblyWriter code(directory / "sprites.z80s");
+	code <<
+		"\t; The following sprite outputters are automatically generated. They are intended to\n"
+		"\t; be CALLed in the ordinary Z80 fashion.\n"
+		"\t;\n"
+		"\t; Input:\n"
+		"\t;	* HL is the screen address of the top-left corner of the sprite.\n"
+		"\t;\n"
+		"\t; Each outputter potentially overwrites the contents of all registers other than SP. Some\n"
+		"\t; use SP to output horizontal runs, restoring it before returning, so interrupts must be\n"
+		"\t; disabled while they run.\n"
+		"\t;\n\n";
+
+	for(const auto &routine: sprites.routines) {
+		code << routine;
+	}
+
+	code <<
+		"\t; From here downwards are dispatch groups for 'clippables', i.e. those sprites that have been\n"
+		"\t; formulated such that they can be drawn with any number of columns removed from either the left-\n"
+		"\t; right-hand sides.\n"
+		"\t;\n"
+		"\t; Each dispatch group is aligned to a 256-byte boundary in memory and consists primarily of\n"
+		"\t; a series of 16-byte routines, after an establishing 16-byte block.\n"
+		"\t;\n"
+		"\t; The first thing in the establishing block is a JP to the routine that draws the whole sprite.\n"
+		"\t; Immediately after that is a JP to the routine that will properly mark dirty bits for this sprite size.\n"
+		"\t;\n"
+		"\t; Call the first routine after the establishing block to output the sprite with the leftmost column\n"
+		"\t; removed. Call the second to output with the two leftmost columns removed. And so on, up to and\n"
+		"\t; including the seventh function.\n"
+		"\t;\n"
+		"\t; Call the eighth function to output the sprite with the rightmost column removed. Call the ninth\n"
+		"\t; to output with the two rightmost columns removed. Etc.\n"
+		"\t;\n"
+		"\t; The clipping functions should be called with the nominal screen destination of the top left corner\n"
+		"\t; in DE.\n";
+	code << sprites.dispatch;
+	code.close();
+}
+
+void Encoder::write_palette(const std::vector<uint8_t> &palette, const std::filesystem::path &file) {
+	std::string encoded = "\tpalette:\n\t\tdb ";
+
+	bool is_first = true;
+	for(uint8_t value: palette) {
+		if(!is_first) encoded += ", ";
+		encoded += format("0x%02x", value);
+		is_first = false;
+	}
+
+	encoded += "\n";
+	write_file(file, encoded);
+}
+
+void Encoder::write_column_functions(const std::filesystem::path &directory) {
+	timings_.clear();
+	tile_dispatch_ = TileDispatch::for_tiles(tile_count(image_files(directory / "tiles")));
+	const auto &dispatch = *tile_dispatch_;
+
+	std::string code =
+		"\t; The following routines are automatically generated. Each one performs the\n"
+		"\t; action of drawing only the subset of tiles marked as dirty according to the\n"
+		"\t; four bit code implied by its function number.\n"
+		"\t;\n"
+		"\t; i.e."
+		"\t;	* draw_left_sliver0 draws zero tiles because all dirty bits are clear;\n"
+		"\t;	* draw_left_sliver1 draws the first tile in its collection of four, but no others;\n"
+		"\t;	* draw_left_sliver9 draws the first and fourth tiles; and\n"
+		"\t;	* draw_left_sliver15 draws all four tiles.\n"
+		"\t; In all cases the first tile is the one lowest down the screen."
+		"\t;\n"
+		"\t; At exit:\n"
+		"\t;	* IX has been decremented by four; and\n"
+		"\t;	* HL points to the start address for the first tile above this group, if any.\n"
+		"\t;\n"
+		"\t; An initial sequence of JP statements provides for fast dispatch into the appropriate sliver.\n"
+		"\t;\n";
+	if(dispatch.banks() > 1) {
+		code += format(
+			"\t; There are %zu tiles, in %zu banks of up to %zu. The low two bits of each map byte give its bank,\n"
+			"\t; which selects the high byte of the JP into the tile tables.\n"
+			"\t;\n",
+			dispatch.tiles(), dispatch.banks(), dispatch.per_bank());
+	}
+	code += "\n";
+
+	code += "\tds align 256\n";
+	code += "\tleft_slivers:\n";
+	for(int c = 0; c < 16; c++) {
+		if(c) code += "\t\tnop\n";
+		code += format("\t\tjp @+draw_left_sliver%d\n", c);
+	}
+	code += "\n";
+	code += "\tds align 256\n";
+	code += "\tright_slivers:\n";
+	for(int c = 0; c < 16; c++) {
+		if(c) code += "\t\tnop\n";
+		code += format("\t\tjp @+draw_right_sliver%d\n", c);
+	}
+	code += "\n";
+
+	for(const char *side: {"left", "right"}) {
+		for(int c = 0; c < 16; c++) {
+			// On input: IX points one beyond the next tile ID.
+			// A contains the top byte of the tile dispatch table.
+			// DE acts as the link register.
+
+			code += format("\t@draw_%s_sliver%d:\n", side, c);
+			code += "\t\tld (@+return + 1), de\n";
+
+			int mask = 1;
+			int offset = 0;
+			auto append_offset = [&] {
+				if(offset) {
+					code += format("\t\tld bc, -%d\n", offset);
+					code += "\t\tadd hl, bc\n";
+				}
+				offset = 0;
+			};
+
+			int load_slot = 0;
+			int ix_offset = 1;
+			while(mask < 16) {
+				if(c & mask) {
+					append_offset();
+					offset = (TileHeight - 1) * 128;
+
+					const auto slot = load_slot++;
+					code += format("\t\tld a, (ix - %d)\n", ix_offset);
+					code += format("\t\tld (@+jpslot%d + 1), a\n", slot);
+					code += stringify(dispatch.select(side[0] == 'l', format("@+jpslot%d", slot)));
+					code += "\t\tld de, @+end_dispatch\n";
+					code += format("\t@jpslot%d:\n", slot);
+					code += format("\t\tjp tiles_%s_%d\n", side, TileBytes - 1);
+					code += "\t@end_dispatch:\n";
+					code += "\n";
+				} else {
+					offset += TileHeight * 128;
+				}
+
+				mask <<= 1;
+				++ix_offset;
+			}
+			append_offset();
+			code += "\t\tld bc, -4\n";
+			code += "\t\tadd ix, bc\n";
+			code += "\t@return:\n";
+			code += "\t\tjp 1234\n\n";
+		}
+	}
+
+	write_file(directory / "slivers.z80s", code);
+}
@@ -0,0 +1,257 @@
+//
+//  Encoder.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "FrameBudget.h"
+#include "ImageCache.h"
+#include "ImageCodec.h"
+#include "MapDictionary.h"
+#include "MandatoryRegisterAllocator.h"
+#include "Operation.h"
+#include "PagePlan.h"
+#include "Palettiser.h"
+#include "PixelAccessor.h"
+#include "RegisterSet.h"
+#include "RoutineCache.h"
+#include "SpriteSerialiser.h"
+#include "TailSharer.h"
+#include "TileDispatch.h"
+#include "TileSerialiser.h"
+#include "TileShape.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct EncoderOptions {
+	/// The number of threads to use for compilation; 0 means one per hardware thread.
+	/// Output is identical regardless of thread count.
+	size_t threads = 0;
+
+	/// If non-null, compiled routines are looked up in and added to this cache.
+	RoutineCache *cache = nullptr;
+
+	/// If set, decoded images are stored in and reused from this directory by later runs; see ImageCache.
+	std::optional<std::filesystem::path> image_cache;
+
+	/// Controls the search for tile register allocations.
+	MandatoryAllocatorOptions allocation;
+
+	/// When tile code is expected to run, for the purposes of choosing between alternative encodings.
+	Region region = Region::across_frame();
+
+	/// If @c true then tile routines on the same page that end alike share a single copy of that ending,
+	/// at the cost of a JP for all but one of them; see TailSharer.
+	bool share_tails = false;
+
+	/// The 16kb pages that are free for tile routines; see PagePlan for how they're used.
+	std::vector<int> tile_pages = {16, 17, 18, 19, 20, 21, 22, 23};
+
+	/// If @c true then tiles are assembled in-process rather than written as source: each page goes to
+	/// tiles_[page].bin, with its layout in tiles.map, and tiles.z80s just places those binaries and
+	/// declares their labels. See Assembler.
+	bool assemble = false;
+};
+
+/*!
+	Implements the full asset pipeline: dissection of a level image into a tile map,
+	palettisation and compilation of tiles and sprites, and generation of the fixed
+	sliver dispatch code.
+
+	All output is written as .z80s source, ready for inclusion by the main program; tiles may
+	optionally be assembled to binary instead.
+*/
+class Encoder {
+public:
+	Encoder(const ImageCodec &codec, EncoderOptions options = {}) :
+		codec_(codec), options_(options), images_(codec, options.image_cache) {}
+
+	/// Finds all unique tiles within the bottom 192 lines of @c image, writing each to
+	/// tiles/[n].png within @c directory, and writes the resulting tile map plus its table of
+	/// column differences to map.z80s. The same is written to source_map.z80s for use by encode.
+	///
+	/// The map is also written in compressed form to map_dictionary.z80s, if it has few enough
+	/// distinct columns; see MapDictionary.
+	void dissect(const PixelAccessor &image, const std::filesystem::path &directory);
+
+	/// Palettises all PNGs in the tiles, sprites and clippables subdirectories of @c directory,
+	/// then compiles them; writes palette.z80s, sprites.z80s and tiles.z80s.
+	///
+	/// Tiles that are identical once palettised share a single routine. If source_map.z80s is present
+	/// then map.z80s is rewritten from it to use only the tiles that are compiled, with its column
+	/// differences regenerated accordingly, and map_dictionary.z80s is rewritten to match.
+	void encode(const std::filesystem::path &directory);
+
+	/// Writes slivers.z80s, the code that draws dirty groups of four tiles. It is fixed other than in
+	/// selecting a bank of tiles, which it does only if the tiles subdirectory has more than a single bank's worth.
+	void write_column_functions(const std::filesystem::path &directory);
+
+	/// The outcome of running a single compiled routine.
+	struct Verification {
+		std::string routine;
+		/// A description of how the routine's output differed from its source, if it did.
+		std::string error;
+		/// Cycles taken from entry to return, with all memory accesses contended as in the border
+		/// or as during the active display.
+		size_t border_cycles = 0, display_cycles = 0;
+	};
+
+	/// Compiles everything in @c directory exactly as per encode, then runs each tile and sprite
+	/// routine in an Executor, comparing the screen afterwards with the source image. If there is a map.z80s
+	/// then every column is also fetched from its dictionary form and compared with the original.
+	std::vector<Verification> verify(const std::filesystem::path &directory);
+
+	/// Compiles the tiles in @c directory exactly as per encode, then combines their costs with the map and
+	/// diffs in map.z80s to find the worst-case cost of redrawing at every scroll position. Writes budget.txt,
+	/// a table of those costs relative to the frame, marking any that exceed it.
+	std::vector<FrameBudget::Position> budget(const std::filesystem::path &directory);
+
+	/// Records the time taken by a named step of the most recent operation.
+	struct Timing {
+		std::string step;
+		double seconds;
+	};
+	const std::vector<Timing> &timings() const {
+		return timings_;
+	}
+
+	/// Every image decoded by this encoder, each of which is decoded only once.
+	const ImageCache &images() const {
+		return images_;
+	}
+
+	/// The contents of a page of tile routines, and how much of it they use. Sets too large for a single
+	/// page run on into the next, so may span two.
+	struct TilePage {
+		int number;
+		size_t span;
+		std::vector<std::string> sets;
+		size_t size, free;
+
+		/// @returns The page's number or, if it spans more than one, the range.
+		std::string name() const {
+			return span > 1 ? std::to_string(number) + "-" + std::to_string(number + int(span) - 1) : std::to_string(number);
+		}
+	};
+	/// The pages of tiles written by the most recent encode.
+	const std::vector<TilePage> &tile_pages() const {
+		return tile_pages_;
+	}
+
+	/// The compressed map produced by the most recent dissect or encode, if any; it was written only
+	/// if it saves space.
+	const std::optional<MapDictionary> &dictionary() const {
+		return dictionary_;
+	}
+
+	/// The means of tile dispatch used by the most recent operation, if it involved any tiles.
+	const std::optional<TileDispatch> &tile_dispatch() const {
+		return tile_dispatch_;
+	}
+
+private:
+	const ImageCodec &codec_;
+	EncoderOptions options_;
+	ImageCache images_;
+	std::vector<Timing> timings_;
+	std::optional<MapDictionary> dictionary_;
+	std::vector<TilePage> tile_pages_;
+	std::optional<TileDispatch> tile_dispatch_;
+
+	template <typename FuncT> void timed(const char *step, FuncT &&function);
+
+	/// Declares the dispatch tables for a page holding @c right and @c left, either of which may be absent,
+	/// in which entry n jumps to the routine for tile @c routines[n]. There is a table of each kind per bank,
+	/// as per TileDispatch. If both are the same set then its second kind of table is unlabelled.
+	std::vector<Operation> tile_declaration_pair(
+		const std::string *right,
+		const std::string *left,
+		const std::vector<uint8_t> &routines);
+
+	struct Assets {
+		Palette palette;
+		/// Tiles that are distinct once palettised.
+		std::vector<TileSerialiser<TileWidth, TileHeight>> tiles;
+		/// For each tile index, the index of the tile whose routine draws it; that's
+		/// the lowest-numbered tile with the same palettised contents.
+		std::vector<uint8_t> tile_routines;
+		std::vector<SpriteSerialiser> sprites;
+	};
+	/// Palettises all PNGs in the tiles, sprites and clippables subdirectories of @c directory, with
+	/// palette indices chosen to minimise the cost of the code generated; see PaletteOrder.
+	Assets load_assets(const std::filesystem::path &directory);
+
+	/// Compiles @c events, the serialisation of tile @c index as sliced per @c slice, into a routine labelled
+	/// @c name_index, using IX as an additional source register — preserving it across the call — only if
+	/// @c permit_ix is true. The first operation of the result is always the label.
+	std::vector<Operation> tile(
+		const std::string &name,
+		int slice,
+		uint8_t index,
+		const TileEvents &events,
+		bool permit_ix);
+
+	/// A routine for every tile, all sliced alike.
+	struct TileSet {
+		std::string name;
+		int slice;
+		std::vector<std::vector<Operation>> routines;
+	};
+	struct CompiledTiles {
+		std::vector<TileSet> sets;
+		/// The page on which each set is placed.
+		PagePlan plan;
+		/// Tails shared between routines, if any; use to link a routine before running or costing it.
+		TailSharer tails;
+	};
+	/// Compiles every set of @c tiles and plans their pages, given dispatch tables of @c entries entries.
+	CompiledTiles compile_tiles(const std::vector<TileSerialiser<TileWidth, TileHeight>> &tiles, size_t entries);
+	/// Fills in the routines of each of @c sets, which should arrive with only their names and slices.
+	void compile_sets(const std::vector<TileSerialiser<TileWidth, TileHeight>> &tiles, std::vector<TileSet> &sets);
+	void write_tiles(
+		const CompiledTiles &tiles,
+		const std::vector<uint8_t> &routines,
+		const std::filesystem::path &directory);
+
+	struct CompiledSprites {
+		std::vector<std::vector<Operation>> routines;
+		std::vector<Operation> dispatch;
+	};
+	CompiledSprites compile_sprites(const std::vector<SpriteSerialiser> &sprites);
+	void write_sprites(const CompiledSprites &sprites, const std::filesystem::path &directory);
+
+	/// Compiles @c sprite, appending its clipping dispatch group to @c dispatch if it is clippable.
+	///
+	/// If @c stack_runs is @c true and the sprite isn't clippable then horizontal runs of at least
+	/// @c MinimumStackRun bytes are output by moving HL straight to the end of each and pushing from there,
+	/// wherever that's cheaper than storing each byte through HL. Registers are allocated only to bytes that
+	/// are stored through HL. SP is saved on entry and restored before returning.
+	std::vector<Operation> sprite(SpriteSerialiser sprite, std::vector<Operation> &dispatch, bool stack_runs);
+	static constexpr size_t MinimumStackRun = 4;
+
+	/// @returns The routines cached under @c key if there are any; otherwise the result of @c compile,
+	/// which is also added to the cache.
+	template <typename CompileT>
+	std::vector<std::vector<Operation>> cached(const CacheKey &key, CompileT &&compile);
+	void write_palette(const std::vector<uint8_t> &palette, const std::filesystem::path &file);
+
+	struct ColumnCapture {
+		RegisterSet registers;
+		size_t initial_y;
+		size_t next_operation;
+	};
+	/// Writes map_dictionary.z80s for @c columns, or removes it if they can't be compressed.
+	void write_dictionary(const std::vector<MapDictionary::Column> &columns, const std::filesystem::path &directory);
+
+	void append_clippable_dispatch_group(
+		const std::vector<ColumnCapture> &columns,
+		std::vector<Operation> &operations,
+		const std::vector<Operation> &source_operations,
+		int index);
+};
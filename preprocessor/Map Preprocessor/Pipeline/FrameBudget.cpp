@@ -0,0 +1,286 @@
+//
+//  FrameBudget.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "FrameBudget.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+using Name = Register::Name;
+using Type = Operation::Type;
+
+/// Placeholders for the addresses and immediates of hand-written code; only their sizes matter here.
+Operand address() {	return Operand::label_indirect("address");	}
+Operand word() {	return Operand::immediate(uint16_t(0));	}
+Operand byte() {	return Operand::immediate(uint8_t(0));	}
+
+/// OUT (n), A; the I/O cycle is modelled as being contended like a memory access.
+MachineCycles out() {
+	MachineCycles cycles;
+	cycles.fetch();
+	cycles.access(3);
+	cycles.access(4);
+	return cycles;
+}
+
+/// OR (HL).
+MachineCycles or_indirect() {
+	MachineCycles cycles;
+	cycles.fetch();
+	cycles.access(3);
+	return cycles;
+}
+
+/// Parses the comma-separated values of a DB line, ignoring any trailing comment.
+std::vector<uint8_t> bytes(const std::string &line) {
+	std::vector<uint8_t> result;
+	std::istringstream values(line.substr(0, line.find(';')));
+	std::string value;
+	while(std::getline(values, value, ',')) {
+		char *end;
+		const auto parsed = strtol(value.c_str(), &end, 0);
+		if(end == value.c_str() || parsed < 0 || parsed > 255) {
+			throw std::runtime_error("Malformed map entry: " + line);
+		}
+		result.push_back(uint8_t(parsed));
+	}
+	return result;
+}
+
+}
+
+FrameBudget::Map FrameBudget::parse_map(const std::string &source) {
+	Map map;
+	enum class Section {
+		None, Map, Diffs
+	} section = Section::None;
+
+	std::istringstream lines(source);
+	std::string line;
+	while(std::getline(lines, line)) {
+		const auto start = line.find_first_not_of(" \t");
+		if(start == std::string::npos) continue;
+		line.erase(0, start);
+
+		if(line.rfind("map:", 0) == 0) {
+			section = Section::Map;
+		} else if(line.rfind("diffs:", 0) == 0) {
+			section = Section::Diffs;
+		} else if(line.rfind("db ", 0) == 0 && section != Section::None) {
+			const auto values = bytes(line.substr(3));
+			if(section == Section::Map) {
+				if(values.size() != Rows) {
+					throw std::runtime_error("Map column is not " + std::to_string(Rows) + " tiles: " + line);
+				}
+				std::copy(values.begin(), values.end(), map.columns.emplace_back().begin());
+			} else {
+				if(values.size() != Slivers) {
+					throw std::runtime_error("Diff entry is not " + std::to_string(Slivers) + " bytes: " + line);
+				}
+				std::copy(values.begin(), values.end(), map.diffs.emplace_back().begin());
+			}
+		}
+	}
+
+	if(map.columns.size() < ColumnCount + 1) {
+		throw std::runtime_error("Map is narrower than the display");
+	}
+	if(map.diffs.size() != map.columns.size() - 1) {
+		throw std::runtime_error("Map and diffs tables have inconsistent lengths");
+	}
+	return map;
+}
+
+FrameBudget::FrameBudget(
+	std::unordered_map<std::string, std::vector<std::optional<Cycles>>> tiles,
+	TileDispatch dispatch,
+	Region region
+) :
+	tiles_(std::move(tiles)), dispatch_(dispatch), region_(region)
+{
+	const auto add = [](Cycles &target, std::initializer_list<Operation> operations) {
+		for(const auto &operation: operations) {
+			target += operation.machine_cycles();
+		}
+	};
+
+	// Each sliver: store of the link register; then for each tile in the group of four, either a
+	// step up the screen, or an adjustment of HL plus the patching of a JP with the tile index
+	// and that JP; finally the step of IX to the next group and the return.
+	for(int mask = 0; mask < 16; mask++) {
+		auto &sliver = slivers_[mask];
+		add(sliver, {Operation::ld(address(), Operand::direct(Name::DE))});
+
+		int offset = 0;
+		const auto append_offset = [&] {
+			if(offset) {
+				add(sliver, {
+					Operation::ld(Operand::direct(Name::BC), word()),
+					Operation::add(Name::HL, Name::BC),
+				});
+			}
+			offset = 0;
+		};
+		for(int bit = 1; bit < 16; bit <<= 1) {
+			if(mask & bit) {
+				append_offset();
+				offset = (TileHeight - 1) * 128;
+				add(sliver, {
+					Operation::ld(Operand::direct(Name::A), Operand::indirect(Name::IX)),
+					Operation::ld(address(), Operand::direct(Name::A)),
+					Operation::ld(Operand::direct(Name::DE), word()),
+					Operation::jp(uint16_t(0)),
+				});
+			} else {
+				offset += TileHeight * 128;
+			}
+		}
+		append_offset();
+		add(sliver, {
+			Operation::ld(Operand::direct(Name::BC), word()),
+			Operation::add(Name::IX, Name::BC),
+			Operation::jp(uint16_t(0)),
+		});
+	}
+	add(tile_dispatch_, {Operation::jp(uint16_t(0))});
+	left_dispatch_ = tile_dispatch_;
+	tile_dispatch_ += cycles(dispatch_.select(false, "slot"));
+	left_dispatch_ += cycles(dispatch_.select(true, "slot"));
+
+	// draw_tiles: per column a load of the screen address, plus paging for the first two and the final
+	// column; per sliver a fetch of its flags, which patch a JP into a dispatch table that jumps to the sliver.
+	add(column_, {Operation::ld(Operand::direct(Name::HL), word())});
+	paged_column_ = column_;
+	add(paged_column_, {Operation::ld(Operand::direct(Name::A), byte())});
+	paged_column_ += out();
+	add(skipped_column_, {Operation::jp(uint16_t(0))});
+	add(sliver_dispatch_, {
+		Operation::ld(Operand::direct(Name::A), address()),
+		Operation::ld(address(), Operand::direct(Name::A)),
+		Operation::ld(Operand::direct(Name::DE), word()),
+		Operation::jp(uint16_t(0)),
+		Operation::jp(uint16_t(0)),
+	});
+
+	// The dirty flags: a byte per sliver on display.
+	static constexpr size_t DirtyBytes = ColumnCount * Slivers;
+
+	// Once per frame: store of the link register, zeroing of the dirty flags, repaging and return.
+	add(frame_, {
+		Operation::ld(address(), Operand::direct(Name::DE)),
+		Operation::ld(Operand::direct(Name::BC), word()),
+		Operation::ld(Operand::direct(Name::SP), word()),
+	});
+	for(size_t c = 0; c < DirtyBytes / 2; c++) {
+		add(frame_, {Operation::unary(Type::PUSH, Name::BC)});
+	}
+	add(frame_, {
+		Operation::unary(Type::XOR, Name::A),
+		Operation::ld(address(), Operand::direct(Name::A)),
+		Operation::ld(Operand::direct(Name::A), byte()),
+	});
+	frame_ += out();
+	add(frame_, {Operation::jp(uint16_t(0))});
+
+	// The game loop's merge of the differences into the dirty flags, which after a scroll leftward
+	// first adjusts its source by one column.
+	add(merge_right_, {
+		Operation::ld(Operand::direct(Name::DE), word()),
+		Operation::ld(Operand::direct(Name::HL), address()),
+		Operation::nullary(Type::RRCA),			// i.e. RRA.
+		Operation::jp(uint16_t(0)),
+	});
+	for(size_t c = 0; c < DirtyBytes; c++) {
+		add(merge_right_, {
+			Operation::unary(Type::DEC, Name::E),
+			Operation::unary(Type::DEC, Name::HL),
+			Operation::ld(Operand::direct(Name::A), Operand::indirect(Name::DE)),
+		});
+		merge_right_ += or_indirect();
+		add(merge_right_, {Operation::ld(Operand::indirect(Name::DE), Operand::direct(Name::A))});
+	}
+	merge_left_ = merge_right_;
+	add(merge_left_, {
+		Operation::ld(Operand::direct(Name::BC), word()),
+		Operation::add(Name::HL, Name::BC),
+	});
+}
+
+const FrameBudget::Cycles &FrameBudget::tile(const std::string &set, size_t index) const {
+	const auto costs = tiles_.find(set);
+	if(costs == tiles_.end() || index >= costs->second.size() || !costs->second[index]) {
+		throw std::runtime_error("Map refers to tile " + std::to_string(index) + " which has no " + set + " routine");
+	}
+	return *costs->second[index];
+}
+
+double FrameBudget::redraw(const Map &map, size_t scroll_column, int scroll_offset, bool leftward) const {
+	// Every video buffer is for a single sub-tile offset, so was last drawn exactly one column away from
+	// its current position: to the left if now scrolling rightward, and vice versa. Screen column k is
+	// drawn from right to left, showing map column scroll_column + ColumnCount - 1 - k.
+	const int page = scroll_offset >> 1;
+	Cycles total = leftward ? merge_left_ : merge_right_;
+	total += frame_;
+
+	const size_t columns = page ? ColumnCount : ColumnCount - 1;
+	if(!page) total += skipped_column_;
+	for(size_t k = 0; k < columns; k++) {
+		const size_t map_column = scroll_column + ColumnCount - 1 - k;
+		const size_t diff = leftward ? map_column : map_column - 1;
+
+		// The first column drawn is clipped to its left portion and the final to its right, other than
+		// in the page for offset 0, which shows only whole tiles. The first is always drawn by the left
+		// slivers, through the left tables.
+		std::string set = "full";
+		if(page && !k) set = "left_" + std::to_string(page);
+		if(page && k == ColumnCount - 1) set = "right_" + std::to_string(TileBytes - page);
+		total += (k < 2 || k == ColumnCount - 1) ? paged_column_ : column_;
+
+		// Slivers are drawn from the bottom up, each covering four rows and again drawn from the bottom up.
+		for(int sliver = int(Slivers) - 1; sliver >= 0; sliver--) {
+			// Differences beyond the end of the table are whatever follows it in memory; assume the worst.
+			const uint8_t flags = diff < map.diffs.size() ? map.diffs[diff][sliver] : 0x3c;
+			const int mask = flags >> 2;
+
+			total += sliver_dispatch_;
+			total += slivers_[mask];
+			for(int row = 0; row < 4; row++) {
+				if(mask & (8 >> row)) {
+					total += k ? tile_dispatch_ : left_dispatch_;
+					total += tile(set, dispatch_.index(map.columns[map_column][sliver*4 + row]));
+				}
+			}
+		}
+	}
+
+	return total.windows(region_);
+}
+
+std::vector<FrameBudget::Position> FrameBudget::analyse(const Map &map) const {
+	// Per scrolling.z80s: total_x counts 2-pixel steps; scroll_column advances as scroll_offset
+	// steps from 0 to 2, so at an offset of 0 the display is a whole column beyond scroll_column.
+	const size_t extent = (map.columns.size() - ColumnCount) * TileBytes;
+
+	std::vector<Position> positions;
+	for(size_t x = 0; x <= extent; x++) {
+		auto &position = positions.emplace_back();
+		position.x = x;
+		position.scroll_offset = int(x % TileBytes) << 1;
+		position.scroll_column = x / TileBytes + (position.scroll_offset ? 1 : 0);
+
+		if(x) {
+			position.from_left = redraw(map, position.scroll_column, position.scroll_offset, false);
+		}
+		if(x < extent) {
+			position.from_right = redraw(map, position.scroll_column, position.scroll_offset, true);
+		}
+	}
+	return positions;
+}
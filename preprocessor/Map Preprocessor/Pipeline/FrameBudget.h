@@ -0,0 +1,145 @@
+//
+//  FrameBudget.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+#include "TileDispatch.h"
+#include "TileShape.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+	Predicts, ahead of time, the cost of redrawing the display at every scroll position of a map.
+
+	When the display scrolls, the runtime ORs the precomputed column differences into the dirty flags and then
+	runs draw_tiles, which dispatches through the sliver routines to every tile that is flagged. This models
+	that sequence — as per src/game_loop.z80s, src/video_buffers/per_buffer_code.z80s and the output of
+	Encoder::write_column_functions — so it will need to be kept in step with them.
+
+	Dirty flags set by sprites are not included; whatever is left of the frame is what remains for sprites
+	and game logic.
+*/
+class FrameBudget {
+public:
+	/// The number of times per frame that the CPU may access memory: 120 lines of 96 plus 192 lines of 64.
+	static constexpr size_t WindowsPerFrame = 23'808;
+
+	/// One more than the number of whole columns on display; column_count in buffer_setup.z80s.
+	static constexpr size_t ColumnCount = 256 / TileWidth + 1;
+	static constexpr size_t Rows = TileRows;
+
+	/// The number of groups of four rows in a column, each drawn by one sliver and flagged by one byte.
+	static constexpr size_t Slivers = Rows / 4;
+
+	/// The tables written by Encoder::dissect: a tile's map byte per row of each map column, and
+	/// flags marking the rows in which each column differs from the one before it.
+	struct Map {
+		std::vector<std::array<uint8_t, Rows>> columns;
+		std::vector<std::array<uint8_t, Slivers>> diffs;
+	};
+
+	/// Parses the map and diffs tables from the contents of a map.z80s.
+	/// Throws std::runtime_error if they can't be found or are inconsistent.
+	static Map parse_map(const std::string &source);
+
+	/// The time taken by some code, with all memory accesses contended as in the border and as during
+	/// the active display.
+	struct Cycles {
+		size_t border = 0, display = 0;
+
+		Cycles &operator +=(const Cycles &rhs) {
+			border += rhs.border;
+			display += rhs.display;
+			return *this;
+		}
+		Cycles &operator +=(const MachineCycles &rhs) {
+			border += rhs.duration(4);
+			display += rhs.duration(8);
+			return *this;
+		}
+
+		/// @returns The number of memory windows that elapse while this code runs in @c region.
+		double windows(Region region) const {
+			return
+				(double(region.border) * double(border) / 4.0 + double(region.display) * double(display) / 8.0) /
+				double(region.border + region.display);
+		}
+	};
+
+	/// @returns The time taken by @c operations.
+	static Cycles cycles(const std::vector<Operation> &operations) {
+		Cycles result;
+		for(const auto &operation: operations) {
+			result += operation.machine_cycles();
+		}
+		return result;
+	}
+
+	/// @param tiles The time taken by each tile routine, per tile set — full, left_n and right_n — indexed by
+	/// tile number. Tiles that weren't compiled are absent.
+	/// @param dispatch How map bytes select tiles.
+	/// @param region When the redraw is expected to occur.
+	FrameBudget(
+		std::unordered_map<std::string, std::vector<std::optional<Cycles>>> tiles,
+		TileDispatch dispatch,
+		Region region);
+
+	/// The cost of redrawing at a single scroll position.
+	struct Position {
+		/// The scroll position in 2-pixel steps, i.e. total_x; the map column at the left of the
+		/// display is x / TileBytes.
+		size_t x = 0;
+
+		/// The values of scroll_column and scroll_offset at this position.
+		size_t scroll_column = 0;
+		int scroll_offset = 0;
+
+		/// The windows taken to redraw upon arriving here by scrolling in each direction,
+		/// if that is possible.
+		std::optional<double> from_left, from_right;
+
+		double windows() const {
+			return std::max(from_left.value_or(0.0), from_right.value_or(0.0));
+		}
+		bool over_budget() const {
+			return windows() > double(WindowsPerFrame);
+		}
+	};
+
+	/// @returns The cost of redrawing at every position in @c map at which the display can sit.
+	/// Throws std::runtime_error if the map refers to a tile for which no cost was supplied.
+	std::vector<Position> analyse(const Map &map) const;
+
+private:
+	std::unordered_map<std::string, std::vector<std::optional<Cycles>>> tiles_;
+	TileDispatch dispatch_;
+	Region region_;
+
+	/// The overhead of each sliver routine, indexed by its mask of dirty tiles, excluding the tiles themselves.
+	std::array<Cycles, 16> slivers_;
+
+	/// Per-tile dispatch: the JP from a tile set's table into the tile, plus the selection of a bank by
+	/// the left or right slivers. The sliver's own JP into the table is included in its overhead.
+	Cycles tile_dispatch_, left_dispatch_;
+
+	/// The remainder of draw_tiles: per column, per sliver and once per frame.
+	Cycles column_, paged_column_, sliver_dispatch_, frame_, skipped_column_;
+
+	/// Merging of differences into the dirty flags by the game loop, after a scroll in either direction.
+	Cycles merge_right_, merge_left_;
+
+	const Cycles &tile(const std::string &set, size_t index) const;
+	double redraw(const Map &map, size_t scroll_column, int scroll_offset, bool leftward) const;
+};
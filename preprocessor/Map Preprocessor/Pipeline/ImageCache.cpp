@@ -0,0 +1,171 @@
+//
+//  ImageCache.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "ImageCache.h"
+#include "RoutineCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Bump this whenever the stored format, or the way in which images are decoded, changes.
+constexpr uint32_t StoredVersion = 1;
+
+/// A PixelAccessor over pixels read back from the cache directory; rows are unpadded.
+class StoredPixelAccessor: public PixelAccessor {
+public:
+	StoredPixelAccessor(size_t width, size_t height, std::vector<uint8_t> &&storage) : storage_(std::move(storage)) {
+		width_ = width;
+		height_ = height;
+		bytes_per_row_ = width * 4;
+		pixels_ = storage_.data();
+	}
+
+private:
+	std::vector<uint8_t> storage_;
+};
+
+/// The stored header: version, content hash and file size, width and height.
+constexpr size_t HeaderSize = 4 + 8 + 8 + 4 + 4;
+
+template <typename IntT> void write(std::string &bytes, IntT value) {
+	for(size_t c = 0; c < sizeof(IntT); c++) {
+		bytes.push_back(char(uint64_t(value) >> (c * 8)));
+	}
+}
+
+template <typename IntT> IntT read(const std::vector<uint8_t> &bytes, size_t offset) {
+	uint64_t result = 0;
+	for(size_t c = 0; c < sizeof(IntT); c++) {
+		result |= uint64_t(bytes[offset + c]) << (c * 8);
+	}
+	return IntT(result);
+}
+
+std::vector<uint8_t> read_file(const std::filesystem::path &path) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file) return {};
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/// @returns A 64-bit FNV-1a hash of @c bytes.
+uint64_t hash(const std::vector<uint8_t> &bytes) {
+	uint64_t result = 0xcbf29ce484222325;
+	for(const auto byte: bytes) {
+		result = (result ^ byte) * 0x100000001b3;
+	}
+	return result;
+}
+
+}
+
+ImageCache::ImageCache(const ImageCodec &codec, std::optional<std::filesystem::path> directory) :
+	codec_(codec), directory_(std::move(directory))
+{
+	if(directory_) {
+		std::filesystem::create_directories(*directory_);
+	}
+}
+
+std::shared_ptr<const PixelAccessor> ImageCache::load(const std::filesystem::path &path) {
+	const auto modified = std::filesystem::last_write_time(path);
+	const auto size = std::filesystem::file_size(path);
+	const auto name = path.string();
+
+	{
+		std::lock_guard lock(mutex_);
+		const auto entry = entries_.find(name);
+		if(entry != entries_.end() && entry->second.modified == modified && entry->second.size == size) {
+			++hits_;
+			return entry->second.image;
+		}
+	}
+
+	std::shared_ptr<const PixelAccessor> image;
+	if(directory_) {
+		const auto contents = hash(read_file(path));
+		char stored_name[22];
+		snprintf(stored_name, sizeof(stored_name), "%016llx.rgba", static_cast<unsigned long long>(contents));
+		const auto stored = *directory_ / stored_name;
+
+		image = find_stored(stored, contents, size);
+		if(image) {
+			++hits_;
+		} else {
+			++misses_;
+			image = codec_.load(path);
+			store(stored, contents, size, *image);
+		}
+	} else {
+		++misses_;
+		image = codec_.load(path);
+	}
+
+	std::lock_guard lock(mutex_);
+	entries_[name] = Entry{.modified = modified, .size = size, .image = image};
+	return image;
+}
+
+std::shared_ptr<const PixelAccessor> ImageCache::find_stored(
+	const std::filesystem::path &stored,
+	uint64_t hash,
+	uintmax_t size
+) {
+	auto bytes = read_file(stored);
+	if(bytes.size() < HeaderSize) return nullptr;
+
+	// A mismatch in any of these means a damaged entry or a hash collision; treat either as a miss.
+	const auto width = read<uint32_t>(bytes, 20);
+	const auto height = read<uint32_t>(bytes, 24);
+	if(
+		read<uint32_t>(bytes, 0) != StoredVersion ||
+		read<uint64_t>(bytes, 4) != hash ||
+		read<uint64_t>(bytes, 12) != size ||
+		bytes.size() != HeaderSize + size_t(width) * size_t(height) * 4
+	) {
+		return nullptr;
+	}
+
+	bytes.erase(bytes.begin(), bytes.begin() + HeaderSize);
+	return std::make_shared<StoredPixelAccessor>(width, height, std::move(bytes));
+}
+
+void ImageCache::store(
+	const std::filesystem::path &stored,
+	uint64_t hash,
+	uintmax_t size,
+	const PixelAccessor &image
+) {
+	std::string bytes;
+	bytes.reserve(HeaderSize + image.width() * image.height() * 4);
+	write(bytes, StoredVersion);
+	write(bytes, hash);
+	write(bytes, uint64_t(size));
+	write(bytes, uint32_t(image.width()));
+	write(bytes, uint32_t(image.height()));
+	for(size_t y = 0; y < image.height(); y++) {
+		const auto row = reinterpret_cast<const char *>(image.pixels(0, y));
+		bytes.append(row, image.width() * 4);
+	}
+
+	// As per RoutineCache: write to a temporary name unique to this thread and process then rename, so that
+	// a reader never sees a partial entry.
+	const auto temporary = temporary_path(stored);
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		file << bytes;
+		if(!file) {
+			throw std::runtime_error(temporary.string() + ": could not be written");
+		}
+	}
+	std::filesystem::rename(temporary, stored);
+}
@@ -0,0 +1,57 @@
+//
+//  ImageCache.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "ImageCodec.h"
+#include "PixelAccessor.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/*!
+	Decodes images via an ImageCodec, keeping the results so that each file is decoded only once.
+
+	In memory, a decoded image is reused for as long as its file's size and modification time are
+	unchanged. If a directory is supplied then decoded pixels are also stored there as raw RGBA, filed
+	under a hash of the file's contents, so that later runs needn't decode at all.
+
+	Safe to use from multiple threads at once.
+*/
+class ImageCache {
+public:
+	ImageCache(const ImageCodec &codec, std::optional<std::filesystem::path> directory = std::nullopt);
+
+	/// @returns The decoded contents of the image at @c path.
+	std::shared_ptr<const PixelAccessor> load(const std::filesystem::path &path);
+
+	/// Counts loads that required no decoding, and those that did.
+	size_t hits() const {	return hits_;	}
+	size_t misses() const {	return misses_;	}
+
+private:
+	const ImageCodec &codec_;
+	std::optional<std::filesystem::path> directory_;
+	std::atomic<size_t> hits_ = 0, misses_ = 0;
+
+	struct Entry {
+		std::filesystem::file_time_type modified;
+		uintmax_t size;
+		std::shared_ptr<const PixelAccessor> image;
+	};
+	std::mutex mutex_;
+	std::unordered_map<std::string, Entry> entries_;
+
+	std::shared_ptr<const PixelAccessor> find_stored(const std::filesystem::path &stored, uint64_t hash, uintmax_t size);
+	void store(const std::filesystem::path &stored, uint64_t hash, uintmax_t size, const PixelAccessor &image);
+};
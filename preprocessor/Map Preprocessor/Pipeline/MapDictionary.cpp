@@ -0,0 +1,110 @@
+//
+//  MapDictionary.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "MapDictionary.h"
+
+#include <bit>
+#include <map>
+
+MapDictionary::Diff MapDictionary::diff(const Column &previous, const Column &next) {
+	Diff result{};
+	for(size_t row = 0; row < FrameBudget::Rows; row++) {
+		if(previous[row] != next[row]) {
+			result[row >> 2] |= uint8_t(0x20 >> (row & 3));
+		}
+	}
+	return result;
+}
+
+std::optional<MapDictionary> MapDictionary::compress(const std::vector<Column> &columns) {
+	MapDictionary dictionary;
+	std::map<Column, uint8_t> column_indices;
+	std::map<std::pair<Diff, uint8_t>, uint8_t> pair_indices;
+
+	for(size_t c = 0; c < columns.size(); c++) {
+		const auto &column = columns[c];
+
+		auto column_index = column_indices.find(column);
+		if(column_index == column_indices.end()) {
+			if(dictionary.columns_.size() == MaxEntries) return std::nullopt;
+			column_index = column_indices.emplace(column, uint8_t(dictionary.columns_.size())).first;
+			dictionary.columns_.push_back(column);
+		}
+
+		const Diff flags = c ? diff(columns[c - 1], column) : all_rows();
+		const auto key = std::make_pair(flags, column_index->second);
+		auto pair_index = pair_indices.find(key);
+		if(pair_index == pair_indices.end()) {
+			if(dictionary.pairs_.size() == MaxEntries) return std::nullopt;
+			pair_index = pair_indices.emplace(key, uint8_t(dictionary.pairs_.size())).first;
+			dictionary.pairs_.push_back(Pair{.diff = flags, .column = column_index->second});
+		}
+
+		dictionary.stream_.push_back(pair_index->second);
+	}
+
+	return dictionary;
+}
+
+std::vector<Operation> MapDictionary::fetch_routine(std::optional<Layout> layout) {
+	using Name = Register::Name;
+	using Type = Operation::Type;
+
+	const auto table = [&](const char *name, uint16_t Layout::*address) {
+		return layout ? Operand::immediate(*layout.*address) : Operand::label(name);
+	};
+	const auto ld = [](Name destination, Operand source) {
+		return Operation::ld(Operand::direct(destination), source);
+	};
+	const auto ld_entry = [&] {
+		return ld(Name::L, Operand::indirect(Name::HL));
+	};
+
+	// Columns are a multiple of three rows long, the other factor being a power of two.
+	static constexpr size_t ColumnShift = std::countr_zero(FrameBudget::Rows / 3);
+	static_assert(FrameBudget::Rows == size_t(3) << ColumnShift);
+	const auto shift = [](std::vector<Operation> &operations, size_t count) {
+		for(size_t c = 0; c < count; c++) {
+			operations.push_back(Operation::add(Name::HL, Name::HL));
+		}
+	};
+
+	// HL = map_pairs + PairSize * map_stream[HL].
+	std::vector<Operation> operations = {
+		Operation::label("fetch_column"),
+		ld(Name::BC, table("map_stream", &Layout::stream)),
+		Operation::add(Name::HL, Name::BC),
+		ld_entry(),
+		ld(Name::H, Operand::immediate(uint8_t(0))),
+	};
+	shift(operations, std::countr_zero(PairSize));
+	operations.push_back(ld(Name::BC, table("map_pairs", &Layout::pairs)));
+	operations.push_back(Operation::add(Name::HL, Name::BC));
+
+	// Copy the differences.
+	for(size_t sliver = 0; sliver < FrameBudget::Slivers; sliver++) {
+		operations.push_back(Operation::nullary(Type::LDI));
+	}
+
+	// HL = map_columns + Rows * column index.
+	operations.push_back(ld_entry());
+	operations.push_back(ld(Name::H, Operand::immediate(uint8_t(0))));
+	shift(operations, ColumnShift);
+	operations.push_back(Operation::ld(Name::B, Name::H));
+	operations.push_back(Operation::ld(Name::C, Name::L));
+	shift(operations, 1);
+	operations.push_back(Operation::add(Name::HL, Name::BC));
+	operations.push_back(ld(Name::BC, table("map_columns", &Layout::columns)));
+	operations.push_back(Operation::add(Name::HL, Name::BC));
+
+	// Copy the column.
+	for(size_t row = 0; row < FrameBudget::Rows; row++) {
+		operations.push_back(Operation::nullary(Type::LDI));
+	}
+	operations.push_back(Operation::nullary(Type::RET));
+	return operations;
+}
@@ -0,0 +1,104 @@
+//
+//  MapDictionary.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "FrameBudget.h"
+#include "Operation.h"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*!
+	A compressed form of the map and diffs tables, exploiting the repetition of whole columns within a level.
+
+	Each distinct column is stored once, in a dictionary. Each distinct pairing of a column with the
+	differences between it and its predecessor is stored once, as a pair entry: a byte of differences per
+	sliver, then the dictionary index of the column, padded to a power of two in size. The map itself is
+	then a stream of one byte per column, each the index of a pair entry.
+
+	The first column has no predecessor, so is paired with differences marking all of its rows.
+*/
+class MapDictionary {
+public:
+	using Column = std::array<uint8_t, FrameBudget::Rows>;
+	using Diff = std::array<uint8_t, FrameBudget::Slivers>;
+
+	/// The size of a pair entry: four bytes with 12 rows of tiles, eight with 24.
+	static constexpr size_t PairSize = std::bit_ceil(sizeof(Diff) + 1);
+
+	/// Both the dictionary and the pair table are indexed by a single byte.
+	static constexpr size_t MaxEntries = 256;
+
+	/// @returns The bytes of dirty flags marking the rows in which @c next differs from @c previous,
+	/// as per the diffs table: four rows per byte, with 0x20 for the uppermost and 0x04 for the lowest.
+	static Diff diff(const Column &previous, const Column &next);
+
+	/// @returns Dirty flags marking every row, as for a column with no predecessor.
+	static Diff all_rows() {
+		Diff result;
+		result.fill(0x3c);
+		return result;
+	}
+
+	/// @returns The dictionary form of @c columns, or @c std::nullopt if it would need more than
+	/// MaxEntries distinct columns or pairs.
+	static std::optional<MapDictionary> compress(const std::vector<Column> &columns);
+
+	struct Pair {
+		Diff diff;
+		uint8_t column;
+	};
+
+	const std::vector<Column> &columns() const {	return columns_;	}
+	const std::vector<Pair> &pairs() const {	return pairs_;	}
+	const std::vector<uint8_t> &stream() const {	return stream_;	}
+
+	/// @returns The size of the map and diffs tables that this replaces.
+	size_t raw_size() const {
+		return stream_.size() * sizeof(Column) + (stream_.size() - 1) * sizeof(Diff);
+	}
+
+	/// @returns The size of the stream, pair table and dictionary, excluding the fetch routine.
+	size_t size() const {
+		return stream_.size() + pairs_.size() * PairSize + columns_.size() * sizeof(Column);
+	}
+
+	/// @returns @c true if the compressed tables are smaller than those they replace; if not then
+	/// there's no reason to use them.
+	bool saves_space() const {
+		return size() < raw_size();
+	}
+
+	/// The addresses of the three tables, for use where labels can't be.
+	struct Layout {
+		uint16_t stream = 0, pairs = 0, columns = 0;
+	};
+
+	/// @returns fetch_column, which is entered with HL = a column number and DE = the address of a buffer of
+	/// sizeof(Diff) + sizeof(Column) bytes, and writes to that buffer the differences between that column and
+	/// its predecessor followed by the column.
+	/// DE is left just beyond the buffer; A is preserved; BC and HL are not.
+	///
+	/// The tables are referred to as map_stream, map_pairs and map_columns if @c layout is absent, or at the
+	/// addresses it gives otherwise, as is required for running or costing the routine.
+	static std::vector<Operation> fetch_routine(std::optional<Layout> layout = std::nullopt);
+
+	/// @returns The time taken to fetch a single column.
+	static FrameBudget::Cycles fetch_cycles() {
+		return FrameBudget::cycles(fetch_routine(Layout{}));
+	}
+
+private:
+	std::vector<Column> columns_;
+	std::vector<Pair> pairs_;
+	std::vector<uint8_t> stream_;
+};
@@ -0,0 +1,113 @@
+//
+//  PagePlan.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "PagePlan.h"
+
+#include "TileDispatch.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+size_t PagePlan::end(const Set *right, const Set *left) {
+	if(right == left) {
+		const auto dispatch = TileDispatch::for_tiles(right->tiles);
+		return dispatch.left_tables() + dispatch.tables_size() + right->size;
+	}
+	size_t end = 0;
+	if(right) {
+		end = TileDispatch::for_tiles(right->tiles).tables_size() + right->size;
+	}
+	if(left) {
+		const auto dispatch = TileDispatch::for_tiles(left->tiles);
+		end = std::max(end, size_t(dispatch.left_tables())) + dispatch.tables_size() + left->size;
+	}
+	return end;
+}
+
+PagePlan PagePlan::pack(const std::vector<Set> &sets, const std::vector<int> &numbers) {
+	std::vector<size_t> lefts, rights;
+	std::vector<Page> pages;
+	for(size_t index = 0; index < sets.size(); index++) {
+		switch(sets[index].slot) {
+			case Slot::Both:	pages.push_back(Page{.right = index, .left = index});	break;
+			case Slot::Left:	lefts.push_back(index);		break;
+			case Slot::Right:	rights.push_back(index);	break;
+		}
+	}
+
+	// Pair the largest left set with the smallest right, and so on. Any pair that won't fit
+	// on a single page is split.
+	std::stable_sort(lefts.begin(), lefts.end(), [&](size_t lhs, size_t rhs) {
+		return sets[lhs].size > sets[rhs].size;
+	});
+	std::stable_sort(rights.begin(), rights.end(), [&](size_t lhs, size_t rhs) {
+		return sets[lhs].size < sets[rhs].size;
+	});
+	for(size_t c = 0; c < std::max(lefts.size(), rights.size()); c++) {
+		Page page;
+		if(c < rights.size()) page.right = rights[c];
+		if(c < lefts.size()) page.left = lefts[c];
+		if(page.right && page.left && end(&sets[*page.right], &sets[*page.left]) > PageSize) {
+			pages.push_back(Page{.right = page.right});
+			pages.push_back(Page{.left = page.left});
+		} else {
+			pages.push_back(page);
+		}
+	}
+
+	// Keep pages in the order of the sets they hold. Any that is too large runs on into the page after.
+	const auto first = [](const Page &page) {
+		return std::min(page.right.value_or(SIZE_MAX), page.left.value_or(SIZE_MAX));
+	};
+	std::stable_sort(pages.begin(), pages.end(), [&](const Page &lhs, const Page &rhs) {
+		return first(lhs) < first(rhs);
+	});
+	size_t needed = 0;
+	for(auto &page: pages) {
+		if(!page.right) {
+			page.origin = TileDispatch::for_tiles(sets[*page.left].tiles).left_tables();
+		}
+		page.end = end(
+			page.right ? &sets[*page.right] : nullptr,
+			page.left ? &sets[*page.left] : nullptr);
+		page.span = (page.end + PageSize - 1) / PageSize;
+		if(page.span > MaxSpan) {
+			const auto &set = sets[first(page)];
+			throw std::runtime_error(
+				"Tile set " + set.name + " needs " + std::to_string(page.end) + " bytes, " +
+				std::to_string(page.end - MaxSpan * PageSize) + " more than " + std::to_string(MaxSpan) + " pages hold");
+		}
+		page.span = std::max(page.span, size_t(1));
+		needed += page.span;
+	}
+
+	// Assign numbers, lowest first; a page that runs on needs the number after its own to be free too.
+	std::set<int> available(numbers.begin(), numbers.end());
+	const size_t count = available.size();
+	PagePlan plan;
+	for(auto &page: pages) {
+		const auto number = std::find_if(available.begin(), available.end(), [&](int number) {
+			for(int c = 1; c < int(page.span); c++) {
+				if(!available.count(number + c)) return false;
+			}
+			return true;
+		});
+		if(number == available.end()) {
+			throw std::runtime_error(
+				"Tile sets need " + std::to_string(needed) + " pages but only " +
+				std::to_string(count) + " are available" +
+				(needed <= count ? ", too few of them consecutive" : ""));
+		}
+		page.number = *number;
+		for(int c = 0; c < int(page.span); c++) {
+			available.erase(page.number + c);
+		}
+		plan.pages_.push_back(page);
+	}
+	return plan;
+}
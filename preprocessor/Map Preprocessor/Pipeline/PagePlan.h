@@ -0,0 +1,85 @@
+//
+//  PagePlan.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*!
+	Decides which 16kb page each tile set is placed on.
+
+	Tiles are dispatched by a JP into a 256-byte table whose address is the same for all sets of a kind:
+	every right set's table is at 0x0000 of its page and every left set's at 0x0100, so a page can hold at
+	most one of each. Full tiles are dispatched through both tables, so have a page to themselves. Beyond 64
+	tiles there is a table per bank of each kind, and the left tables follow all of the right; see TileDispatch.
+
+	Left and right sets are paired so as to even out the sizes of the pages they share. A pair that
+	doesn't fit is split across two pages, if there are enough; a page that holds only a left set begins
+	where its first table does.
+
+	Paging a page in at 0x0000 also pages in the one after it at 0x4000, so a set too large for one page
+	runs on into the next, which is then given over to it.
+*/
+class PagePlan {
+public:
+	static constexpr size_t PageSize = 16 * 1024;
+	/// The most pages that a single page's contents may run on to fill, including its own.
+	static constexpr size_t MaxSpan = 2;
+
+	enum class Slot {
+		/// Dispatched through the table at 0x0000.
+		Right,
+		/// Dispatched through the table at 0x0100.
+		Left,
+		/// Dispatched through both.
+		Both,
+	};
+
+	struct Set {
+		std::string name;
+		Slot slot;
+		/// The number of entries in its dispatch tables, the same for every set.
+		size_t tiles;
+		/// The total size of its routines, in bytes.
+		size_t size;
+	};
+
+	struct Page {
+		int number;
+		/// Indices of the sets whose tables are at 0x0000 and 0x0100, which are the same for full tiles.
+		std::optional<size_t> right, left;
+		/// The address at which the page's contents begin, which is after the space for right tables if it has none.
+		uint16_t origin = 0;
+		/// The address just beyond everything on the page, as planned.
+		size_t end = 0;
+		/// The number of consecutive pages, from @c number, that its contents fill.
+		size_t span = 1;
+
+		size_t free() const {
+			return end < span * PageSize ? span * PageSize - end : 0;
+		}
+	};
+
+	/// Places all of @c sets in pages chosen from @c numbers, lowest first.
+	/// Throws if there aren't enough pages, if any set is too large for MaxSpan pages of its own, or if
+	/// there are too many tiles to dispatch.
+	static PagePlan pack(const std::vector<Set> &sets, const std::vector<int> &numbers);
+
+	const std::vector<Page> &pages() const {
+		return pages_;
+	}
+
+	/// @returns The address just beyond the end of a page that holds @c right and @c left, either of which may be absent.
+	static size_t end(const Set *right, const Set *left);
+
+private:
+	std::vector<Page> pages_;
+};
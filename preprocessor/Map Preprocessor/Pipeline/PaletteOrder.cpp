@@ -0,0 +1,309 @@
+//
+//  PaletteOrder.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "PaletteOrder.h"
+
+#include "RegisterSet.h"
+
+#include <bit>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace {
+
+/// @returns The name of the label that @c reference is relative to, e.g. '@return' for '@+return+1'.
+std::string referenced_label(const std::string &reference) {
+	const bool is_local =
+		reference.size() > 2 && reference[0] == '@' && (reference[1] == '+' || reference[1] == '-');
+	const size_t start = is_local ? 2 : 0;
+	const auto plus = reference.find('+', start);
+	const auto name = reference.substr(start, plus == std::string::npos ? std::string::npos : plus - start);
+	return is_local ? "@" + name : name;
+}
+
+}
+
+void PaletteOrder::add(const std::vector<Operation> &routine) {
+	using Name = Register::Name;
+	using Type = Operation::Type;
+
+	// Find the labels of instructions that are modified at runtime; their operands
+	// are placeholders, not loads.
+	std::set<std::string> modified;
+	for(const auto &operation: routine) {
+		if(
+			operation.type == Type::LD &&
+			operation.destination->type == Operand::Type::LabelIndirect
+		) {
+			modified.insert(referenced_label(std::get<Label>(operation.destination->value).str()));
+		}
+	}
+
+	// Follow register contents through the routine in the same straight line as the
+	// code generators did, which includes straight through any labels.
+	std::array<std::optional<uint8_t>, Registers.size()> values;
+	uint16_t pixels = 0;
+	const auto slot = [](Name reg) -> std::optional<size_t> {
+		for(size_t c = 0; c < Registers.size(); c++) {
+			if(Registers[c] == reg) return c;
+		}
+		return std::nullopt;
+	};
+	const auto parts = [](Name reg) {
+		return Register::size(reg) == 2 ?
+			std::make_pair(Register::high_part(reg), Register::low_part(reg)) :
+			std::make_pair(reg, reg);
+	};
+	const auto value = [&](Name reg) -> std::optional<uint16_t> {
+		const auto [high, low] = parts(reg);
+		const auto high_slot = slot(high), low_slot = slot(low);
+		if(!high_slot || !low_slot || !values[*high_slot] || !values[*low_slot]) return std::nullopt;
+		return Register::size(reg) == 2 ?
+			uint16_t(*values[*high_slot] << 8 | *values[*low_slot]) :
+			uint16_t(*values[*low_slot]);
+	};
+	const auto set = [&](Name reg, std::optional<uint16_t> target, bool is_pixel) {
+		const auto [high, low] = parts(reg);
+		const auto apply = [&](Name part, std::optional<uint8_t> content) {
+			const auto index = slot(part);
+			if(!index) return;
+			values[*index] = content;
+			pixels = uint16_t(is_pixel && content ? pixels | (1 << *index) : pixels & ~(1 << *index));
+		};
+		if(Register::size(reg) == 2) {
+			apply(high, target ? std::optional<uint8_t>(uint8_t(*target >> 8)) : std::nullopt);
+		}
+		apply(low, target ? std::optional<uint8_t>(uint8_t(*target)) : std::nullopt);
+	};
+
+	bool skip_next = false;
+	auto previous = loads_.end();
+	for(const auto &operation: routine) {
+		switch(operation.type) {
+			case Type::BLANK_LINE:
+			case Type::NONE:
+			case Type::DS_ALIGN:
+			continue;
+
+			case Type::LABEL:
+				skip_next = modified.contains(std::get<Label>(operation.destination->value).str());
+			continue;
+
+			default: break;
+		}
+
+		// Capture state prior to this operation.
+		Load load;
+		for(size_t c = 0; c < Registers.size(); c++) {
+			if(values[c]) {
+				load.values[c] = *values[c];
+				load.known |= 1 << c;
+			}
+		}
+		load.pixels = pixels;
+
+		// Determine which register is written, and with what.
+		std::optional<Name> destination;
+		std::optional<uint16_t> result;
+		const auto direct = [](const std::optional<Operand> &operand) -> std::optional<Name> {
+			if(operand && operand->type == Operand::Type::Direct) {
+				return std::get<Name>(operand->value);
+			}
+			return std::nullopt;
+		};
+		const auto source_value = [&]() -> std::optional<uint16_t> {
+			const auto &operand = operation.type == Type::LD ? operation.source : operation.destination;
+			if(!operand) return std::nullopt;
+			switch(operand->type) {
+				case Operand::Type::Immediate:
+					if(const auto *value8 = std::get_if<uint8_t>(&operand->value)) return *value8;
+					return std::get<uint16_t>(operand->value);
+				case Operand::Type::Direct:
+					return value(std::get<Name>(operand->value));
+				default:
+					return std::nullopt;
+			}
+		};
+		std::optional<Name> consumed;
+
+		switch(operation.type) {
+			case Type::LD:
+				destination = direct(operation.destination);
+				if(destination) result = source_value();
+			break;
+
+			case Type::INC:
+			case Type::DEC:
+				destination = direct(operation.destination);
+				if(destination) {
+					if(const auto previous_value = value(*destination)) {
+						const auto mask = Register::size(*destination) == 2 ? 0xffff : 0xff;
+						result = uint16_t((*previous_value + (operation.type == Type::INC ? 1 : -1)) & mask);
+					}
+				}
+			break;
+
+			case Type::RRCA:
+			case Type::RLCA:
+			case Type::CPL:
+				destination = Name::A;
+				if(const auto a = value(Name::A)) {
+					const auto a8 = uint8_t(*a);
+					switch(operation.type) {
+						default:
+						case Type::RRCA:	result = std::rotr(a8, 1);	break;
+						case Type::RLCA:	result = std::rotl(a8, 1);	break;
+						case Type::CPL:		result = uint8_t(~a8);		break;
+					}
+				}
+			break;
+
+			case Type::ADD:
+				// ADD HL/IX/IY, rr consumes an address offset.
+				if(operation.source) {
+					destination = direct(operation.destination);
+					consumed = direct(operation.source);
+					break;
+				}
+				[[fallthrough]];
+			case Type::SUB:
+			case Type::OR:
+			case Type::XOR:
+			case Type::AND: {
+				destination = Name::A;
+				const auto a = value(Name::A);
+				const auto operand = source_value();
+				if(a && operand) {
+					const auto a8 = uint8_t(*a), operand8 = uint8_t(*operand);
+					switch(operation.type) {
+						default:
+						case Type::ADD:	result = uint8_t(a8 + operand8);	break;
+						case Type::SUB:	result = uint8_t(a8 - operand8);	break;
+						case Type::OR:	result = uint8_t(a8 | operand8);	break;
+						case Type::XOR:	result = uint8_t(a8 ^ operand8);	break;
+						case Type::AND:	result = uint8_t(a8 & operand8);	break;
+					}
+				}
+			} break;
+
+			case Type::SET7:
+			case Type::RES7:
+				destination = direct(operation.destination);
+			break;
+
+			case Type::EX_DE_HL:
+				for(size_t c = 0; c < Registers.size(); c++) {
+					if(Register::pair(Registers[c]) == Name::DE || Register::pair(Registers[c]) == Name::HL) {
+						values[c] = std::nullopt;
+						pixels &= ~(1 << c);
+					}
+				}
+			break;
+
+			case Type::LDI:
+				set(Name::BC, std::nullopt, false);
+				set(Name::DE, std::nullopt, false);
+				set(Name::HL, std::nullopt, false);
+			break;
+
+			case Type::JP:
+			case Type::CALL:
+			case Type::RET:
+				values = {};
+				pixels = 0;
+			break;
+
+			default: break;
+		}
+
+		// A load consumed immediately by address arithmetic was an offset, not a pixel, so
+		// isn't subject to reordering; nor are whatever other parts of the pair it was loaded into.
+		if(consumed) {
+			if(
+				previous != loads_.end() &&
+				Register::pair(previous->first.reg) == *consumed &&
+				!--previous->second
+			) {
+				loads_.erase(previous);
+			}
+			if(const auto offset = value(*consumed)) {
+				set(*consumed, offset, false);
+			}
+		}
+		previous = loads_.end();
+
+		if(!destination) continue;
+		const bool is_load = result && !skip_next && slot(parts(*destination).second);
+		set(*destination, is_load ? result : std::nullopt, is_load);
+		skip_next = false;
+
+		if(is_load) {
+			load.reg = *destination;
+			load.target = *result;
+			previous = loads_.try_emplace(load, 0).first;
+			++previous->second;
+		}
+	}
+}
+
+size_t PaletteOrder::cost(const Order &order, Region region) const {
+	const auto byte = [&](uint8_t value) {
+		return uint8_t(order[value >> 4] << 4 | order[value & 0xf]);
+	};
+
+	size_t total = 0;
+	for(const auto &[load, count]: loads_) {
+		RegisterSet set;
+		for(size_t c = 0; c < Registers.size(); c++) {
+			if(!(load.known & (1 << c))) continue;
+			set.set_value<uint8_t>(
+				Registers[c],
+				(load.pixels & (1 << c)) ? byte(load.values[c]) : load.values[c]
+			);
+		}
+
+		const auto operation = Register::size(load.reg) == 2 ?
+			set.load<uint16_t>(load.reg, uint16_t(byte(uint8_t(load.target >> 8)) << 8 | byte(uint8_t(load.target)))) :
+			set.load<uint8_t>(load.reg, byte(uint8_t(load.target)));
+		total += count * operation.cost(region);
+	}
+	return total;
+}
+
+PaletteOrder::Order PaletteOrder::search(uint8_t background, Region region) const {
+	Order order;
+	std::iota(order.begin(), order.end(), 0);
+	std::swap(order[0], order[background]);
+
+	// Swap pairs of entries for as long as doing so helps, leaving the background alone.
+	static constexpr int MaxPasses = 16;
+	auto best = cost(order, region);
+	bool improved = true;
+	for(int pass = 0; pass < MaxPasses && improved; pass++) {
+		improved = false;
+		for(size_t a = 0; a < order.size(); a++) {
+			if(a == background) continue;
+			for(size_t b = a + 1; b < order.size(); b++) {
+				if(b == background) continue;
+
+				std::swap(order[a], order[b]);
+				const auto trial = cost(order, region);
+				if(trial < best) {
+					best = trial;
+					improved = true;
+				} else {
+					std::swap(order[a], order[b]);
+				}
+			}
+		}
+	}
+
+	return order;
+}
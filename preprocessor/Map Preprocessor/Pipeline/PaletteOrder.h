@@ -0,0 +1,70 @@
+//
+//  PaletteOrder.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+#include "Register.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/*!
+	Chooses the palette index of each colour so as to minimise the cost of the routines that draw with them.
+
+	Reordering the palette applies the same one-to-one mapping to every pixel, so it doesn't change which output
+	bytes and words are equal to one another, and register allocation is unaffected. What it does change is
+	whether one value can be reached from another by INC, DEC, RRCA, RLCA, CPL or arithmetic with another
+	register, rather than by a full load; see RegisterSet::load.
+
+	So every load in a set of routines compiled under one order is recorded, along with the contents of the
+	registers at that time, and a candidate order is costed by asking a RegisterSet how it would now make each
+	of those loads. Orders are searched by swapping pairs of entries for as long as that reduces the total.
+*/
+class PaletteOrder {
+public:
+	/// Entry n is the index to which palette entry n should move.
+	using Order = std::array<uint8_t, 16>;
+
+	/// Records the loads within @c routine, which was compiled under the order being improved upon.
+	void add(const std::vector<Operation> &routine);
+
+	/// @returns The cost in @c region of all recorded loads were the palette rearranged as per @c order.
+	size_t cost(const Order &order, Region region) const;
+
+	/// @returns The order with the lowest cost that could be found, with entry @c background always moved to index 0.
+	Order search(uint8_t background, Region region) const;
+
+private:
+	/// The registers whose contents are recorded: those that RegisterSet::load may consider.
+	static constexpr std::array<Register::Name, 11> Registers = {
+		Register::Name::A,
+		Register::Name::B, Register::Name::C,
+		Register::Name::D, Register::Name::E,
+		Register::Name::H, Register::Name::L,
+		Register::Name::IXh, Register::Name::IXl,
+		Register::Name::IYh, Register::Name::IYl,
+	};
+
+	struct Load {
+		/// The contents of Registers before the load, where known; of those, pixels are marked
+		/// in @c pixels and are remapped with the palette; anything else is an address.
+		std::array<uint8_t, Registers.size()> values{};
+		uint16_t known = 0, pixels = 0;
+
+		Register::Name reg = Register::Name::A;
+		uint16_t target = 0;
+
+		auto operator <=>(const Load &) const = default;
+	};
+
+	/// All loads seen, and the number of times each occurred.
+	std::map<Load, size_t> loads_;
+};
@@ -0,0 +1,220 @@
+//
+//  RoutineCache.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "RoutineCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+//
+// Serialisation: everything is written little-endian; optionals and variants are
+// preceded by a byte indicating presence or alternative.
+//
+
+class Writer {
+public:
+	template <typename IntT> void write(IntT value) {
+		for(size_t c = 0; c < sizeof(IntT); c++) {
+			bytes_.push_back(char(uint64_t(value) >> (c * 8)));
+		}
+	}
+
+	void write(const std::string &string) {
+		write(uint32_t(string.size()));
+		bytes_ += string;
+	}
+
+	void write(const Label &label) {
+		write(label.str());
+	}
+
+	void write(const Operand &operand) {
+		write(uint8_t(operand.type));
+		write(uint8_t(operand.value.index()));
+		std::visit([&](const auto &value) {
+			using ValueT = std::decay_t<decltype(value)>;
+			if constexpr (std::is_same_v<ValueT, Register::Name>) {
+				write(uint8_t(value));
+			} else {
+				write(value);
+			}
+		}, operand.value);
+	}
+
+	void write(const Operation &operation) {
+		write(uint8_t(operation.type));
+		for(const auto &operand: {operation.destination, operation.source}) {
+			write(uint8_t(operand.has_value()));
+			if(operand) write(*operand);
+		}
+	}
+
+	const std::string &bytes() const {
+		return bytes_;
+	}
+
+private:
+	std::string bytes_;
+};
+
+class Reader {
+public:
+	Reader(const std::string &bytes) : bytes_(bytes) {}
+
+	template <typename IntT> IntT read() {
+		uint64_t result = 0;
+		for(size_t c = 0; c < sizeof(IntT); c++) {
+			result |= uint64_t(uint8_t(next())) << (c * 8);
+		}
+		return IntT(result);
+	}
+
+	std::string read_string() {
+		const auto size = read<uint32_t>();
+		if(size > bytes_.size() - offset_) throw std::runtime_error("Truncated cache entry");
+		std::string result = bytes_.substr(offset_, size);
+		offset_ += size;
+		return result;
+	}
+
+	Operand read_operand() {
+		Operand operand;
+		operand.type = Operand::Type(read<uint8_t>());
+		switch(read<uint8_t>()) {
+			case 0:	operand.value = Register::Name(read<uint8_t>());	break;
+			case 1:	operand.value = read<uint16_t>();					break;
+			case 2:	operand.value = read<uint8_t>();					break;
+			case 3:	operand.value = Label(read_string());				break;
+			default: throw std::runtime_error("Malformed cache entry");
+		}
+		return operand;
+	}
+
+	Operation read_operation() {
+		Operation operation{.type = Operation::Type(read<uint8_t>())};
+		if(read<uint8_t>()) operation.destination = read_operand();
+		if(read<uint8_t>()) operation.source = read_operand();
+		return operation;
+	}
+
+	/// Reads a count of items, each of which occupies at least @c minimum_size bytes, rejecting any
+	/// count that the remainder of the entry could not hold.
+	size_t read_count(size_t minimum_size) {
+		const size_t count = read<uint32_t>();
+		if(count > (bytes_.size() - offset_) / minimum_size) throw std::runtime_error("Truncated cache entry");
+		return count;
+	}
+
+	bool at_end() const {
+		return offset_ == bytes_.size();
+	}
+
+private:
+	const std::string &bytes_;
+	size_t offset_ = 0;
+
+	char next() {
+		if(offset_ == bytes_.size()) throw std::runtime_error("Truncated cache entry");
+		return bytes_[offset_++];
+	}
+};
+
+}
+
+std::filesystem::path temporary_path(const std::filesystem::path &destination) {
+	// The thread distinguishes writers within this process; a random tag drawn once per process
+	// distinguishes processes that share a cache directory.
+	static const uint64_t process_tag = [] {
+		std::random_device entropy;
+		return (uint64_t(entropy()) << 32) | entropy();
+	}();
+
+	char suffix[40];
+	snprintf(suffix, sizeof(suffix), ".%016llx.%zx.tmp",
+		static_cast<unsigned long long>(process_tag), std::hash<std::thread::id>()(std::this_thread::get_id()));
+	auto result = destination;
+	result += suffix;
+	return result;
+}
+
+RoutineCache::RoutineCache(const std::filesystem::path &directory) : directory_(directory) {
+	std::filesystem::create_directories(directory_);
+}
+
+std::filesystem::path RoutineCache::path(const CacheKey &key) const {
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key.hash()));
+	return directory_ / name;
+}
+
+std::optional<std::vector<std::vector<Operation>>> RoutineCache::find(const CacheKey &key) {
+	std::ifstream file(path(key), std::ios::binary);
+	if(!file) {
+		++misses_;
+		return std::nullopt;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	const std::string bytes = contents.str();
+
+	try {
+		Reader reader(bytes);
+		if(reader.read_string() != key.bytes()) {
+			++misses_;
+			return std::nullopt;
+		}
+
+		std::vector<std::vector<Operation>> routines(reader.read_count(sizeof(uint32_t)));
+		for(auto &routine: routines) {
+			routine.resize(reader.read_count(3));	// A type and two presence flags.
+			for(auto &operation: routine) {
+				operation = reader.read_operation();
+			}
+		}
+		if(!reader.at_end()) {
+			throw std::runtime_error("Overlong cache entry");
+		}
+
+		++hits_;
+		return routines;
+	} catch(const std::runtime_error &) {
+		// Treat a damaged entry as absent; it'll be overwritten.
+		++misses_;
+		return std::nullopt;
+	}
+}
+
+void RoutineCache::store(const CacheKey &key, const std::vector<std::vector<Operation>> &routines) {
+	Writer writer;
+	writer.write(key.bytes());
+	writer.write(uint32_t(routines.size()));
+	for(const auto &routine: routines) {
+		writer.write(uint32_t(routine.size()));
+		for(const auto &operation: routine) {
+			writer.write(operation);
+		}
+	}
+
+	// Write to a temporary name unique to this thread and process then rename, so that a reader never sees
+	// a partial entry.
+	const auto destination = path(key);
+	const auto temporary = temporary_path(destination);
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		file << writer.bytes();
+		if(!file) {
+			throw std::runtime_error(temporary.string() + ": could not be written");
+		}
+	}
+	std::filesystem::rename(temporary, destination);
+}
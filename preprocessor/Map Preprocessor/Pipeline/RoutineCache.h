@@ -0,0 +1,100 @@
+//
+//  RoutineCache.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*!
+	Builds the key under which a compiled routine is cached: a byte string of everything
+	that can affect code generation, starting with the compiler version.
+*/
+class CacheKey {
+public:
+	/// Bump this whenever a change to code generation means that previously-cached routines
+	/// are no longer the ones that would now be generated.
+	static constexpr uint32_t CompilerVersion = 7;
+
+	CacheKey() {
+		append(CompilerVersion);
+	}
+
+	template <typename IntT>
+	std::enable_if_t<std::is_integral_v<IntT>> append(IntT value) {
+		for(size_t c = 0; c < sizeof(IntT); c++) {
+			bytes_.push_back(char(uint64_t(value) >> (c * 8)));
+		}
+	}
+
+	void append(const std::string &string) {
+		append(uint32_t(string.size()));
+		bytes_ += string;
+	}
+
+	void append(const uint8_t *data, size_t size) {
+		append(uint32_t(size));
+		bytes_.append(reinterpret_cast<const char *>(data), size);
+	}
+
+	const std::string &bytes() const {
+		return bytes_;
+	}
+
+	/// @returns A 64-bit FNV-1a hash of the key, used to name its cache file.
+	uint64_t hash() const {
+		uint64_t result = 0xcbf29ce484222325;
+		for(const auto byte: bytes_) {
+			result = (result ^ uint8_t(byte)) * 0x100000001b3;
+		}
+		return result;
+	}
+
+private:
+	std::string bytes_;
+};
+
+/// @returns A name alongside @c destination under which a cache entry can be written before being
+/// renamed into place, unique to the calling thread and process.
+std::filesystem::path temporary_path(const std::filesystem::path &destination);
+
+/*!
+	A persistent, content-addressed store of compiled routines.
+
+	Each entry is a list of Operation streams, filed under the hash of its CacheKey; the full key
+	is stored alongside so that a hash collision is detected as a miss rather than returning the
+	wrong code. Because keys are built from palettised pixels rather than source colours, any change
+	to the palette that alters a routine's input also alters its key.
+
+	Safe to use from multiple threads at once.
+*/
+class RoutineCache {
+public:
+	RoutineCache(const std::filesystem::path &directory);
+
+	/// @returns The routines stored under @c key, if any.
+	std::optional<std::vector<std::vector<Operation>>> find(const CacheKey &key);
+
+	/// Stores @c routines under @c key, replacing anything already there.
+	void store(const CacheKey &key, const std::vector<std::vector<Operation>> &routines);
+
+	size_t hits() const {	return hits_;	}
+	size_t misses() const {	return misses_;	}
+
+private:
+	std::filesystem::path directory_;
+	std::atomic<size_t> hits_ = 0, misses_ = 0;
+
+	std::filesystem::path path(const CacheKey &key) const;
+};
@@ -0,0 +1,661 @@
+//
+//  TailSharer.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "TailSharer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace {
+
+using Name = Register::Name;
+using Type = Operation::Type;
+
+/// The registers whose values are followed, a byte at a time.
+constexpr std::array<Name, 13> Registers = {
+	Name::A, Name::B, Name::C, Name::D, Name::E, Name::H, Name::L,
+	Name::IXh, Name::IXl, Name::IYh, Name::IYl, Name::SPh, Name::SPl,
+};
+using RegisterMask = uint16_t;
+
+std::optional<size_t> slot(Name reg) {
+	const auto found = std::find(Registers.begin(), Registers.end(), reg);
+	if(found == Registers.end()) return std::nullopt;
+	return size_t(found - Registers.begin());
+}
+
+/// Symbolic values, each an interned expression in terms of constants and the contents of registers at entry;
+/// two values are the same exactly if they have the same identifier. Expressions of constants are folded.
+class Values {
+public:
+	uint32_t intern(const std::string &expression) {
+		return ids_.emplace(expression, uint32_t(ids_.size())).first->second;
+	}
+
+	uint32_t constant(uint8_t value) {
+		const auto id = intern("#" + std::to_string(value));
+		constants_.emplace(id, value);
+		return id;
+	}
+
+	/// @returns A value unlike any other.
+	uint32_t unknown() {
+		return intern("?" + std::to_string(unknowns_++));
+	}
+
+	/// @returns The value @c name(@c arguments), or @c fold(@c arguments) if they are all constant.
+	template <typename FoldT>
+	uint32_t apply(const char *name, std::initializer_list<uint32_t> arguments, FoldT &&fold) {
+		std::vector<uint8_t> constants;
+		std::string expression = name;
+		for(const auto argument: arguments) {
+			const auto value = constants_.find(argument);
+			if(value != constants_.end()) {
+				constants.push_back(value->second);
+			}
+			expression += " " + std::to_string(argument);
+		}
+		if(constants.size() == arguments.size()) {
+			return constant(uint8_t(fold(constants)));
+		}
+		return intern(expression);
+	}
+
+private:
+	std::unordered_map<std::string, uint32_t> ids_;
+	std::unordered_map<uint32_t, uint8_t> constants_;
+	size_t unknowns_ = 0;
+};
+
+using State = std::array<uint32_t, Registers.size()>;
+
+/// The effect of a single operation: a key that is the same for two operations only if they have the same effect
+/// on registers and memory given the states they were evaluated in, and the registers read and written.
+struct Step {
+	uint32_t key = 0;
+	RegisterMask reads = 0, writes = 0;
+};
+
+/// Applies operations to a State.
+class Evaluator {
+public:
+	Evaluator(Values &values, State &state) : values_(values), state_(state) {}
+
+	Step step(const Operation &operation) {
+		step_ = Step{};
+		writes_.clear();
+		evaluate(operation);
+		for(const auto &[index, value]: writes_) {
+			state_[index] = value;
+		}
+		return step_;
+	}
+
+private:
+	Values &values_;
+	State &state_;
+	Step step_;
+	std::vector<std::pair<size_t, uint32_t>> writes_;
+
+	/// Sets the key for an operation that affects only registers: those it writes, and their new values.
+	void set_register_key() {
+		std::string key = "=";
+		for(const auto &[index, value]: writes_) {
+			key += " " + std::to_string(index) + ":" + std::to_string(value);
+		}
+		step_.key = values_.intern(key);
+	}
+
+	/// Sets the key for an operation that has some other effect, as @c description plus @c values.
+	void set_key(const std::string &description, std::initializer_list<uint32_t> values) {
+		std::string key = description;
+		for(const auto value: values) {
+			key += " " + std::to_string(value);
+		}
+		step_.key = values_.intern(key);
+	}
+
+	/// Marks an operation as not to be matched with any other, and anything it writes as unknown.
+	void set_opaque(const Operation &operation) {
+		step_.key = values_.unknown();
+		if(
+			operation.type == Type::JP || operation.type == Type::CALL ||
+			(operation.destination && operation.destination->type == Operand::Type::Direct)
+		) {
+			for(size_t index = 0; index < Registers.size(); index++) {
+				write(Registers[index], values_.unknown());
+			}
+		}
+	}
+
+	uint32_t read(Name reg) {
+		const auto index = *slot(reg);
+		step_.reads |= RegisterMask(1 << index);
+		return state_[index];
+	}
+	void write(Name reg, uint32_t value) {
+		const auto index = *slot(reg);
+		step_.writes |= RegisterMask(1 << index);
+		writes_.emplace_back(index, value);
+	}
+
+	/// @returns @c true if every register named by @c operation is followed.
+	static bool is_followed(const Operation &operation) {
+		for(const auto &operand: {operation.destination, operation.source}) {
+			if(!operand || (operand->type != Operand::Type::Direct && operand->type != Operand::Type::Indirect)) {
+				continue;
+			}
+			const auto reg = std::get<Name>(operand->value);
+			if(!slot(Register::high_part(reg)) || !slot(Register::low_part(reg))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// @returns The value of @c operand, which is an 8-bit register or constant.
+	std::optional<uint32_t> byte(const Operand &operand) {
+		switch(operand.type) {
+			case Operand::Type::Direct:
+				return read(std::get<Name>(operand.value));
+			case Operand::Type::Immediate:
+				if(const auto value = std::get_if<uint8_t>(&operand.value)) {
+					return values_.constant(*value);
+				}
+				[[fallthrough]];
+			default:
+				return std::nullopt;
+		}
+	}
+
+	/// Applies a 16-bit function to the register pair @c pair.
+	template <typename FunctionT>
+	void apply16(const char *name, Name pair, std::initializer_list<uint32_t> arguments, FunctionT &&function) {
+		const auto word = [&](const std::vector<uint8_t> &bytes) {
+			return function(bytes);
+		};
+		write(Register::high_part(pair), values_.apply(
+			(std::string(name) + ".h").c_str(), arguments, [&](const auto &bytes) { return word(bytes) >> 8; }));
+		write(Register::low_part(pair), values_.apply(
+			(std::string(name) + ".l").c_str(), arguments, [&](const auto &bytes) { return word(bytes) & 0xff; }));
+	}
+
+	void evaluate(const Operation &operation) {
+		if(!is_followed(operation)) {
+			set_opaque(operation);
+			return;
+		}
+
+		const auto &destination = operation.destination;
+		const auto &source = operation.source;
+		const auto direct = destination && destination->type == Operand::Type::Direct;
+		const auto reg = direct ? std::get<Name>(destination->value) : Name::A;
+
+		switch(operation.type) {
+			case Type::LABEL:
+			case Type::DS_ALIGN:
+			case Type::BLANK_LINE:
+			case Type::NONE:
+			case Type::NOP:
+				set_key(operation.text(), {});
+			break;
+
+			case Type::LD:
+				if(direct) {
+					switch(source->type) {
+						case Operand::Type::Direct: {
+							const auto from = std::get<Name>(source->value);
+							write(Register::high_part(reg), read(Register::high_part(from)));
+							if(Register::size(reg) == 2) {
+								write(Register::low_part(reg), read(Register::low_part(from)));
+							}
+						} break;
+
+						case Operand::Type::Immediate:
+							if(const auto value = std::get_if<uint8_t>(&source->value)) {
+								write(reg, values_.constant(*value));
+							} else {
+								const auto word = std::get<uint16_t>(source->value);
+								write(Register::high_part(reg), values_.constant(uint8_t(word >> 8)));
+								write(Register::low_part(reg), values_.constant(uint8_t(word)));
+							}
+						break;
+
+						case Operand::Type::Label: {
+							const auto &label = std::get<Label>(source->value).str();
+							write(Register::high_part(reg), values_.intern(label + ".h"));
+							write(Register::low_part(reg), values_.intern(label + ".l"));
+						} break;
+
+						default:
+							set_opaque(operation);
+						return;
+					}
+					set_register_key();
+					break;
+				}
+
+				// Stores to (HL), (IX) or (IY).
+				if(destination->type == Operand::Type::Indirect) {
+					const auto pointer = std::get<Name>(destination->value);
+					const auto high = read(Register::high_part(pointer));
+					const auto low = read(Register::low_part(pointer));
+					const auto value = byte(*source);
+					if(!value) {
+						set_opaque(operation);
+						return;
+					}
+					set_key("store", {high, low, *value});
+					break;
+				}
+
+				// Stores to a label, i.e. self-modification.
+				if(destination->type == Operand::Type::LabelIndirect && source->type == Operand::Type::Direct) {
+					const auto from = std::get<Name>(source->value);
+					set_key(operation.text(), {read(Register::high_part(from)), read(Register::low_part(from))});
+					break;
+				}
+
+				set_opaque(operation);
+			break;
+
+			case Type::INC:
+			case Type::DEC: {
+				const int delta = operation.type == Type::INC ? 1 : -1;
+				if(!direct) {
+					set_opaque(operation);
+					break;
+				}
+				if(Register::size(reg) == 2) {
+					const auto high = read(Register::high_part(reg));
+					const auto low = read(Register::low_part(reg));
+					apply16(operation.type == Type::INC ? "inc" : "dec", reg, {high, low}, [&](const auto &bytes) {
+						return uint16_t(((bytes[0] << 8) | bytes[1]) + delta);
+					});
+				} else {
+					write(reg, values_.apply(operation.type == Type::INC ? "inc" : "dec", {read(reg)}, [&](const auto &bytes) {
+						return bytes[0] + delta;
+					}));
+				}
+				set_register_key();
+			} break;
+
+			case Type::SET7:
+			case Type::RES7:
+				if(!direct) {
+					set_opaque(operation);
+					break;
+				}
+				write(reg, values_.apply(operation.type == Type::SET7 ? "set7" : "res7", {read(reg)}, [&](const auto &bytes) {
+					return operation.type == Type::SET7 ? bytes[0] | 0x80 : bytes[0] & 0x7f;
+				}));
+				set_register_key();
+			break;
+
+			case Type::RRCA:
+				write(Name::A, values_.apply("rrca", {read(Name::A)}, [](const auto &bytes) {
+					return (bytes[0] >> 1) | (bytes[0] << 7);
+				}));
+				set_register_key();
+			break;
+			case Type::RLCA:
+				write(Name::A, values_.apply("rlca", {read(Name::A)}, [](const auto &bytes) {
+					return (bytes[0] << 1) | (bytes[0] >> 7);
+				}));
+				set_register_key();
+			break;
+			case Type::CPL:
+				write(Name::A, values_.apply("cpl", {read(Name::A)}, [](const auto &bytes) {
+					return bytes[0] ^ 0xff;
+				}));
+				set_register_key();
+			break;
+
+			case Type::ADD:
+				// ADD HL, rr and its index equivalents.
+				if(source) {
+					const auto from = std::get<Name>(source->value);
+					const auto high = read(Register::high_part(reg));
+					const auto low = read(Register::low_part(reg));
+					const auto from_high = read(Register::high_part(from));
+					const auto from_low = read(Register::low_part(from));
+					apply16("add", reg, {high, low, from_high, from_low}, [](const auto &bytes) {
+						return uint16_t(((bytes[0] << 8) | bytes[1]) + ((bytes[2] << 8) | bytes[3]));
+					});
+					set_register_key();
+					break;
+				}
+				[[fallthrough]];
+
+			case Type::SUB:
+			case Type::OR:
+			case Type::XOR:
+			case Type::AND: {
+				// Other than ADD HL, rr these are modelled as unary, with the destination being the operand.
+				const auto operand = byte(*destination);
+				if(!operand) {
+					set_opaque(operation);
+					break;
+				}
+				const auto a = read(Name::A);
+				const bool is_self = direct && reg == Name::A;
+				if(is_self && (operation.type == Type::SUB || operation.type == Type::XOR)) {
+					write(Name::A, values_.constant(0));
+				} else if(is_self && (operation.type == Type::AND || operation.type == Type::OR)) {
+					write(Name::A, a);
+				} else {
+					const auto type = operation.type;
+					write(Name::A, values_.apply(operation.text().c_str(), {a, *operand}, [type](const auto &bytes) {
+						switch(type) {
+							default:
+							case Type::ADD:	return bytes[0] + bytes[1];
+							case Type::SUB:	return bytes[0] - bytes[1];
+							case Type::OR:	return bytes[0] | bytes[1];
+							case Type::XOR:	return bytes[0] ^ bytes[1];
+							case Type::AND:	return bytes[0] & bytes[1];
+						}
+					}));
+				}
+				set_register_key();
+			} break;
+
+			case Type::EX_DE_HL: {
+				const auto d = read(Name::D), e = read(Name::E);
+				const auto h = read(Name::H), l = read(Name::L);
+				write(Name::D, h);
+				write(Name::E, l);
+				write(Name::H, d);
+				write(Name::L, e);
+				set_register_key();
+			} break;
+
+			case Type::PUSH: {
+				const auto high = read(Register::high_part(reg));
+				const auto low = read(Register::low_part(reg));
+				const auto sp_high = read(Name::SPh);
+				const auto sp_low = read(Name::SPl);
+				apply16("sub2", Name::SP, {sp_high, sp_low}, [](const auto &bytes) {
+					return uint16_t(((bytes[0] << 8) | bytes[1]) - 2);
+				});
+				set_key("push", {sp_high, sp_low, high, low});
+			} break;
+
+			case Type::LDI: {
+				const auto h = read(Name::H), l = read(Name::L);
+				const auto d = read(Name::D), e = read(Name::E);
+				const auto b = read(Name::B), c = read(Name::C);
+				const auto step = [](int delta) {
+					return [delta](const auto &bytes) {
+						return uint16_t(((bytes[0] << 8) | bytes[1]) + delta);
+					};
+				};
+				apply16("inc", Name::HL, {h, l}, step(1));
+				apply16("inc", Name::DE, {d, e}, step(1));
+				apply16("dec", Name::BC, {b, c}, step(-1));
+				set_key("ldi", {h, l, d, e});
+			} break;
+
+			// A JP to an address is an exit, with that address as patched at entry; anything else
+			// is a branch within the page, after which nothing is known.
+			case Type::JP:
+				if(destination->type == Operand::Type::Immediate) {
+					set_key(operation.text(), {});
+				} else {
+					set_opaque(operation);
+				}
+			break;
+
+			case Type::CALL:
+			case Type::RET:
+				set_opaque(operation);
+			break;
+		}
+	}
+};
+
+/// @returns The local label referred to by @c operation, and any offset, if it refers to one.
+std::optional<std::pair<std::string, std::string>> local_reference(const Operation &operation) {
+	for(const auto &operand: {operation.destination, operation.source}) {
+		if(!operand || (operand->type != Operand::Type::Label && operand->type != Operand::Type::LabelIndirect)) {
+			continue;
+		}
+		const auto &reference = std::get<Label>(operand->value).str();
+		if(reference.size() > 2 && reference[0] == '@' && (reference[1] == '+' || reference[1] == '-')) {
+			const auto plus = reference.find('+', 2);
+			return std::make_pair(
+				reference.substr(0, plus),
+				plus == std::string::npos ? std::string() : reference.substr(plus));
+		}
+	}
+	return std::nullopt;
+}
+
+bool is_code(const Operation &operation) {
+	return operation.type != Type::BLANK_LINE && operation.type != Type::NONE;
+}
+
+}
+
+void TailSharer::share(const std::vector<std::vector<Operation> *> &routines) {
+	// Routines are compared by the code operations in each, i.e. excluding blank lines.
+	struct Routine {
+		/// Indices of code operations.
+		std::vector<size_t> code;
+		/// Per code operation: its key, the state before it, the registers read before being written from it
+		/// onwards and the bytes from it onwards. The final two have an extra entry, for the end of the routine.
+		std::vector<uint32_t> keys;
+		std::vector<State> states;
+		std::vector<RegisterMask> live;
+		std::vector<size_t> bytes;
+
+		/// The first code operation at which a tail may begin: after the entry label and
+		/// after any reference to an earlier local label.
+		size_t earliest_join = 1;
+
+		/// If this routine now jumps into another, the index of its first code operation that was
+		/// replaced, the routine jumped into and the code operation in that routine that is jumped to.
+		std::optional<size_t> join;
+		size_t target = 0, target_join = 0;
+	};
+	std::vector<Routine> analysed(routines.size());
+
+	Values values;
+	State entry;
+	for(size_t index = 0; index < Registers.size(); index++) {
+		entry[index] = values.intern(std::string("entry ") + Register::name(Registers[index]));
+	}
+
+	for(size_t index = 0; index < routines.size(); index++) {
+		const auto &operations = *routines[index];
+		auto &routine = analysed[index];
+
+		State state = entry;
+		Evaluator evaluator(values, state);
+		std::vector<Step> steps;
+		for(size_t c = 0; c < operations.size(); c++) {
+			if(!is_code(operations[c])) continue;
+			routine.code.push_back(c);
+			routine.states.push_back(state);
+			steps.push_back(evaluator.step(operations[c]));
+			routine.keys.push_back(steps.back().key);
+
+			if(const auto reference = local_reference(operations[c]); reference && reference->first[1] == '-') {
+				routine.earliest_join = routine.code.size();
+			}
+		}
+
+		routine.live.resize(steps.size() + 1);
+		routine.bytes.resize(steps.size() + 1);
+		for(size_t c = steps.size(); c--;) {
+			routine.live[c] = RegisterMask(steps[c].reads | (routine.live[c + 1] & ~steps[c].writes));
+			routine.bytes[c] = routine.bytes[c + 1] + operations[routine.code[c]].size();
+		}
+	}
+
+	// Resolves a code operation within a routine to the place where it now physically resides.
+	const auto location = [&](size_t routine, size_t code) {
+		while(analysed[routine].join && code >= *analysed[routine].join) {
+			code = code - *analysed[routine].join + analysed[routine].target_join;
+			routine = analysed[routine].target;
+		}
+		return std::make_pair(routine, analysed[routine].code[code]);
+	};
+
+	// Determines whether @c routine may jump into code operation @c target_join of @c target at @c join: every
+	// register read by the code that will actually run from there must hold the same value in both. If the target
+	// has itself been joined to another routine then the code that runs is partly, or wholly, that routine's.
+	const auto compatible = [&](const Routine &routine, size_t join, size_t target, size_t target_join) {
+		while(true) {
+			const auto &other = analysed[target];
+			if(other.join && target_join >= *other.join) {
+				target_join = target_join - *other.join + other.target_join;
+				target = other.target;
+				continue;
+			}
+
+			const auto live = other.live[target_join];
+			for(size_t reg = 0; reg < Registers.size(); reg++) {
+				if((live & (1 << reg)) && routine.states[join][reg] != other.states[target_join][reg]) {
+					return false;
+				}
+			}
+			if(!other.join) {
+				return true;
+			}
+			join += *other.join - target_join;
+			target_join = *other.join;
+		}
+	};
+
+	// Names places that are jumped to, or referred to by self-modification; labels are inserted once all joins
+	// are known, so that operation indices remain valid until then.
+	std::map<std::pair<size_t, size_t>, std::string> names;
+	const auto name = [&](std::pair<size_t, size_t> location) -> const std::string & {
+		auto &label = names[location];
+		if(label.empty()) {
+			label = "tail_" + std::to_string(next_label_++);
+		}
+		return label;
+	};
+
+	const size_t jump_size = Operation::jp("tail").size();
+	for(size_t index = 1; index < routines.size(); index++) {
+		auto &routine = analysed[index];
+		const size_t length = routine.keys.size();
+
+		// Find the join that saves most space, preferring the earliest routine in the event of a tie.
+		size_t best_gain = 0, best_target = 0, best_length = 0;
+		for(size_t target = 0; target < index; target++) {
+			const auto &other = analysed[target];
+			const size_t other_length = other.keys.size();
+
+			size_t common = 0;
+			while(
+				common < length && common < other_length &&
+				routine.keys[length - 1 - common] == other.keys[other_length - 1 - common]
+			) {
+				++common;
+			}
+
+			// Take the longest tail for which registers read by the kept copy hold the same values in both.
+			for(size_t tail = common; tail; --tail) {
+				const size_t join = length - tail, other_join = other_length - tail;
+				if(routine.bytes[join] <= jump_size + best_gain) break;
+				if(join < routine.earliest_join || other_join < other.earliest_join) continue;
+
+				if(compatible(routine, join, target, other_join)) {
+					best_gain = routine.bytes[join] - jump_size;
+					best_target = target;
+					best_length = tail;
+					break;
+				}
+			}
+		}
+		if(!best_gain) continue;
+
+		const size_t join = length - best_length;
+		routine.join = join;
+		routine.target = best_target;
+		routine.target_join = analysed[best_target].keys.size() - best_length;
+		saved_ += best_gain;
+
+		// Redirect any references from the code that remains to local labels in the tail; those
+		// are necessarily self-modification of operands in the tail.
+		auto &operations = *routines[index];
+		for(size_t c = 0; c < join; c++) {
+			auto &operation = operations[routine.code[c]];
+			const auto reference = local_reference(operation);
+			if(!reference || reference->first[1] != '+') continue;
+
+			const auto label = "@" + reference->first.substr(2);
+			size_t target = c + 1;
+			while(
+				target < length &&
+				!(operations[routine.code[target]].type == Type::LABEL &&
+					std::get<Label>(operations[routine.code[target]].destination->value).str() == label)
+			) {
+				++target;
+			}
+			if(target < join || target == length) continue;
+
+			const auto &alias = name(location(index, target));
+			for(auto *operand: {&operation.destination, &operation.source}) {
+				if(
+					*operand &&
+					((*operand)->type == Operand::Type::Label || (*operand)->type == Operand::Type::LabelIndirect)
+				) {
+					(*operand)->value = Label(alias + reference->second);
+				}
+			}
+		}
+
+		const auto &destination = name(location(index, join));
+		operations.erase(operations.begin() + ptrdiff_t(routine.code[join]), operations.end());
+		operations.push_back(Operation::jp(destination.c_str()));
+		operations.push_back(Operation::nullary(Type::BLANK_LINE));
+	}
+
+	// Insert labels, from last to first so that earlier indices are unaffected.
+	for(auto label = names.rbegin(); label != names.rend(); ++label) {
+		auto &operations = *routines[label->first.first];
+		operations.insert(operations.begin() + ptrdiff_t(label->first.second), Operation::label(label->second.c_str()));
+	}
+	for(const auto &[location, label]: names) {
+		const auto &operations = *routines[location.first];
+		const auto start = std::find_if(operations.begin(), operations.end(), [&](const Operation &operation) {
+			return
+				operation.type == Type::LABEL &&
+				std::get<Label>(operation.destination->value).str() == label;
+		});
+		tails_[label] = std::vector<Operation>(start, operations.end());
+	}
+}
+
+std::vector<Operation> TailSharer::linked(const std::vector<Operation> &routine) const {
+	std::vector<Operation> result = routine;
+	while(true) {
+		const auto last = std::find_if(result.rbegin(), result.rend(), is_code);
+		if(
+			last == result.rend() ||
+			last->type != Type::JP ||
+			last->destination->type != Operand::Type::Label
+		) {
+			break;
+		}
+
+		const auto tail = tails_.find(std::get<Label>(last->destination->value).str());
+		if(tail == tails_.end()) {
+			break;
+		}
+		result.insert(result.end(), tail->second.begin(), tail->second.end());
+	}
+	return result;
+}
@@ -0,0 +1,52 @@
+//
+//  TailSharer.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+	Shrinks pages of routines by finding sequences of instructions with which more than one routine ends,
+	keeping only one copy of each and having the other routines JP into it.
+
+	Two tails are interchangeable if every instruction in them has the same effect — the same values
+	written to the same registers, or to memory at the same address — given the register contents
+	at the point of the join. That's established by following the values in every register symbolically
+	from entry to each routine, and the join is permitted only if every register that the kept tail reads
+	before writing has the same value in both routines at that point. So a tail that reloads a register
+	can stand in for one that didn't need to, if the register already held that value.
+
+	Flags aren't modelled; routines are expected not to depend on them. Nor are values read from memory.
+*/
+class TailSharer {
+public:
+	/// Shares tails among @c routines, all of which are to be placed on the same page, modifying them
+	/// in place. Each routine is expected to begin with its label, and to run straight through to a
+	/// final exit. A routine may end by jumping into any that precedes it in @c routines.
+	void share(const std::vector<std::vector<Operation> *> &routines);
+
+	/// @returns @c routine followed by the tails that it jumps into, i.e. a program that can be run or
+	/// costed as a whole.
+	std::vector<Operation> linked(const std::vector<Operation> &routine) const;
+
+	/// @returns The number of bytes saved by all calls to share.
+	size_t saved() const {
+		return saved_;
+	}
+
+private:
+	size_t saved_ = 0;
+	size_t next_label_ = 0;
+
+	/// The code from each label that was added as the destination of a JP, to the end of the routine it is in.
+	std::unordered_map<std::string, std::vector<Operation>> tails_;
+};
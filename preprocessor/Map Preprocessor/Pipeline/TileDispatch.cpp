@@ -0,0 +1,58 @@
+//
+//  TileDispatch.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "TileDispatch.h"
+
+#include <stdexcept>
+
+TileDispatch TileDispatch::for_tiles(size_t tiles) {
+	for(size_t banks = 1; banks <= MaxBanks; banks <<= 1) {
+		const TileDispatch dispatch(tiles, banks);
+		if(tiles <= banks * dispatch.per_bank()) {
+			return dispatch;
+		}
+	}
+
+	const TileDispatch largest(0, MaxBanks);
+	throw std::runtime_error(
+		"There are " + std::to_string(tiles) + " tiles but at most " +
+		std::to_string(MaxBanks * largest.per_bank()) + " can be dispatched");
+}
+
+size_t TileDispatch::tables_size() const {
+	if(!tiles_) {
+		return 0;
+	}
+
+	// Each table is a JP and a NOP per tile, other than the last, after a byte of padding per bank.
+	const size_t last = (tiles_ - 1) / per_bank();
+	const size_t entries = tiles_ - last * per_bank();
+	return last * 256 + last + entries * 4 - 1;
+}
+
+std::vector<Operation> TileDispatch::select(bool left, const std::string &slot) const {
+	std::vector<Operation> operations;
+	if(banks_ == 1) {
+		return operations;
+	}
+
+	operations.push_back(Operation{
+		.type = Operation::Type::AND,
+		.destination = Operand::immediate(uint8_t(banks_ - 1)),
+	});
+	if(left) {
+		operations.push_back(Operation{
+			.type = Operation::Type::OR,
+			.destination = Operand::immediate(uint8_t(banks_)),
+		});
+	}
+	operations.push_back(
+		Operation::ld(
+			Operand::label_indirect((slot + "+2").c_str()),
+			Operand::direct(Register::Name::A)));
+	return operations;
+}
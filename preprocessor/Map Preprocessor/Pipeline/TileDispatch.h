@@ -0,0 +1,74 @@
+//
+//  TileDispatch.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "Operation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+	Describes how a byte of the map selects a tile routine.
+
+	Each sliver patches the low byte of a JP with the map byte, then takes that JP into a 256-byte-aligned
+	table of JPs, one per tile, four bytes apart. With up to 64 tiles that is the whole story: the map byte
+	is four times the tile's index, and there is a single table of each kind — at 0x0000 for right sets and
+	full tiles, at 0x0100 for left sets.
+
+	Beyond 64 tiles, tiles are divided between two or four banks, each with a table of its own. The bank
+	occupies the low two bits of the map byte, which are otherwise clear, and bank n's table begins n bytes
+	into its 256 so that the map byte remains the exact offset of the tile's entry. Right tables are at
+	0x0000, 0x0100, etc, one per bank, and left tables follow them; the sliver also patches the high byte of
+	its JP, from the bank number. Tiles in the first bank therefore cost just as much as any other.
+
+	With four banks each holds only 63 tiles, so that no table runs into the next.
+*/
+class TileDispatch {
+public:
+	static constexpr size_t MaxBanks = 4;
+
+	/// @returns The dispatch for @c tiles tiles, using as few banks as possible.
+	/// Throws std::runtime_error if there are too many tiles to dispatch.
+	static TileDispatch for_tiles(size_t tiles);
+
+	size_t tiles() const {	return tiles_;	}
+	size_t banks() const {	return banks_;	}
+	size_t per_bank() const {	return banks_ == MaxBanks ? 63 : 64;	}
+
+	/// @returns The map byte that selects tile @c index.
+	uint8_t byte(size_t index) const {
+		return uint8_t(((index % per_bank()) << 2) | (index / per_bank()));
+	}
+
+	/// @returns The index of the tile selected by @c byte, which may be beyond the number of tiles
+	/// if the byte isn't one that byte produces.
+	size_t index(uint8_t byte) const {
+		return (byte & (banks_ - 1)) * per_bank() + (byte >> 2);
+	}
+
+	/// @returns The address of the first left table, relative to the first right.
+	uint16_t left_tables() const {
+		return uint16_t(banks_ * 256);
+	}
+
+	/// @returns The number of bytes from the start of the first table of a kind to the end of the last.
+	size_t tables_size() const;
+
+	/// @returns The operations that a sliver performs, with the map byte in A and having already stored it
+	/// as the low byte of the JP at @c slot, to point that JP at the table of the proper bank. There are
+	/// none if there's only one bank.
+	std::vector<Operation> select(bool left, const std::string &slot) const;
+
+private:
+	TileDispatch(size_t tiles, size_t banks) : tiles_(tiles), banks_(banks) {}
+
+	size_t tiles_;
+	size_t banks_;
+};
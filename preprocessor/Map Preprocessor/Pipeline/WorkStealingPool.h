@@ -0,0 +1,140 @@
+//
+//  WorkStealingPool.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/*!
+	Runs a fixed set of independent, indexed jobs across a group of threads.
+
+	Each worker starts with a contiguous range of job indices and works from the front of it;
+	a worker that runs dry steals the back half of whichever other range is largest. So
+	jobs of very uneven cost still balance out, and callers that store results by index
+	get identical output regardless of thread count or timing.
+*/
+class WorkStealingPool {
+public:
+	/// Constructs a pool of @c threads workers; 0 means one per hardware thread.
+	WorkStealingPool(size_t threads = 0) :
+		threads_(threads ? threads : std::max(size_t(1), size_t(std::thread::hardware_concurrency()))) {}
+
+	size_t threads() const {
+		return threads_;
+	}
+
+	/// Calls @c job(index) for every index in [0, count), returning only once all have completed.
+	/// If any job throws then remaining jobs are abandoned and the first exception is rethrown here.
+	template <typename JobT>
+	void parallel_for(size_t count, JobT &&job) const {
+		const size_t workers = std::min(threads_, count);
+		if(workers <= 1) {
+			for(size_t c = 0; c < count; c++) {
+				job(c);
+			}
+			return;
+		}
+
+		struct Range {
+			std::mutex mutex;
+			size_t begin, end;
+		};
+		std::vector<std::unique_ptr<Range>> ranges;
+		for(size_t c = 0; c < workers; c++) {
+			auto &range = ranges.emplace_back(std::make_unique<Range>());
+			range->begin = c * count / workers;
+			range->end = (c + 1) * count / workers;
+		}
+
+		std::mutex exception_mutex;
+		std::exception_ptr exception;
+		std::atomic<bool> abandoned = false;
+
+		const auto next = [&](size_t worker) -> std::optional<size_t> {
+			{
+				auto &own = *ranges[worker];
+				std::lock_guard lock(own.mutex);
+				if(own.begin != own.end) {
+					return own.begin++;
+				}
+			}
+
+			// Nothing left locally; steal the back half of the largest remaining range.
+			while(true) {
+				size_t victim = worker;
+				size_t largest = 0;
+				for(size_t c = 0; c < workers; c++) {
+					if(c == worker) continue;
+					std::lock_guard lock(ranges[c]->mutex);
+					const size_t size = ranges[c]->end - ranges[c]->begin;
+					if(size > largest) {
+						largest = size;
+						victim = c;
+					}
+				}
+				if(!largest) return std::nullopt;
+
+				size_t begin, end;
+				{
+					auto &range = *ranges[victim];
+					std::lock_guard lock(range.mutex);
+					if(range.begin == range.end) continue;	// Someone else got there first; look again.
+					end = range.end;
+					begin = range.begin + (range.end - range.begin) / 2;
+					range.end = begin;
+				}
+
+				// Take the first stolen job now and publish the rest for others to steal from.
+				auto &own = *ranges[worker];
+				std::lock_guard lock(own.mutex);
+				own.begin = begin + 1;
+				own.end = end;
+				return begin;
+			}
+		};
+
+		const auto work = [&](size_t worker) {
+			while(true) {
+				if(abandoned) return;
+				const auto index = next(worker);
+				if(!index) return;
+
+				try {
+					job(*index);
+				} catch(...) {
+					std::lock_guard lock(exception_mutex);
+					if(!exception) exception = std::current_exception();
+					abandoned = true;
+				}
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for(size_t c = 1; c < workers; c++) {
+			pool.emplace_back(work, c);
+		}
+		work(0);
+		for(auto &thread: pool) {
+			thread.join();
+		}
+
+		if(exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+private:
+	size_t threads_;
+};
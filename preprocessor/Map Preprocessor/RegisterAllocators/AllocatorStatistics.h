@@ -0,0 +1,70 @@
+//
+//  AllocatorStatistics.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/*!
+	Counts calls into the register allocators and RegisterSet, across all threads, so that a change to
+	either can be judged by how much more or less work it does as well as by the code it produces.
+
+	Counting is always on. Each count is a relaxed increment, which is small beside the work counted.
+*/
+class AllocatorStatistics {
+public:
+	struct Counts {
+		size_t mandatory_values = 0, mandatory_spans = 0;
+		size_t optional_values = 0, optional_spans = 0;
+		size_t register_loads = 0;
+	};
+
+	static void mandatory_value() {	increment(shared().mandatory_values_);	}
+	static void mandatory_spans() {	increment(shared().mandatory_spans_);	}
+	static void optional_value() {	increment(shared().optional_values_);	}
+	static void optional_spans() {	increment(shared().optional_spans_);	}
+	static void register_load() {	increment(shared().register_loads_);	}
+
+	/// @returns The counts since the last reset.
+	static Counts counts() {
+		const auto &statistics = shared();
+		return Counts{
+			.mandatory_values = statistics.mandatory_values_.load(std::memory_order_relaxed),
+			.mandatory_spans = statistics.mandatory_spans_.load(std::memory_order_relaxed),
+			.optional_values = statistics.optional_values_.load(std::memory_order_relaxed),
+			.optional_spans = statistics.optional_spans_.load(std::memory_order_relaxed),
+			.register_loads = statistics.register_loads_.load(std::memory_order_relaxed),
+		};
+	}
+
+	/// Zeroes all counts; this should not overlap with any counting.
+	static void reset() {
+		auto &statistics = shared();
+		for(auto *count: {
+			&statistics.mandatory_values_, &statistics.mandatory_spans_,
+			&statistics.optional_values_, &statistics.optional_spans_,
+			&statistics.register_loads_,
+		}) {
+			count->store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	std::atomic<size_t> mandatory_values_{0}, mandatory_spans_{0};
+	std::atomic<size_t> optional_values_{0}, optional_spans_{0};
+	std::atomic<size_t> register_loads_{0};
+
+	static AllocatorStatistics &shared() {
+		static AllocatorStatistics statistics;
+		return statistics;
+	}
+
+	static void increment(std::atomic<size_t> &count) {
+		count.fetch_add(1, std::memory_order_relaxed);
+	}
+};
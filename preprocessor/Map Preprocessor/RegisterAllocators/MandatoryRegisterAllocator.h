@@ -8,14 +8,59 @@
 #pragma once
 
 #include "Allocation.h"
+#include "AllocatorStatistics.h"
+#include "Operation.h"
+#include "OptionalRegisterAllocator.h"
 #include "Prioritiser.h"
 #include "Register.h"
 #include "RegisterSet.h"
+#include "WorkStealingPool.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <map>
 #include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+/*!
+	Selects how hard a MandatoryRegisterAllocator works to minimise cost.
+*/
+struct MandatoryAllocatorOptions {
+	/// If @c true then, beyond the usual priority-based guess, a furthest-next-use allocation is tried
+	/// and a bounded search is made for the allocation of least cost; the cheapest result wins.
+	bool exact = false;
+
+	/// Number of states the search may expand per stream; if it runs out then the better of the
+	/// heuristic results is used. This limits work rather than time so that output is reproducible.
+	size_t expansion_limit = 250'000;
+
+	/// Maximum number of distinct register states retained at each step of the search; beyond this
+	/// only the most promising are kept and the result is no longer guaranteed to be optimal.
+	size_t state_limit = 16384;
+
+	/// The number of most-spilled values considered for the index registers; every combination of them
+	/// is tried, so each one added doubles the worst-case work. At most @c MaxSpillLimit.
+	size_t spill_limit = 8;
+	static constexpr size_t MaxSpillLimit = 16;
+
+	/// The number of threads across which to evaluate those combinations; 0 means one per hardware thread.
+	/// Output is identical regardless of thread count.
+	size_t threads = 1;
+
+	/// When the generated code is expected to run, which determines the relative costs of
+	/// loading and using each register.
+	Region region = Region::across_frame();
+};
+
 /*!
 	Attempts 'reasonably' to allocate registers to a timestamped stream of constants
 	with the requirement that all constants must go into a register when they arrive.
@@ -29,17 +74,32 @@ template <typename IntT>
 class MandatoryRegisterAllocator {
 public:
 	template<typename ListT>
-	MandatoryRegisterAllocator(const ListT &registers) {
+	MandatoryRegisterAllocator(const ListT &registers, MandatoryAllocatorOptions options = {}) : options_(options) {
+		if(options_.spill_limit > MandatoryAllocatorOptions::MaxSpillLimit) {
+			throw std::invalid_argument(
+				"Spill limit of " + std::to_string(options_.spill_limit) + " exceeds the maximum of " +
+				std::to_string(MandatoryAllocatorOptions::MaxSpillLimit));
+		}
+
 		for(const auto reg: registers) {
 			if(Register::is_index_pair(reg)) {
 				index_registers_.push_back(reg);
 			} else {
 				registers_.push_back(reg);
 			}
+
+			load_costs_[reg] = Operation::ld(
+				Operand::direct(reg),
+				Operand::immediate<uint16_t>(0)
+			).cost(options_.region);
+			use_costs_[reg] = Operation::unary(Operation::Type::PUSH, reg).cost(options_.region);
+			cheapest_load_ = std::min(cheapest_load_, load_costs_[reg]);
+			cheapest_use_ = std::min(cheapest_use_, use_costs_[reg]);
 		}
 	}
 
 	void add_value(Time time, IntT value) {
+		AllocatorStatistics::mandatory_value();
 		prioritiser_.add_value(time, value);
 	}
 
@@ -48,6 +108,31 @@ public:
 	// makes a guess of its own.
 
 	std::vector<Allocation<IntT>> spans() {
+		AllocatorStatistics::mandatory_spans();
+		auto result = prioritised_spans();
+		if(!options_.exact) {
+			return result;
+		}
+
+		// Keep the priority-based result unless something is strictly cheaper, so that
+		// exact mode never makes things worse.
+		auto result_cost = cost(result);
+		const auto consider = [&](std::vector<Allocation<IntT>> &&candidate) {
+			const auto candidate_cost = cost(candidate);
+			if(candidate_cost < result_cost) {
+				result = std::move(candidate);
+				result_cost = candidate_cost;
+			}
+		};
+		consider(furthest_next_use_spans());
+		if(auto searched = searched_spans(result_cost)) {
+			consider(std::move(*searched));
+		}
+		return result;
+	}
+
+private:
+	std::vector<Allocation<IntT>> prioritised_spans() {
 		// Do an initial run to set a no-index-register baseline.
 		std::vector<Allocation<IntT>> baseline = spans({});
 		if(index_registers_.empty()) {
@@ -76,39 +161,119 @@ public:
 			return baseline;
 		}
 
-		// Try all combinations of the first few spills as sorted by spill size.
-		const size_t spills_to_try = std::min(ordered_spills.size(), size_t(8));
-		for(int try_list = 1; try_list < 1 << spills_to_try; try_list++) {
-			OptionalRegisterAllocator<uint16_t> index_allocator(index_registers_);
+		// Try all combinations of the first few spills as sorted by spill size. Each spill's times are
+		// gathered once up front, rather than per combination.
+		std::vector<std::pair<IntT, std::vector<Time>>> candidates;
+		for(const auto &spill: ordered_spills) {
+			if(candidates.size() == options_.spill_limit) break;
+			candidates.emplace_back(spill.second, std::vector<Time>{});
+		}
+		for(const auto &pair: prioritiser_.values()) {
+			for(auto &candidate: candidates) {
+				if(candidate.first == pair.second) {
+					candidate.second.push_back(pair.first);
+				}
+			}
+		}
 
-			int index = 1;
-			for(const auto &spill: ordered_spills) {
-				if(try_list & index) {
-					for(const auto &pair: prioritiser_.values()) {
-						if(pair.second == spill.second) {
-							index_allocator.add_value(pair.first, pair.second);
-						}
+		// Phase one: get the index register reservations implied by each combination. Each is allocated
+		// from scratch: the greedy index allocator's result isn't monotonic in its input, so one combination's
+		// reservations can't be derived from a neighbour's. Work is shared instead by evaluating each distinct
+		// outcome only once, below.
+		const WorkStealingPool pool(options_.threads);
+		std::vector<std::vector<Allocation<IntT>>> reservations((size_t(1) << candidates.size()) - 1);
+		pool.parallel_for(reservations.size(), [&](size_t index) {
+			const size_t try_list = index + 1;
+			OptionalRegisterAllocator<IntT> index_allocator(index_registers_);
+			for(size_t c = 0; c < candidates.size(); c++) {
+				if(try_list & (size_t(1) << c)) {
+					for(const auto time: candidates[c].second) {
+						index_allocator.add_value(time, candidates[c].first);
 					}
 				}
-				index <<= 1;
 			}
+			reservations[index] = index_allocator.spans();
+		});
+
+		// Phase two: evaluate each distinct, non-empty set of reservations once, in order of first
+		// appearance, skipping any that provably can't beat the best found so far. Only those that can't
+		// even tie are skipped, so the winner is the same as a serial run's.
+		std::vector<size_t> distinct;
+		{
+			std::set<std::vector<std::tuple<Time, IntT, Register::Name>>> seen;
+			for(size_t index = 0; index < reservations.size(); index++) {
+				if(reservations[index].empty()) continue;	// Non-use of the index registers has already been tested.
+
+				std::vector<std::tuple<Time, IntT, Register::Name>> key;
+				for(const auto &reservation: reservations[index]) {
+					key.emplace_back(reservation.time, reservation.value, reservation.reg);
+				}
+				if(seen.insert(std::move(key)).second) {
+					distinct.push_back(index);
+				}
+			}
+		}
 
-			const auto index_spans = index_allocator.spans();
-			if(index_spans.empty()) continue;	// Non-use of the index registers has already been tested.
-
-			const auto new_encoding = spans(index_spans);
-			if(cost(new_encoding) < cost(baseline)) {
-				baseline = new_encoding;
+		std::atomic<size_t> best_cost = cost(baseline);
+		std::vector<std::optional<std::pair<size_t, std::vector<Allocation<IntT>>>>> encodings(distinct.size());
+		pool.parallel_for(distinct.size(), [&](size_t index) {
+			const auto &index_spans = reservations[distinct[index]];
+			if(lower_bound(index_spans) > best_cost) return;
+
+			auto new_encoding = spans(index_spans);
+			const auto new_cost = cost(new_encoding);
+			auto best = best_cost.load();
+			while(new_cost < best && !best_cost.compare_exchange_weak(best, new_cost));
+			encodings[index] = std::make_pair(new_cost, std::move(new_encoding));
+		});
+
+		size_t baseline_cost = cost(baseline);
+		for(auto &encoding: encodings) {
+			if(encoding && encoding->first < baseline_cost) {
+				baseline_cost = encoding->first;
+				baseline = std::move(encoding->second);
 			}
 		}
 
 		return baseline;
 	}
 
-private:
 	std::vector<Register::Name> registers_;
 	std::vector<Register::Name> index_registers_;
 	Prioritiser<IntT> prioritiser_;
+	MandatoryAllocatorOptions options_;
+
+	// Costs of loading a constant into, and pushing, each register.
+	std::map<Register::Name, size_t> load_costs_, use_costs_;
+	size_t cheapest_load_ = std::numeric_limits<size_t>::max();
+	size_t cheapest_use_ = std::numeric_limits<size_t>::max();
+
+	/// @returns A lower bound on the cost of the result of @c spans(index_reservations): every use
+	/// costs at least the cheapest use, each reservation costs its load plus the excess of every use
+	/// while it's resident, and every other value needs at least one load.
+	size_t lower_bound(const std::vector<Allocation<IntT>> &index_reservations) {
+		const auto &values = prioritiser_.values();
+		size_t result = cheapest_use_ * values.size();
+
+		std::unordered_set<IntT> reserved;
+		for(auto it = index_reservations.begin(); it != index_reservations.end(); ++it) {
+			const auto next = std::find_if(it + 1, index_reservations.end(), [&](const auto &reservation) {
+				return reservation.reg == it->reg;
+			});
+			const Time horizon = next == index_reservations.end() ? prioritiser_.end_time() : next->time - 1;
+			const auto uses = size_t(prioritiser_.priority_at(it->time, horizon, it->value).value_or(0));
+			result += load_costs_[it->reg] + uses * (use_costs_[it->reg] - cheapest_use_);
+			reserved.insert(it->value);
+		}
+
+		std::unordered_set<IntT> others;
+		for(const auto &pair: values) {
+			if(!reserved.count(pair.second)) {
+				others.insert(pair.second);
+			}
+		}
+		return result + cheapest_load_ * others.size();
+	}
 
 	size_t cost(const std::vector<Allocation<IntT>> &spans) {
 		size_t result = 0;
@@ -118,15 +283,21 @@ private:
 			// Perform a load if required.
 			if(it != spans.end() && it->time == value.first) {
 				state.set_value<uint16_t>(it->reg, it->value);
-				result += Register::is_index_pair(it->reg) ? 4 : 3;
+				result += load_costs_[it->reg];
 				++it;
 			}
 
-			// Test which register is being drawn from.
-			const auto ix = state.value<uint16_t>(Register::Name::IX);
-			const auto iy = state.value<uint16_t>(Register::Name::IY);
-			const bool is_index = (ix && *ix == value.second) || (iy && *iy == value.second);
-			result += is_index ? 4 : 3;
+			// Test which register is being drawn from; anything in an index register
+			// is assumed to be used from there.
+			size_t use = cheapest_use_;
+			for(const auto reg: index_registers_) {
+				const auto held = state.value<uint16_t>(reg);
+				if(held && *held == value.second) {
+					use = use_costs_[reg];
+					break;
+				}
+			}
+			result += use;
 		}
 
 		return result;
@@ -217,4 +388,280 @@ private:
 
 		return spans;
 	}
+	//
+	// Exact mode.
+	//
+	// Both of the below work on a dense form of the stream: a list of value IDs, plus for each step the
+	// step at which that value is next used. Registers are numbered with all non-index registers first.
+	//
+
+	static constexpr int Dead = -1;
+	static constexpr size_t MaxRegisters = 8;
+	using Contents = std::array<int, MaxRegisters>;
+
+	struct Stream {
+		std::vector<Time> times;
+		std::vector<IntT> values;
+		std::vector<int> ids;
+		std::vector<size_t> next_use;		// Or ids.size() if never used again.
+		std::vector<size_t> last_use;		// Indexed by ID.
+		std::vector<int> remaining_ids;		// Number of distinct IDs used at or after each step.
+
+		Stream(const std::map<Time, IntT> &source) {
+			std::unordered_map<IntT, int> id_map;
+			for(const auto &pair: source) {
+				const auto id = id_map.emplace(pair.second, int(id_map.size())).first->second;
+				times.push_back(pair.first);
+				values.push_back(pair.second);
+				ids.push_back(id);
+			}
+
+			next_use.resize(ids.size());
+			last_use.resize(id_map.size());
+			remaining_ids.resize(ids.size() + 1);
+			std::vector<size_t> next(id_map.size(), ids.size());
+			for(size_t c = ids.size(); c-- > 0;) {
+				remaining_ids[c] = remaining_ids[c + 1] + (next[size_t(ids[c])] == ids.size());
+				next_use[c] = next[size_t(ids[c])];
+				next[size_t(ids[c])] = c;
+			}
+			for(size_t c = 0; c < ids.size(); c++) {
+				last_use[size_t(ids[c])] = c;
+			}
+		}
+
+		size_t size() const {
+			return ids.size();
+		}
+	};
+
+	std::vector<Register::Name> all_registers() const {
+		std::vector<Register::Name> all = registers_;
+		all.insert(all.end(), index_registers_.begin(), index_registers_.end());
+		return all;
+	}
+
+	/// Belady's algorithm: on each miss, load into an empty register if there is one, preferring
+	/// non-index registers, otherwise evict whichever value is next used furthest in the future.
+	std::vector<Allocation<IntT>> furthest_next_use_spans() {
+		const Stream stream(prioritiser_.values());
+		const auto registers = all_registers();
+		std::vector<Allocation<IntT>> spans;
+
+		Contents contents;
+		contents.fill(Dead);
+		std::vector<size_t> next_use(registers.size(), 0);
+		for(size_t step = 0; step < stream.size(); step++) {
+			const auto id = stream.ids[step];
+			const auto resident = std::find(contents.begin(), contents.begin() + registers.size(), id);
+			if(resident != contents.begin() + registers.size()) {
+				next_use[size_t(resident - contents.begin())] = stream.next_use[step];
+				continue;
+			}
+
+			size_t selected = 0;
+			for(size_t reg = 0; reg < registers.size(); reg++) {
+				if(contents[reg] == Dead || next_use[reg] == stream.size()) {
+					selected = reg;
+					break;
+				}
+				if(next_use[reg] > next_use[selected]) {
+					selected = reg;
+				}
+			}
+			contents[selected] = id;
+			next_use[selected] = stream.next_use[step];
+			spans.push_back(Allocation<IntT>{
+				.time = stream.times[step],
+				.value = stream.values[step],
+				.reg = registers[selected],
+			});
+		}
+
+		return spans;
+	}
+
+	/// Searches breadth-first over register contents, merging paths that arrive at the same contents
+	/// and pruning any that cannot beat @c bound. Loads are only ever made on demand, and values
+	/// that won't be used again are treated as interchangeable with empty registers, which keeps the
+	/// state space small enough that the search is usually exhaustive.
+	///
+	/// Only the current and previous layers of states are held in full; each earlier step keeps just
+	/// what's needed to walk back along the cheapest path.
+	///
+	/// @returns The cheapest allocation found, or @c std::nullopt if nothing beat @c bound or the
+	/// expansion limit was reached.
+	std::optional<std::vector<Allocation<IntT>>> searched_spans(size_t bound) {
+		const Stream stream(prioritiser_.values());
+		const auto registers = all_registers();
+		const size_t plain_registers = registers_.size();
+		if(registers.size() > MaxRegisters) {
+			return std::nullopt;
+		}
+
+		std::vector<size_t> load_costs, use_costs;
+		for(const auto reg: registers) {
+			load_costs.push_back(load_costs_[reg]);
+			use_costs.push_back(use_costs_[reg]);
+		}
+
+		struct Node {
+			Contents contents;
+			size_t cost;
+			size_t parent;
+			int loaded;		// Register loaded at this step, or -1 for none.
+		};
+		struct Trail {
+			uint32_t parent;
+			int8_t loaded;
+		};
+		struct ContentsHash {
+			size_t operator()(const Contents &contents) const {
+				size_t result = 0;
+				for(const auto value: contents) {
+					result = result * 31 + size_t(value + 1);
+				}
+				return result;
+			}
+		};
+
+		// A lower bound on the cost of serving steps [step, end) given the resident values: every use
+		// costs at least the cheapest use and every value that will be used but isn't resident needs a load.
+		const auto remaining_cost = [&](size_t step, const Contents &contents) -> size_t {
+			size_t resident = 0;
+			for(size_t reg = 0; reg < registers.size(); reg++) {
+				resident += contents[reg] != Dead;
+			}
+			return
+				cheapest_use_ * (stream.size() - step) +
+				cheapest_load_ * (size_t(stream.remaining_ids[step]) - resident);
+		};
+
+		Node root{.cost = 0, .parent = 0, .loaded = -1};
+		root.contents.fill(Dead);
+		std::vector<Node> previous{root}, layer;
+		std::vector<std::vector<Trail>> trails;
+		trails.reserve(stream.size());
+
+		std::unordered_map<Contents, size_t, ContentsHash> merged;
+		size_t expanded = 0;
+		for(size_t step = 0; step < stream.size(); step++) {
+			expanded += previous.size();
+			if(expanded > options_.expansion_limit) {
+				return std::nullopt;
+			}
+
+			const auto id = stream.ids[step];
+			layer.clear();
+			merged.clear();
+
+			const auto add = [&](Node &&node) {
+				// Forget anything that won't be used again.
+				for(size_t reg = 0; reg < registers.size(); reg++) {
+					if(node.contents[reg] != Dead && stream.last_use[size_t(node.contents[reg])] <= step) {
+						node.contents[reg] = Dead;
+					}
+				}
+				if(node.cost + remaining_cost(step + 1, node.contents) >= bound) {
+					return;
+				}
+
+				const auto existing = merged.find(node.contents);
+				if(existing == merged.end()) {
+					merged.emplace(node.contents, layer.size());
+					layer.push_back(std::move(node));
+				} else if(node.cost < layer[existing->second].cost) {
+					layer[existing->second] = std::move(node);
+				}
+			};
+
+			for(size_t index = 0; index < previous.size(); index++) {
+				const auto &node = previous[index];
+				const auto resident = std::find(node.contents.begin(), node.contents.begin() + registers.size(), id);
+				if(resident != node.contents.begin() + registers.size()) {
+					add(Node{
+						.contents = node.contents,
+						.cost = node.cost + use_costs[size_t(resident - node.contents.begin())],
+						.parent = index,
+						.loaded = -1,
+					});
+					continue;
+				}
+
+				// Within each class of register an empty one is at least as good as any occupied one,
+				// and all empty ones are alike; so branch only on the first empty, or else every occupied.
+				const auto branch = [&](size_t begin, size_t end) {
+					for(size_t reg = begin; reg < end; reg++) {
+						if(node.contents[reg] == Dead) {
+							end = reg + 1;
+							begin = reg;
+							break;
+						}
+					}
+					for(size_t reg = begin; reg < end; reg++) {
+						Node next{
+							.contents = node.contents,
+							.cost = node.cost + load_costs[reg] + use_costs[reg],
+							.parent = index,
+							.loaded = int(reg),
+						};
+						next.contents[reg] = id;
+						add(std::move(next));
+					}
+				};
+				branch(0, plain_registers);
+				branch(plain_registers, registers.size());
+			}
+
+			if(layer.empty()) {
+				return std::nullopt;
+			}
+
+			// Keep only the most promising states if there are too many.
+			if(layer.size() > options_.state_limit) {
+				std::vector<std::pair<size_t, size_t>> ranked;
+				for(size_t index = 0; index < layer.size(); index++) {
+					ranked.emplace_back(layer[index].cost + remaining_cost(step + 1, layer[index].contents), index);
+				}
+				std::nth_element(ranked.begin(), ranked.begin() + ptrdiff_t(options_.state_limit), ranked.end());
+				ranked.resize(options_.state_limit);
+				std::sort(ranked.begin(), ranked.end(), [](const auto &lhs, const auto &rhs) {
+					return lhs.second < rhs.second;
+				});
+
+				std::vector<Node> kept;
+				for(const auto &pair: ranked) {
+					kept.push_back(std::move(layer[pair.second]));
+				}
+				layer = std::move(kept);
+			}
+
+			auto &trail = trails.emplace_back();
+			trail.reserve(layer.size());
+			for(const auto &node: layer) {
+				trail.push_back(Trail{.parent = uint32_t(node.parent), .loaded = int8_t(node.loaded)});
+			}
+			std::swap(previous, layer);
+		}
+
+		// Walk back from the cheapest final state to collect its loads.
+		size_t index = size_t(std::min_element(previous.begin(), previous.end(), [](const Node &lhs, const Node &rhs) {
+			return lhs.cost < rhs.cost;
+		}) - previous.begin());
+
+		std::vector<Allocation<IntT>> spans;
+		for(size_t step = stream.size(); step > 0; step--) {
+			const auto &trail = trails[step - 1][index];
+			if(trail.loaded >= 0) {
+				spans.push_back(Allocation<IntT>{
+					.time = stream.times[step - 1],
+					.value = stream.values[step - 1],
+					.reg = registers[size_t(trail.loaded)],
+				});
+			}
+			index = trail.parent;
+		}
+		std::reverse(spans.begin(), spans.end());
+		return spans;
+	}
 };
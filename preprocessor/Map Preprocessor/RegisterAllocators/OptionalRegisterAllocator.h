@@ -9,10 +9,12 @@
 
 #include <limits>
 #include <map>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
 #include "Allocation.h"
+#include "AllocatorStatistics.h"
 #include "Prioritiser.h"
 #include "Register.h"
 
@@ -36,10 +38,12 @@ public:
 		registers_(registers) {}
 
 	void add_value(Time time, IntT value) {
+		AllocatorStatistics::optional_value();
 		prioritiser_.add_value(time, value);
 	}
 
 	std::vector<Allocation<IntT>> spans() {
+		AllocatorStatistics::optional_spans();
 		auto prioritiser = prioritiser_;
 		std::vector<Allocation<IntT>> result;
 
@@ -7,10 +7,16 @@
 
 #pragma once
 
+#include "Allocation.h"
+
+#include <algorithm>
 #include <limits>
+#include <map>
 #include <optional>
+#include <set>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 
 template <typename IntT>
 struct PrioritisedValue {
@@ -29,23 +35,55 @@ struct PrioritisedValue {
 	provides the single value that would most benefit from being
 	in a register at any given point in time along with the number of
 	times it will be used at any point in the future.
+
+	Alongside the time-ordered list of values, a sorted list of occurrence
+	times is kept per value; so usage counts and spans within a window are
+	each a pair of binary searches, i.e. O(log n).
+
+	The top-priority query can't be wholly logarithmic, since priorities depend
+	on the window asked about. Values are therefore also indexed by their total
+	number of occurrences, and considered from most to least frequent; a value
+	can't be used more often within a window than it is overall, so the search stops
+	at the first value that occurs less often than the best found so far. That's
+	O(log n) when the window covers every use of the most frequent values,
+	but O(distinct values · log n) in the worst case.
 */
 template <typename IntT>
 class Prioritiser {
 public:
 	void add_value(Time time, IntT value) {
-		values_.emplace(time, value);
+		if(!values_.emplace(time, value).second) {
+			return;
+		}
+
+		auto &times = occurrences_[value];
+		counts_.erase({times.size(), value});
+		if(times.empty() || times.back() < time) {
+			times.push_back(time);
+		} else {
+			times.insert(std::upper_bound(times.begin(), times.end(), time), time);
+		}
+		counts_.emplace(times.size(), value);
 	}
 
 	void remove_value(Time start, Time end, IntT value) {
-		auto cursor = values_.lower_bound(start);
-		const auto target = values_.upper_bound(end);
-		while(cursor != target) {
-			if(cursor->second == value) {
-				cursor = values_.erase(cursor);
-			} else {
-				++cursor;
-			}
+		const auto entry = occurrences_.find(value);
+		if(entry == occurrences_.end()) {
+			return;
+		}
+
+		auto &times = entry->second;
+		counts_.erase({times.size(), value});
+		const auto begin = std::lower_bound(times.begin(), times.end(), start);
+		const auto target = std::upper_bound(begin, times.end(), end);
+		for(auto cursor = begin; cursor != target; ++cursor) {
+			values_.erase(*cursor);
+		}
+		times.erase(begin, target);
+		if(times.empty()) {
+			occurrences_.erase(entry);
+		} else {
+			counts_.emplace(times.size(), value);
 		}
 	}
 
@@ -57,50 +95,68 @@ public:
 	}
 
 	std::optional<TimeSpan> span_of(IntT value, Time start = 0) const {
-		// Do a dumb, linear search.
-		TimeSpan result{
-			.begin = std::numeric_limits<Time>::max(),
-			.end = std::numeric_limits<Time>::min(),
-		};
-
-		auto it = values_.lower_bound(start);
-		while(it != values_.end()) {
-			if(it->second == value) {
-				result.begin = std::min(result.begin, it->first);
-				result.end = std::max(result.begin, it->first);
-			}
-			++it;
+		const auto entry = occurrences_.find(value);
+		if(entry == occurrences_.end()) {
+			return {};
 		}
 
-		if(result.begin > result.end) {
+		const auto &times = entry->second;
+		const auto first = std::lower_bound(times.begin(), times.end(), start);
+		if(first == times.end()) {
 			return {};
 		}
-		return result;
+		return TimeSpan{
+			.begin = *first,
+			.end = times.back(),
+		};
 	}
 
 	std::optional<int> priority_at(Time time, Time horizon, IntT value) const {
-		IntT throwaway;
-		const auto priorities = all_priorities(time, horizon, throwaway);
-		const auto entry = priorities.find(value);
-		if(entry == priorities.end()) {
+		const auto entry = occurrences_.find(value);
+		if(entry == occurrences_.end()) {
+			return {};
+		}
+
+		const auto [begin, end] = window(entry->second, time, horizon);
+		if(begin == end) {
 			return {};
 		}
-		return entry->second.usages_remaining;
+		return int(end - begin);
 	}
 
 	std::optional<PrioritisedValue<IntT>> prioritised_value_at(Time time, Time horizon) const {
 		// Version 1 has a very simple metric: number of remaining usages.
 		// TODO: incorporate a sense of how imminent those usages are.
-
-		// Count remaining usages, keeping track of the top item.
-		IntT top_value = 0;
-		const auto priorities = all_priorities(time, horizon, top_value);
-
-		// Pick whatever came out on top, if anything.
-		if(priorities.empty()) {
-			return {};
+		//
+		// Ties go to whichever value reaches the winning count soonest.
+		std::optional<PrioritisedValue<IntT>> result;
+		Time result_decider = 0;
+		for(auto candidate = counts_.rbegin(); candidate != counts_.rend(); ++candidate) {
+			const auto &[total, value] = *candidate;
+			if(result && total < result->usages_remaining) break;
+
+			const auto [begin, end] = window(occurrences_.find(value)->second, time, horizon);
+			if(begin == end) continue;
+
+			const size_t count = size_t(end - begin);
+			const Time decider = begin[count - 1];
+			if(
+				!result ||
+				count > result->usages_remaining ||
+				(count == result->usages_remaining && decider < result_decider)
+			) {
+				result = PrioritisedValue<IntT>{
+					.value = value,
+					.active_range = {
+						.begin = *begin,
+						.end = end[-1] + 1,
+					},
+					.usages_remaining = count,
+				};
+				result_decider = decider;
+			}
 		}
-		return priorities.find(top_value)->second;
+		return result;
 	}
 
 	const std::map<Time, IntT> &values() {
@@ -109,30 +165,13 @@ public:
 
 private:
 	std::map<Time, IntT> values_;
-
-	std::unordered_map<IntT, PrioritisedValue<IntT>> all_priorities(Time time, Time horizon, IntT &top_value) const {
-		std::unordered_map<IntT, PrioritisedValue<IntT>> priorities;
-
-		size_t top_count = 0;
-		auto cursor = values_.lower_bound(time);
-		const auto target = values_.upper_bound(horizon);
-		while(cursor != target) {
-			auto &priority = priorities[cursor->second];
-
-			priority.value = cursor->second;
-			priority.active_range.begin = std::min(priority.active_range.begin, cursor->first);
-			priority.active_range.end = std::max(priority.active_range.end, cursor->first + 1);
-
-			++priority.usages_remaining;
-			if(priority.usages_remaining > top_count) {
-				top_count = priority.usages_remaining;
-				top_value = cursor->second;
-			}
-			++cursor;
-		}
-
-		return priorities;
+	std::unordered_map<IntT, std::vector<Time>> occurrences_;
+	std::set<std::pair<size_t, IntT>> counts_;	// (total occurrences, value) for every value in occurrences_.
+
+	/// @returns The range of @c times that falls within [@c time, @c horizon].
+	static std::pair<std::vector<Time>::const_iterator, std::vector<Time>::const_iterator>
+		window(const std::vector<Time> &times, Time time, Time horizon) {
+		const auto begin = std::lower_bound(times.begin(), times.end(), time);
+		return {begin, std::upper_bound(begin, times.end(), horizon)};
 	}
-
 };
-
@@ -12,6 +12,7 @@
 #include "TileSerialiser.h"
 #include "Register.h"
 
+#include <cassert>
 #include <unordered_map>
 #include <optional>
 
@@ -23,7 +24,7 @@ struct RegisterEvent {
 	uint16_t value;
 };
 
-template <int TileSize>
+template <int Width, int Height>
 class TileRegisterAllocator {
 	static constexpr auto RegistersSansIX = { Register::Name::BC, Register::Name::DE, Register::Name::IY };
 	static constexpr auto RegistersPlusIX = {
@@ -32,70 +33,58 @@ class TileRegisterAllocator {
 	};
 
 public:
-	TileRegisterAllocator(TileSerialiser<TileSize> &serialiser, bool permit_ix) :
-		a_cursor_(a_allocations_.end()),
-		registers_(permit_ix ? RegistersPlusIX : RegistersSansIX)
+	/// Allocates registers for @c events, which should be a complete serialisation of the tile;
+	/// times passed to next_word and next_byte are thereafter the event offsets within it.
+	TileRegisterAllocator(
+		const TileEvents &events,
+		bool permit_ix,
+		MandatoryAllocatorOptions options = {}
+	) :
+		registers_(permit_ix ? RegistersPlusIX : RegistersSansIX),
+		a_cursor_(a_allocations_.end())
 	{
-		MandatoryRegisterAllocator<uint16_t> allocator(registers_);
-		serialiser.reset();
+		MandatoryRegisterAllocator<uint16_t> allocator(registers_, options);
 
 		// Accumulate word priorities.
-		while(true) {
-			const auto event = serialiser.next();
-			if(event.type == TileEvent::Type::Stop) {
-				break;
-			}
-
-			switch(event.type) {
-				default: break;
-				case TileEvent::Type::OutputWord:
-					allocator.add_value(serialiser.event_offset(), event.content);
-				break;
+		for(size_t index = 0; index < events.size(); index++) {
+			const auto &event = events[index];
+			if(event.type == TileEvent::Type::OutputWord) {
+				allocator.add_value(Time(index + 1), event.content);
 			}
 		}
 
 		allocations_ = allocator.spans();
 
 		// Reset state.
-		serialiser.reset();
 		reset();
 
 		// Look for A optimisations.
 		const auto registers8 = { Register::Name::A };
 		OptionalRegisterAllocator<uint8_t> a_allocator(registers8);
-		while(true) {
-			const auto next = serialiser.next();
-			if(next.type == TileEvent::Type::Stop) {
-				break;
-			}
-
-			switch(next.type) {
-				default: break;
-
-				case TileEvent::Type::OutputByte: {
-					const auto event = next_byte(serialiser.event_offset(), next.content);
-					if(event.type == RegisterEvent::Type::UseConstant) {
-						a_allocator.add_value(serialiser.event_offset(), event.value);
-					}
-				} break;
+		for(size_t index = 0; index < events.size(); index++) {
+			const auto &next = events[index];
+			if(next.type == TileEvent::Type::OutputByte) {
+				const auto event = next_byte(index + 1, uint8_t(next.content));
+				if(event.type == RegisterEvent::Type::UseConstant) {
+					a_allocator.add_value(Time(index + 1), uint8_t(event.value));
+				}
 			}
 		}
 		a_allocations_ = a_allocator.spans();
 
 		// Clear state.
-		serialiser.reset();
 		reset();
 	}
 
 	RegisterEvent next_word(size_t time, uint16_t value) {
-		 if(cursor_ != allocations_.end() && time == cursor_->time) {
+		 if(cursor_ != allocations_.end() && Time(time) == cursor_->time) {
 			 state_.set_value<uint16_t>(cursor_->reg, cursor_->value);
 			 const auto cursor = cursor_;
 			 ++cursor_;
 
 			 return RegisterEvent {
-				.reg = cursor->reg,
 				.type = RegisterEvent::Type::Load,
+				.reg = cursor->reg,
 				.value = cursor->value,
 			 };
 		 }
@@ -133,16 +122,16 @@ public:
 		}
 
 		// Is this a point at which A is loaded?
-		if(a_cursor_ != a_allocations_.end() && time == a_cursor_->time) {
+		if(a_cursor_ != a_allocations_.end() && Time(time) == a_cursor_->time) {
 			state_.set_value<uint8_t>(Register::Name::A, value);
 			++a_cursor_;
-			return RegisterEvent{.reg = Register::Name::A, .type = RegisterEvent::Type::Load, .value = value};
+			return RegisterEvent{.type = RegisterEvent::Type::Load, .reg = Register::Name::A, .value = value};
 		}
 
 		// Otherwise, does A have the right value already or is this a constant?
 		const auto a = state_.value<uint8_t>(Register::Name::A);
 		if(a && *a == value) {
-			return RegisterEvent{.reg = Register::Name::A, .type = RegisterEvent::Type::Reuse, .value = value};
+			return RegisterEvent{.type = RegisterEvent::Type::Reuse, .reg = Register::Name::A, .value = value};
 		} else {
 			return RegisterEvent{.type = RegisterEvent::Type::UseConstant, .value = value};
 		}
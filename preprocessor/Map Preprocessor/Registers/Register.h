@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 namespace Register {
 
 enum class Name {
@@ -65,6 +67,7 @@ constexpr const char *name(Name r) {
 		case Name::SPl: return "spl";
 		case Name::SPh:	return "sph";
 	}
+	__builtin_unreachable();
 }
 
 constexpr Name low_part(Name r) {
@@ -93,6 +96,7 @@ constexpr Name low_part(Name r) {
 		case Name::SPl: return Name::SPl;
 		case Name::SPh:	return Name::SPh;
 	}
+	__builtin_unreachable();
 }
 
 constexpr Name high_part(Name r) {
@@ -121,6 +125,7 @@ constexpr Name high_part(Name r) {
 		case Name::SPl: return Name::SPl;
 		case Name::SPh:	return Name::SPh;
 	}
+	__builtin_unreachable();
 }
 
 constexpr size_t size(Name r) {
@@ -148,6 +153,7 @@ constexpr size_t size(Name r) {
 		case Name::SPl:
 		case Name::SPh:	return 1;
 	}
+	__builtin_unreachable();
 }
 
 constexpr bool is_index_pair_or_hl(Name r) {
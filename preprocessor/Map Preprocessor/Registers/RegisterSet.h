@@ -7,9 +7,15 @@
 
 #pragma once
 
+#include "AllocatorStatistics.h"
 #include "Register.h"
 #include "Operation.h"
 
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
 /// Models the full set of Z80 registers of which this program's code generators are aware
 /// and provides the minimal route to loading values to registers given their current state.
 ///
@@ -20,6 +26,7 @@ class RegisterSet {
 public:
 	template <typename IntT>
 	Operation load(Register::Name reg, IntT target) {
+		AllocatorStatistics::register_load();
 		const auto previous = value<IntT>(reg);
 		struct SetAtExit {
 			SetAtExit(Register::Name reg, IntT target, RegisterSet &set) :
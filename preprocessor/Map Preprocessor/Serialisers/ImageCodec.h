@@ -0,0 +1,36 @@
+//
+//  ImageCodec.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "PixelAccessor.h"
+
+#include <filesystem>
+#include <memory>
+
+/*!
+	Abstracts the means by which the asset pipeline reads and writes image files, so that
+	the host can pick its preferred decoder — e.g. NSImage in the Cocoa application, libpng
+	in the command-line tool.
+
+	Implementations should throw std::runtime_error if a file cannot be read or written.
+*/
+class ImageCodec {
+public:
+	virtual ~ImageCodec() = default;
+
+	/// Decodes the image at @c path.
+	virtual std::unique_ptr<PixelAccessor> load(const std::filesystem::path &path) const = 0;
+
+	/// Writes the @c width by @c height area of @c source with its top-left corner at (@c x, @c y)
+	/// to @c path as a PNG. May be called from several threads at once, for different paths.
+	virtual void save(
+		const std::filesystem::path &path,
+		const PixelAccessor &source,
+		size_t x, size_t y,
+		size_t width, size_t height) const = 0;
+};
@@ -0,0 +1,96 @@
+//
+//  NSImageCodec.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#import <Cocoa/Cocoa.h>
+
+#include "ImageCodec.h"
+#include "PixelAccessor.h"
+
+#include <stdexcept>
+
+/*!
+	Wraps the necessary CGBitmap calls to take an NSImage and provide
+	access to its pixel contents.
+*/
+class NSImagePixelAccessor: public PixelAccessor {
+public:
+	NSImagePixelAccessor(NSImage *image) {
+		colour_space_ = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+		bitmap_ = CGBitmapContextCreate(
+			NULL,
+			image.size.width, image.size.height,
+			8, 0,
+			colour_space_, kCGImageAlphaPremultipliedLast);
+		NSGraphicsContext *gctx = [NSGraphicsContext graphicsContextWithCGContext:bitmap_ flipped:NO];
+		[NSGraphicsContext setCurrentContext:gctx];
+		[image drawInRect:NSMakeRect(0, 0, image.size.width, image.size.height)];
+
+		pixels_ = reinterpret_cast<uint8_t *>(CGBitmapContextGetData(bitmap_));
+		width_ = CGBitmapContextGetWidth(bitmap_);
+		height_ = CGBitmapContextGetHeight(bitmap_);
+		bytes_per_row_ = CGBitmapContextGetBytesPerRow(bitmap_);
+	}
+
+	~NSImagePixelAccessor() {
+		[NSGraphicsContext setCurrentContext:nil];
+		CGContextRelease(bitmap_);
+		CGColorSpaceRelease(colour_space_);
+	}
+
+private:
+	CGContextRef bitmap_;
+	CGColorSpaceRef colour_space_;
+};
+
+/*!
+	Provides image loading via NSImage and saving via NSBitmapImageRep.
+*/
+class NSImageCodec: public ImageCodec {
+public:
+	std::unique_ptr<PixelAccessor> load(const std::filesystem::path &path) const override {
+		NSData *fileData = [NSData dataWithContentsOfFile:[NSString stringWithUTF8String:path.c_str()]];
+		NSImage *image = [[NSImage alloc] initWithData:fileData];
+		if(!image) {
+			throw std::runtime_error(path.string() + ": could not be decoded");
+		}
+		return std::make_unique<NSImagePixelAccessor>(image);
+	}
+
+	void save(
+		const std::filesystem::path &path,
+		const PixelAccessor &source,
+		size_t x, size_t y,
+		size_t width, size_t height
+	) const override {
+		// Saves may be made from worker threads, which have no autorelease pool of their own.
+		@autoreleasepool {
+			uint8_t *planes[] = {
+				reinterpret_cast<uint8_t *>(const_cast<uint32_t *>(source.pixels(x, y)))
+			};
+			NSBitmapImageRep *image_representation =
+				[[NSBitmapImageRep alloc]
+					initWithBitmapDataPlanes:planes
+					pixelsWide:width
+					pixelsHigh:height
+					bitsPerSample:8
+					samplesPerPixel:4
+					hasAlpha:YES
+					isPlanar:NO
+					colorSpaceName:NSDeviceRGBColorSpace
+					bytesPerRow:source.bytes_per_row()
+					bitsPerPixel:0];
+
+			NSData *const data =
+				[image_representation representationUsingType:NSBitmapImageFileTypePNG properties:@{}];
+			[data
+				writeToFile:[NSString stringWithUTF8String:path.c_str()]
+				atomically:NO];
+		}
+	}
+};
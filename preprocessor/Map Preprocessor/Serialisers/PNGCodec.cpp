@@ -0,0 +1,74 @@
+//
+//  PNGCodec.cpp
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "PNGCodec.h"
+
+#include <png.h>
+
+#include <cstring>
+#include <stdexcept>
+
+PNGPixelAccessor::PNGPixelAccessor(const std::filesystem::path &path) {
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+
+	if(!png_image_begin_read_from_file(&image, path.c_str())) {
+		throw std::runtime_error(path.string() + ": " + image.message);
+	}
+
+	image.format = PNG_FORMAT_RGBA;
+	storage_.resize(PNG_IMAGE_SIZE(image));
+	if(!png_image_finish_read(&image, nullptr, storage_.data(), 0, nullptr)) {
+		png_image_free(&image);
+		throw std::runtime_error(path.string() + ": " + image.message);
+	}
+
+	// Premultiply alpha, to match the format that CoreGraphics supplies.
+	for(size_t c = 0; c < storage_.size(); c += 4) {
+		const unsigned alpha = storage_[c + 3];
+		if(alpha == 0xff) continue;
+		for(size_t channel = 0; channel < 3; channel++) {
+			storage_[c + channel] = uint8_t((storage_[c + channel] * alpha + 127) / 255);
+		}
+	}
+
+	width_ = image.width;
+	height_ = image.height;
+	bytes_per_row_ = PNG_IMAGE_ROW_STRIDE(image);
+	pixels_ = storage_.data();
+}
+
+std::unique_ptr<PixelAccessor> PNGCodec::load(const std::filesystem::path &path) const {
+	return std::make_unique<PNGPixelAccessor>(path);
+}
+
+void PNGCodec::save(
+	const std::filesystem::path &path,
+	const PixelAccessor &source,
+	size_t x, size_t y,
+	size_t width, size_t height
+) const {
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	image.width = png_uint_32(width);
+	image.height = png_uint_32(height);
+	image.format = PNG_FORMAT_RGBA;
+
+	// Row stride is measured in components, i.e. bytes for an 8-bit format.
+	if(!png_image_write_to_file(
+		&image,
+		path.c_str(),
+		0,
+		source.pixels(x, y),
+		png_int_32(source.bytes_per_row()),
+		nullptr
+	)) {
+		throw std::runtime_error(path.string() + ": " + image.message);
+	}
+}
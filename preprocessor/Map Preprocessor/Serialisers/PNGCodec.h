@@ -0,0 +1,39 @@
+//
+//  PNGCodec.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "ImageCodec.h"
+#include "PixelAccessor.h"
+
+#include <filesystem>
+#include <vector>
+
+/*!
+	A PixelAccessor that decodes a PNG via libpng, without any dependency on
+	the host's graphics frameworks.
+*/
+class PNGPixelAccessor: public PixelAccessor {
+public:
+	PNGPixelAccessor(const std::filesystem::path &path);
+
+private:
+	std::vector<uint8_t> storage_;
+};
+
+/*!
+	Provides PNG loading and saving via libpng.
+*/
+class PNGCodec: public ImageCodec {
+public:
+	std::unique_ptr<PixelAccessor> load(const std::filesystem::path &path) const override;
+	void save(
+		const std::filesystem::path &path,
+		const PixelAccessor &source,
+		size_t x, size_t y,
+		size_t width, size_t height) const override;
+};
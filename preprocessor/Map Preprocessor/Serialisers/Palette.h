@@ -0,0 +1,61 @@
+//
+//  Palette.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*!
+	A SAM palette, plus the means to map source colours to it.
+
+	Source colours are grouped into bins by the top five bits of each channel, which is finer than the
+	SAM's three bits plus a shared bright, so the mapping is a fixed-size table however many distinct
+	colours the source has.
+*/
+struct Palette {
+	static constexpr int ChannelBits = 5;
+	static constexpr int ChannelBins = 1 << ChannelBits;
+	static constexpr size_t Bins = size_t(1) << (ChannelBits * 3);
+
+	/// @returns The bin for @c colour, a 32-bit RGBA word with red in the low byte; the
+	/// red bin is in the low bits, then green, then blue.
+	static constexpr size_t bin(uint32_t colour) {
+		constexpr int shift = 8 - ChannelBits;
+		constexpr uint32_t mask = ChannelBins - 1;
+		return
+			((colour >> shift) & mask) |
+			(((colour >> (8 + shift)) & mask) << ChannelBits) |
+			(((colour >> (16 + shift)) & mask) << (ChannelBits * 2));
+	}
+
+	std::vector<uint8_t> sam_palette;
+
+	/// The palette index of every bin.
+	std::vector<uint8_t> mapping = std::vector<uint8_t>(Bins);
+
+	/// @returns The palette index of @c colour.
+	uint8_t index(uint32_t colour) const {
+		return mapping[bin(colour)];
+	}
+
+	/// Moves the colour at each index n to index @c order[n].
+	template <typename OrderT>
+	void reorder(const OrderT &order) {
+		std::vector<uint8_t> reordered(sam_palette.size());
+		for(size_t index = 0; index < sam_palette.size(); index++) {
+			reordered[order[index]] = sam_palette[index];
+		}
+		sam_palette = std::move(reordered);
+
+		for(auto &index: mapping) {
+			index = order[index];
+		}
+	}
+};
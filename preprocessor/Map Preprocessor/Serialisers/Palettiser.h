@@ -7,131 +7,157 @@
 
 #pragma once
 
-#include <algorithm>
-#include <set>
-
-struct Palette {
-	std::vector<uint8_t> sam_palette;
-	std::unordered_map<uint32_t, uint8_t> source_mapping;
-};
+#include "Palette.h"
+#include "PixelAccessor.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*!
+	Picks a palette of up to @c TargetCount colours for everything passed to it.
+
+	Colours are counted into a histogram of Palette::Bins bins as they arrive, so the cost of adding
+	an image is independent of how many distinct colours it has. The colour space is then cut into
+	boxes, each time splitting the box with the greatest squared error, weighted by pixel count, at
+	whichever plane leaves the two halves with the least. So a colour used by only a few pixels
+	doesn't get a palette entry of its own if there's a more common colour range that needs dividing.
+*/
 template <size_t TargetCount = 16, size_t TargetOffset = 0>
 class Palettiser {
 public:
-	Palettiser(size_t rotation) : rotation_(rotation) {}
-
-	void add_colour(uint32_t colour) {
-		colours_.insert(colour);
+	/// Adds @c count pixels of @c colour; transparent colours are ignored.
+	void add_colour(uint32_t colour, uint64_t count = 1) {
+		if(PixelAccessor::is_transparent(colour)) return;
+		histogram_[Palette::bin(colour)].add(colour, count);
 	}
 
 	void add_colours(const PixelAccessor &source) {
 		for(size_t y = 0; y < source.height(); y++) {
 			const uint32_t *line = source.pixels(0, y);
-			colours_.insert(line, line + source.width());
+			for(size_t x = 0; x < source.width(); x++) {
+				add_colour(line[x]);
+			}
 		}
 	}
 
-	Palette palette() {
-		// First effort: median cut.
-		// Seed output palette with initial bucket.
-		struct Bucket {
-			std::vector<uint32_t> colours;
+	Palette palette() const {
+		struct Box {
+			std::array<int, 3> min, max;	// Inclusive, in bins.
+			Moments moments;
+			double error;
+		};
+		const auto box = [&](std::array<int, 3> min, std::array<int, 3> max, const Moments &moments) {
+			return Box{.min = min, .max = max, .moments = moments, .error = moments.error()};
 		};
-		std::vector<Bucket> buckets;
-
-		auto &bucket = buckets.emplace_back();
-		std::transform(
-			colours_.begin(),
-			colours_.end(),
-			std::back_inserter(bucket.colours),
-			[](const auto value){ return value;}
-		);
-
-		while(true) {
-			// Test for termination conditions: at 16 buckets, or
-			// else all remaining buckets have only one colour in them.
-			if(buckets.size() == TargetCount) break;
-			size_t net_size = 0;
-			for(const auto &bucket: buckets) {
-				net_size += bucket.colours.size();
+
+		// Start with the whole colour space.
+		std::vector<Box> boxes;
+		{
+			Moments total;
+			for(const auto &bin: histogram_) {
+				total += bin;
 			}
-			if(net_size == buckets.size()) break;
-
-			// Didn't terminate so find bucket with greatest single-colour range.
-			int colour_shift = 0;
-			Bucket *selected_bucket = nullptr;
-			int max_range = 0;
-			for(auto &bucket: buckets) {
-				if(bucket.colours.size() == 1) {
-					continue;
+			constexpr int top = Palette::ChannelBins - 1;
+			boxes.push_back(box({0, 0, 0}, {top, top, top}, total));
+		}
+
+		while(boxes.size() < TargetCount) {
+			// Pick the box with the greatest error; stop if none has any.
+			Box *selected = nullptr;
+			for(auto &candidate: boxes) {
+				if(candidate.error > 0.0 && (!selected || candidate.error > selected->error)) {
+					selected = &candidate;
 				}
+			}
+			if(!selected) break;
 
-				uint32_t max = 0, min = 255;
-				for(int index = 0; index < 24; index += 8) {
-					for(const auto colour: bucket.colours) {
-						max = std::max(max, (colour >> index) & 0xff);
-						min = std::min(min, (colour >> index) & 0xff);
+			// Total the box by slice along each axis.
+			std::array<std::vector<Moments>, 3> slices;
+			for(int axis = 0; axis < 3; axis++) {
+				slices[axis].resize(size_t(selected->max[axis] - selected->min[axis] + 1));
+			}
+			for(int b = selected->min[2]; b <= selected->max[2]; b++) {
+				for(int g = selected->min[1]; g <= selected->max[1]; g++) {
+					for(int r = selected->min[0]; r <= selected->max[0]; r++) {
+						const auto &bin = histogram_[
+							size_t(r) | size_t(g) << Palette::ChannelBits | size_t(b) << (Palette::ChannelBits * 2)
+						];
+						if(!bin.count) continue;
+						slices[0][size_t(r - selected->min[0])] += bin;
+						slices[1][size_t(g - selected->min[1])] += bin;
+						slices[2][size_t(b - selected->min[2])] += bin;
 					}
+				}
+			}
 
-					const auto range = max - min;
-					if(range > max_range) {
-						selected_bucket = &bucket;
-						colour_shift = index;
-						max_range = range;
+			// Find the cut that leaves the least error, with pixels on both sides.
+			struct Cut {
+				int axis;
+				int last;	// The final slice included in the lower half.
+				Moments lower;
+				double error;
+			};
+			std::optional<Cut> best;
+			for(int axis = 0; axis < 3; axis++) {
+				Moments lower;
+				for(size_t slice = 0; slice + 1 < slices[axis].size(); slice++) {
+					lower += slices[axis][slice];
+					if(!lower.count) continue;
+					if(lower.count == selected->moments.count) break;
+
+					const double error = lower.error() + (selected->moments - lower).error();
+					if(!best || error < best->error) {
+						best = Cut{.axis = axis, .last = selected->min[axis] + int(slice), .lower = lower, .error = error};
 					}
 				}
 			}
 
-			// Sort values in that bucket by the relevant channel, divide and continue.
-			std::multimap<uint8_t, uint32_t> colours_by_channel;
-			for(const auto colour: selected_bucket->colours) {
-				colours_by_channel.emplace((colour >> colour_shift) & 0xff, colour);
+			// All pixels are in a single bin, so can't be divided further.
+			if(!best) {
+				selected->error = 0.0;
+				continue;
 			}
 
-			auto median = colours_by_channel.begin();
-			std::advance(median, colours_by_channel.size() / 2);
-
-			selected_bucket->colours.clear();
-			auto cursor = colours_by_channel.begin();
-			while(cursor != median) {
-				selected_bucket->colours.push_back(cursor->second);
-				++cursor;
-			}
+			auto upper_min = selected->min;
+			upper_min[best->axis] = best->last + 1;
+			auto lower_max = selected->max;
+			lower_max[best->axis] = best->last;
 
-			auto &new_bucket = buckets.emplace_back();
-			while(cursor != colours_by_channel.end()) {
-				new_bucket.colours.push_back(cursor->second);
-				++cursor;
-			}
+			const auto upper = box(upper_min, selected->max, selected->moments - best->lower);
+			*selected = box(selected->min, lower_max, best->lower);
+			boxes.push_back(upper);
 		}
 
 		// Build final palette.
 		Palette result;
 		result.sam_palette.resize(TargetCount);
-		uint8_t palette_index = rotation_;
-		for(const auto &bucket: buckets) {
-			const uint8_t index = palette_index + TargetOffset;
-			palette_index = (palette_index + 1) % TargetCount;
-
-			uint32_t sum[3]{};
-			for(const auto colour: bucket.colours) {
-				result.source_mapping[colour] = index;
-				sum[0] += (colour >> 0) & 0xff;
-				sum[1] += (colour >> 8) & 0xff;
-				sum[2] += (colour >> 16) & 0xff;
+		uint8_t palette_index = 0;
+		for(const auto &box: boxes) {
+			const uint8_t index = palette_index++ + TargetOffset;
+
+			for(int b = box.min[2]; b <= box.max[2]; b++) {
+				for(int g = box.min[1]; g <= box.max[1]; g++) {
+					for(int r = box.min[0]; r <= box.max[0]; r++) {
+						result.mapping[
+							size_t(r) | size_t(g) << Palette::ChannelBits | size_t(b) << (Palette::ChannelBits * 2)
+						] = index;
+					}
+				}
 			}
+			if(!box.moments.count) continue;
 
-			sum[0] = uint8_t(roundf(static_cast<float>(sum[0]) / static_cast<float>(bucket.colours.size())));
-			sum[1] = uint8_t(roundf(static_cast<float>(sum[1]) / static_cast<float>(bucket.colours.size())));
-			sum[2] = uint8_t(roundf(static_cast<float>(sum[2]) / static_cast<float>(bucket.colours.size())));
-
-			const auto remap = [](uint32_t source) {
-				return int(roundf(7.0 * static_cast<float>(source) / 255.0));
+			const auto remap = [&](int channel) {
+				const auto mean = float(box.moments.sum[channel]) / float(box.moments.count);
+				return int(roundf(7.0f * roundf(mean) / 255.0f));
 			};
 
-			const uint8_t red = remap(sum[0]);
-			const uint8_t green = remap(sum[1]);
-			const uint8_t blue = remap(sum[2]);
+			const uint8_t red = remap(0);
+			const uint8_t green = remap(1);
+			const uint8_t blue = remap(2);
 
 			const uint8_t bright = (red & 1) + (green & 1) + (blue & 1);
 			const uint8_t sam_colour =
@@ -155,6 +181,50 @@ public:
 	}
 
 private:
-	std::unordered_set<uint32_t> colours_;
-	size_t rotation_;
+	/// The number of pixels in a bin or box, and the sums of their channels and of their channels squared.
+	struct Moments {
+		uint64_t count = 0;
+		std::array<uint64_t, 3> sum{};
+		uint64_t squares = 0;
+
+		void add(uint32_t colour, uint64_t pixels) {
+			count += pixels;
+			for(int channel = 0; channel < 3; channel++) {
+				const uint64_t value = (colour >> (channel * 8)) & 0xff;
+				sum[channel] += value * pixels;
+				squares += value * value * pixels;
+			}
+		}
+
+		Moments &operator +=(const Moments &rhs) {
+			count += rhs.count;
+			for(int channel = 0; channel < 3; channel++) {
+				sum[channel] += rhs.sum[channel];
+			}
+			squares += rhs.squares;
+			return *this;
+		}
+
+		Moments operator -(const Moments &rhs) const {
+			Moments result = *this;
+			result.count -= rhs.count;
+			for(int channel = 0; channel < 3; channel++) {
+				result.sum[channel] -= rhs.sum[channel];
+			}
+			result.squares -= rhs.squares;
+			return result;
+		}
+
+		/// @returns The sum of squared distances of all pixels from their mean.
+		double error() const {
+			if(!count) return 0.0;
+			double mean_squares = 0.0;
+			for(int channel = 0; channel < 3; channel++) {
+				mean_squares += double(sum[channel]) * double(sum[channel]);
+			}
+			return std::max(0.0, double(squares) - mean_squares / double(count));
+		}
+	};
+
+	std::vector<Moments> histogram_ = std::vector<Moments>(Palette::Bins);
 };
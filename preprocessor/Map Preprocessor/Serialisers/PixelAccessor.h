@@ -7,37 +7,27 @@
 
 #pragma once
 
-#include <map>
+#include "Palette.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
 #include <vector>
 
 /*!
-	Wraps the necessary CGBitmap calls to take an NSImage and provide
-	access to its pixel contents.
+	Provides access to the pixel contents of a decoded image, as 32-bit
+	RGBA words with premultiplied alpha, red in the low byte.
+
+	Subclasses are responsible for decoding and for owning the pixel
+	storage; see e.g. PNGPixelAccessor and NSImagePixelAccessor.
 */
 class PixelAccessor {
 public:
-	PixelAccessor(NSImage *image) {
-		colour_space_ = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
-		bitmap_ = CGBitmapContextCreate(
-			NULL,
-			image.size.width, image.size.height,
-			8, 0,
-			colour_space_, kCGImageAlphaPremultipliedLast);
-		NSGraphicsContext *gctx = [NSGraphicsContext graphicsContextWithCGContext:bitmap_ flipped:NO];
-		[NSGraphicsContext setCurrentContext:gctx];
-		[image drawInRect:NSMakeRect(0, 0, image.size.width, image.size.height)];
-
-		pixels_ = reinterpret_cast<uint8_t *>(CGBitmapContextGetData(bitmap_));
-		width_ = CGBitmapContextGetWidth(bitmap_);
-		height_ = CGBitmapContextGetHeight(bitmap_);
-		bytes_per_row_ = CGBitmapContextGetBytesPerRow(bitmap_);
-	}
+	virtual ~PixelAccessor() = default;
 
-	~PixelAccessor() {
-		[NSGraphicsContext setCurrentContext:nil];
-		CGContextRelease(bitmap_);
-		CGColorSpaceRelease(colour_space_);
-	}
+	PixelAccessor(const PixelAccessor &) = delete;
+	PixelAccessor &operator =(const PixelAccessor &) = delete;
 
 	size_t bytes_per_row() const { return bytes_per_row_; }
 	size_t width() const { return width_; }
@@ -57,17 +47,20 @@ public:
 		return !(colour >> 24);
 	}
 
-private:
-	size_t width_, height_;
-	CGContextRef bitmap_;
-	CGColorSpaceRef colour_space_;
-	uint8_t *pixels_;
-	size_t bytes_per_row_;
+protected:
+	PixelAccessor() = default;
+
+	size_t width_ = 0, height_ = 0;
+	uint8_t *pixels_ = nullptr;
+	size_t bytes_per_row_ = 0;
 };
 
 /*!
 	Takes a PixelAccessor and an active palette, maps it through the paltte and subsequently
 	provides pixels as 4bpp palette entries.
+
+	The palettised pixels are immutable once built and are shared between copies, so copying
+	is cheap and allocation-free; copies may be used from different threads.
 */
 class PalettedPixelAccessor {
 public:
@@ -80,36 +73,41 @@ public:
 
 	PalettedPixelAccessor(
 		const PixelAccessor &accessor,
-		const std::unordered_map<uint32_t, uint8_t> &palette,
+		const Palette &palette,
 		Transformation transformation
 	) :
 		width_(accessor.width()),
 		height_(accessor.height())
 	{
-		pixels_.resize(width_ * height_);
+		std::vector<uint8_t> pixels(width_ * height_);
 
 		for(size_t y = 0; y < height_; y++) {
 			for(size_t x = 0; x < width_; x++) {
 				size_t destination = y * width_ + x;
 				if(transformation == Transformation::ReverseX) {
-					destination = pixels_.size() - 1 - destination;
+					destination = pixels.size() - 1 - destination;
 				}
 
 				const uint32_t source_colour = accessor.pixel(x, y);
 				if(PixelAccessor::is_transparent(source_colour)) {
-					pixels_[destination] = 0xff;
+					pixels[destination] = 0xff;
 				} else {
-					const auto iterator = palette.find(source_colour);
-					pixels_[destination] = iterator != palette.end() ? iterator->second : 0;
+					pixels[destination] = palette.index(source_colour);
 				}
 			}
 		}
+		pixels_ = std::make_shared<const std::vector<uint8_t>>(std::move(pixels));
 	}
 
 	size_t width() const { return width_; }
 	size_t height() const { return height_; }
 	uint8_t pixel(size_t x, size_t y) const { return *pixels(x, y); }
-	const uint8_t *pixels(size_t x, size_t y) const { return &pixels_[y * width_ + x]; }
+
+	const uint8_t *pixels(size_t x, size_t y) const { return &(*pixels_)[y * width_ + x]; }
+
+	/// Pixels are stored contiguously, row by row, with no padding; so this is the
+	/// full set of width() * height() palette entries.
+	const std::vector<uint8_t> &all_pixels() const { return *pixels_; }
 
 	static constexpr bool is_transparent(uint8_t colour) {
 		return colour == 0xff;
@@ -117,5 +115,5 @@ public:
 
 private:
 	size_t width_, height_;
-	std::vector<uint8_t> pixels_;
+	std::shared_ptr<const std::vector<uint8_t>> pixels_;
 };
@@ -9,6 +9,9 @@
 
 #include "PixelAccessor.h"
 
+#include <cstdint>
+#include <optional>
+
 struct SpriteEvent {
 	enum class Type {
 		/// Moves the cursor location by a specified amount.
@@ -43,7 +46,7 @@ public:
 	SpriteSerialiser(
 		uint8_t index,
 		const PixelAccessor &accessor,
-		const std::unordered_map<uint32_t, uint8_t> &palette,
+		const Palette &palette,
 		Order order) :
 			index_(index),
 			contents_(accessor, palette, PalettedPixelAccessor::Transformation::None),
@@ -72,10 +75,8 @@ public:
 			return SpriteEvent{.type = SpriteEvent::Type::Stop};
 		}
 
-		const auto sprite_event = SpriteEvent{
-			.type = SpriteEvent::Type::OutputByte,
-			.content.output = next->value,
-		};
+		SpriteEvent sprite_event{.type = SpriteEvent::Type::OutputByte};
+		sprite_event.content.output = next->value;
 
 		if(next->continuous) {
 			return sprite_event;
@@ -83,11 +84,11 @@ public:
 
 		continuous_ = true;
 		enqueued_ = sprite_event;
-		return SpriteEvent{
-			.type = SpriteEvent::Type::Move,
-			.content.move.x = next->x >> 1,
-			.content.move.y = next->y,
-		};
+
+		SpriteEvent move{.type = SpriteEvent::Type::Move};
+		move.content.move.x = next->x >> 1;
+		move.content.move.y = next->y;
+		return move;
 	}
 
 	void reset() {
@@ -113,6 +114,10 @@ public:
 		return order_;
 	}
 
+	const PalettedPixelAccessor &contents() const {
+		return contents_;
+	}
+
 private:
 	uint8_t index_;
 	PalettedPixelAccessor contents_;
@@ -171,7 +176,8 @@ private:
 	}
 
 	std::optional<NextPixels> next_columns_first() {
-		while(x_ >= 0 && x_ < contents_.width()) {
+		// x_ is unsigned, so a leftward pass that steps beyond column 0 wraps around and also ends here.
+		while(x_ < contents_.width()) {
 			while(y_ < contents_.height()) {
 				const auto y = y_;
 				y_ += 2;
@@ -7,13 +7,17 @@
 
 #pragma once
 
+#include "PixelAccessor.h"
+
 #include <array>
 #include <cstdint>
 #include <cmath>
+#include <cstdlib>
 #include <map>
+#include <vector>
 
 struct TileEvent {
-	enum class Type {
+	enum class Type: uint8_t {
 		/// Start a new line two lines up from the start of the current line.
 		Up2,
 		/// Start a new line one line up from the start of the current line.
@@ -31,12 +35,21 @@ struct TileEvent {
 	uint16_t content;
 };
 
-template <int TileSize>
+/// A complete serialisation of one slice of a tile, ending with a Stop; the event at index n
+/// is that for which TileSerialiser::event_offset() would return n + 1.
+using TileEvents = std::vector<TileEvent>;
+
+/// Serialises a tile of @c Width by @c Height pixels for output via the stack. Alternate lines are
+/// output on the way up the tile and the rest on the way back down, so that every step between lines
+/// is a change to H other than the single Up1 at the top.
+template <int Width, int Height>
 struct TileSerialiser {
+	static_assert(!(Width & 3) && !(Height & 1), "Tiles must be a whole number of words wide and of line pairs high");
+
 	TileSerialiser(
 		uint8_t index,
 		const PixelAccessor &accessor,
-		const std::unordered_map<uint32_t, uint8_t> &palette) :
+		const Palette &palette) :
 			index_(index),
 			contents_(accessor, palette, PalettedPixelAccessor::Transformation::ReverseX)
 	{
@@ -56,7 +69,7 @@ struct TileSerialiser {
 	/// One column = one byte's width, i.e. two pixels.
 	void set_slice(int slice) {
 		odd_width_ = slice & 1;
-		words_wide_ = (TileSize >> 2) - ((abs(slice) + 1) >> 1);
+		words_wide_ = (Width >> 2) - ((abs(slice) + 1) >> 1);
 		byte_begin_ = (slice >= 0) ? 0 : (-slice << 1);
 		reset();
 	}
@@ -69,11 +82,11 @@ struct TileSerialiser {
 			x_ = 0;
 			++y_;
 
-			if(y_ == TileSize) {
+			if(y_ == Height) {
 				return TileEvent{.type = TileEvent::Type::Stop};
-			} else if(y_ < (TileSize >> 1)) {
+			} else if(y_ < (Height >> 1)) {
 				previous_.type = TileEvent::Type::Up2;
-			} else if(y_ == TileSize >> 1) {
+			} else if(y_ == Height >> 1) {
 				previous_.type = TileEvent::Type::Up1;
 			} else {
 				previous_.type = TileEvent::Type::Down2;
@@ -104,6 +117,17 @@ struct TileSerialiser {
 		return previous_;
 	}
 
+	/// @returns All events for the current slice, from the beginning; serialisation is reset afterwards.
+	TileEvents events() {
+		TileEvents result;
+		reset();
+		do {
+			result.push_back(next());
+		} while(result.back().type != TileEvent::Type::Stop);
+		reset();
+		return result;
+	}
+
 	void reset() {
 		x_ = 0;
 		y_ = 0;
@@ -119,10 +143,14 @@ struct TileSerialiser {
 		return event_offset_;
 	}
 
+	const PalettedPixelAccessor &contents() const {
+		return contents_;
+	}
+
 private:
 	const uint8_t *swizzled_offset() {
 		const auto y = [&] {
-			if(y_ & 8) return 31 - (y_ << 1);
+			if(y_ >= (Height >> 1)) return (Height << 1) - 1 - (y_ << 1);
 			return y_ << 1;
 		}();
 		return contents_.pixels(x_, y);
@@ -0,0 +1,33 @@
+//
+//  TileShape.h
+//  Map Preprocessor
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include <cstddef>
+
+// The dimensions of a tile, in pixels, fixed at build time so that the serialiser and the sliver generator
+// can be specialised for them; see the TILE_WIDTH and TILE_HEIGHT options in CMakeLists.txt.
+#ifndef TILE_WIDTH
+#define TILE_WIDTH 16
+#endif
+
+#ifndef TILE_HEIGHT
+#define TILE_HEIGHT 16
+#endif
+
+static constexpr int TileWidth = TILE_WIDTH;
+static constexpr int TileHeight = TILE_HEIGHT;
+
+static_assert(TileWidth == 8 || TileWidth == 16, "Tiles must be 8 or 16 pixels wide");
+static_assert(TileHeight == 8 || TileHeight == 16, "Tiles must be 8 or 16 pixels high");
+
+/// The number of bytes across a tile, which is also the number of 2-pixel scroll steps per tile
+/// and therefore the number of video buffers.
+static constexpr int TileBytes = TileWidth / 2;
+
+/// The number of rows of tiles on display.
+static constexpr size_t TileRows = 192 / TileHeight;
@@ -0,0 +1,174 @@
+//
+//  AssemblerTests.cpp
+//  Map Preprocessor Tests
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Assembler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Name = Register::Name;
+using Type = Operation::Type;
+
+bool all_passed = true;
+
+std::string hex(const std::vector<uint8_t> &bytes) {
+	std::string result;
+	for(const auto byte: bytes) {
+		char text[4];
+		snprintf(text, sizeof(text), "%02x ", byte);
+		result += text;
+	}
+	return result;
+}
+
+void expect_bytes(const Operation &operation, const std::vector<uint8_t> &expected) {
+	try {
+		const auto bytes = Assembler::encode(operation);
+		if(bytes != expected) {
+			std::fprintf(stderr, "%s assembles to %srather than %s\n",
+				operation.text().c_str(), hex(bytes).c_str(), hex(expected).c_str());
+			all_passed = false;
+		}
+		if(bytes.size() != operation.size()) {
+			std::fprintf(stderr, "%s is %zu bytes but its size is given as %zu\n",
+				operation.text().c_str(), bytes.size(), operation.size());
+			all_passed = false;
+		}
+	} catch(const std::exception &exception) {
+		std::fprintf(stderr, "%s: %s\n", operation.text().c_str(), exception.what());
+		all_passed = false;
+	}
+}
+
+void expect_failure(const Operation &operation) {
+	try {
+		const auto bytes = Assembler::encode(operation);
+		std::fprintf(stderr, "%s assembles to %srather than failing\n", operation.text().c_str(), hex(bytes).c_str());
+		all_passed = false;
+	} catch(const std::runtime_error &error) {
+		if(std::string(error.what()).rfind("Cannot assemble", 0) != 0) {
+			std::fprintf(stderr, "%s fails with '%s'\n", operation.text().c_str(), error.what());
+			all_passed = false;
+		}
+	}
+}
+
+Operation ld(Operand destination, Operand source) {	return Operation::ld(destination, source);	}
+Operand direct(Name name) {						return Operand::direct(name);					}
+Operand indirect(Name name) {					return Operand::indirect(name);				}
+Operand byte(uint8_t value) {					return Operand::immediate(value);				}
+Operand word(uint16_t value) {					return Operand::immediate(value);				}
+
+/// @returns An arithmetic or logical operation with a single operand, as generated for A.
+Operation unary(Type type, Operand operand) {
+	return Operation{.type = type, .destination = operand};
+}
+
+}
+
+int main() {
+	// Stores, as made by tiles and sprites.
+	expect_bytes(ld(indirect(Name::HL), direct(Name::A)), {0x77});
+	expect_bytes(ld(indirect(Name::HL), direct(Name::E)), {0x73});
+	expect_bytes(ld(indirect(Name::HL), byte(0x12)), {0x36, 0x12});
+	expect_bytes(ld(indirect(Name::IX), direct(Name::A)), {0xdd, 0x77, 0x00});
+	expect_bytes(ld(indirect(Name::IX), direct(Name::L)), {0xdd, 0x75, 0x00});
+	expect_bytes(ld(indirect(Name::IY), byte(0x12)), {0xfd, 0x36, 0x00, 0x12});
+	expect_bytes(ld(indirect(Name::BC), direct(Name::A)), {0x02});
+	expect_bytes(ld(indirect(Name::DE), direct(Name::A)), {0x12});
+
+	// Loads.
+	expect_bytes(ld(direct(Name::A), byte(0x12)), {0x3e, 0x12});
+	expect_bytes(ld(direct(Name::IXh), byte(0x12)), {0xdd, 0x26, 0x12});
+	expect_bytes(ld(direct(Name::IYl), byte(0x34)), {0xfd, 0x2e, 0x34});
+	expect_bytes(ld(direct(Name::BC), word(0x1234)), {0x01, 0x34, 0x12});
+	expect_bytes(ld(direct(Name::IX), word(0x1234)), {0xdd, 0x21, 0x34, 0x12});
+	expect_bytes(ld(direct(Name::SP), word(0x1234)), {0x31, 0x34, 0x12});
+	expect_bytes(ld(direct(Name::HL), Operand::label("target")), {0x21, 0x00, 0x00});
+	expect_bytes(Operation::ld(Name::D, Name::E), {0x53});
+	expect_bytes(Operation::ld(Name::A, Name::IXl), {0xdd, 0x7d});
+	expect_bytes(Operation::ld(Name::IYh, Name::A), {0xfd, 0x67});
+	expect_bytes(Operation::ld(Name::SP, Name::HL), {0xf9});
+	expect_bytes(Operation::ld(Name::SP, Name::IX), {0xdd, 0xf9});
+	expect_bytes(ld(direct(Name::A), indirect(Name::DE)), {0x1a});
+	expect_bytes(ld(direct(Name::E), indirect(Name::HL)), {0x5e});
+	expect_bytes(ld(direct(Name::H), indirect(Name::IX)), {0xdd, 0x66, 0x00});
+
+	// Self-modification and its reads.
+	expect_bytes(ld(Operand::label_indirect("target"), direct(Name::A)), {0x32, 0x00, 0x00});
+	expect_bytes(ld(Operand::label_indirect("target"), direct(Name::HL)), {0x22, 0x00, 0x00});
+	expect_bytes(ld(Operand::label_indirect("target"), direct(Name::IY)), {0xfd, 0x22, 0x00, 0x00});
+	expect_bytes(ld(Operand::label_indirect("target"), direct(Name::SP)), {0xed, 0x73, 0x00, 0x00});
+	expect_bytes(ld(direct(Name::A), Operand::label_indirect("target")), {0x3a, 0x00, 0x00});
+	expect_bytes(ld(direct(Name::HL), Operand::label_indirect("target")), {0x2a, 0x00, 0x00});
+	expect_bytes(ld(direct(Name::DE), Operand::label_indirect("target")), {0xed, 0x5b, 0x00, 0x00});
+
+	// Increments and decrements.
+	expect_bytes(Operation::unary(Type::INC, Name::L), {0x2c});
+	expect_bytes(Operation::unary(Type::DEC, Name::H), {0x25});
+	expect_bytes(Operation::unary(Type::INC, Name::IXl), {0xdd, 0x2c});
+	expect_bytes(Operation::unary(Type::INC, Name::HL), {0x23});
+	expect_bytes(Operation::unary(Type::INC, Name::DE), {0x13});
+	expect_bytes(Operation::unary(Type::DEC, Name::SP), {0x3b});
+	expect_bytes(unary(Type::INC, indirect(Name::HL)), {0x34});
+	expect_bytes(unary(Type::DEC, indirect(Name::IX)), {0xdd, 0x35, 0x00});
+
+	// Arithmetic.
+	expect_bytes(Operation::add(Name::HL, Name::BC), {0x09});
+	expect_bytes(Operation::add(Name::HL, Name::SP), {0x39});
+	expect_bytes(Operation::add(Name::IX, Name::DE), {0xdd, 0x19});
+	expect_bytes(Operation::add(Name::IY, Name::IY), {0xfd, 0x29});
+	expect_bytes(unary(Type::ADD, direct(Name::B)), {0x80});
+	expect_bytes(unary(Type::SUB, byte(0x12)), {0xd6, 0x12});
+	expect_bytes(unary(Type::AND, indirect(Name::HL)), {0xa6});
+	expect_bytes(unary(Type::AND, indirect(Name::IY)), {0xfd, 0xa6, 0x00});
+	expect_bytes(unary(Type::XOR, direct(Name::A)), {0xaf});
+	expect_bytes(unary(Type::OR, direct(Name::IXh)), {0xdd, 0xb4});
+	expect_bytes(Operation::unary(Type::SET7, Name::H), {0xcb, 0xfc});
+	expect_bytes(Operation::unary(Type::RES7, Name::A), {0xcb, 0xbf});
+	expect_bytes(unary(Type::SET7, indirect(Name::HL)), {0xcb, 0xfe});
+	expect_bytes(unary(Type::SET7, indirect(Name::IX)), {0xdd, 0xcb, 0x00, 0xfe});
+	expect_bytes(unary(Type::RES7, indirect(Name::IY)), {0xfd, 0xcb, 0x00, 0xbe});
+	expect_bytes(Operation::nullary(Type::RRCA), {0x0f});
+	expect_bytes(Operation::nullary(Type::RLCA), {0x07});
+	expect_bytes(Operation::nullary(Type::CPL), {0x2f});
+
+	// Stack, flow and the rest.
+	expect_bytes(Operation::unary(Type::PUSH, Name::BC), {0xc5});
+	expect_bytes(Operation::unary(Type::PUSH, Name::AF), {0xf5});
+	expect_bytes(Operation::unary(Type::PUSH, Name::IX), {0xdd, 0xe5});
+	expect_bytes(Operation::unary(Type::PUSH, Name::IY), {0xfd, 0xe5});
+	expect_bytes(Operation::jp(0x1234), {0xc3, 0x34, 0x12});
+	expect_bytes(Operation::jp("target"), {0xc3, 0x00, 0x00});
+	expect_bytes(unary(Type::JP, indirect(Name::HL)), {0xe9});
+	expect_bytes(unary(Type::JP, indirect(Name::IX)), {0xdd, 0xe9});
+	expect_bytes(Operation::call("target"), {0xcd, 0x00, 0x00});
+	expect_bytes(Operation::nullary(Type::RET), {0xc9});
+	expect_bytes(Operation::nullary(Type::EX_DE_HL), {0xeb});
+	expect_bytes(Operation::nullary(Type::LDI), {0xed, 0xa0});
+	expect_bytes(Operation::nullary(Type::NOP), {0x00});
+	expect_bytes(Operation::label("target"), {});
+
+	// Combinations with no encoding: an index half alongside a displacement, H or L alongside a prefix
+	// without one, (HL) alongside a prefix, and mixed prefixes.
+	expect_failure(ld(direct(Name::IXh), indirect(Name::IX)));
+	expect_failure(ld(indirect(Name::IY), direct(Name::IYl)));
+	expect_failure(Operation::ld(Name::H, Name::IXl));
+	expect_failure(Operation::ld(Name::IYh, Name::L));
+	expect_failure(ld(direct(Name::IXh), indirect(Name::HL)));
+	expect_failure(ld(indirect(Name::HL), direct(Name::IXl)));
+	expect_failure(Operation::ld(Name::IXh, Name::IYl));
+	expect_failure(ld(indirect(Name::IX), direct(Name::IYh)));
+	expect_failure(Operation::unary(Type::SET7, Name::IXh));
+
+	return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+//
+//  OperationTests.cpp
+//  Map Preprocessor Tests
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Operation.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+bool all_passed = true;
+
+void expect_length(const char *name, const Operation &operation, size_t expected) {
+	const auto length = operation.machine_cycles().length();
+	if(length != expected) {
+		std::fprintf(stderr, "%s takes %zu cycles rather than %zu\n", name, length, expected);
+		all_passed = false;
+	}
+}
+
+}
+
+int main() {
+	// Only a conditional RET has the extra internal cycle; every generated routine ends with an unconditional one.
+	expect_length("ret", Operation::nullary(Operation::Type::RET), 10);
+	expect_length("jp nn", Operation::jp(0x1234), 10);
+	expect_length("jp (hl)", Operation{.type = Operation::Type::JP, .destination = Operand::indirect(Register::Name::HL)}, 4);
+	expect_length("jp (ix)", Operation{.type = Operation::Type::JP, .destination = Operand::indirect(Register::Name::IX)}, 8);
+	expect_length("call nn", Operation::call("target"), 17);
+
+	return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
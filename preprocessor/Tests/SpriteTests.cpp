@@ -0,0 +1,209 @@
+//
+//  SpriteTests.cpp
+//  Map Preprocessor Tests
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "Encoder.h"
+#include "PNGCodec.h"
+#include "TestSupport.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool all_passed = true;
+
+void fail(const std::string &message) {
+	std::fprintf(stderr, "%s\n", message.c_str());
+	all_passed = false;
+}
+
+/// Writes a work folder of sprites that are solid, ragged and noisy, so that runs are output both via the
+/// stack and through HL, with values that are worth keeping in registers; plus a single tile.
+void write_corpus(const ImageCodec &codec, const std::filesystem::path &directory) {
+	static constexpr uint32_t Colours[] = {
+		0xff00'0000, 0xff92'0000, 0xff00'0092, 0xff92'0092, 0xff00'9200, 0xffff'ffff, 0xff00'ffff, 0xffff'ff00,
+	};
+	static constexpr uint32_t Transparent = 0;
+
+	std::mt19937 random(1234);
+	const auto write = [&](const std::filesystem::path &path, size_t width, size_t height, int style) {
+		BufferPixelAccessor image(width, height);
+		for(size_t y = 0; y < height; y++) {
+			for(size_t x = 0; x < width; x++) {
+				uint32_t colour = Colours[(x / 4 + y) & 7];
+				switch(style) {
+					case 0:	break;
+					case 1:	colour = (x + y * 3) % 11 < 2 ? Transparent : Colours[(y >> 1) & 3];			break;
+					case 2:	colour = (random() & 3) ? Colours[random() & 7] : Transparent;				break;
+					case 3:	colour = x < y || x >= width - y / 2 ? Transparent : Colours[(x * y) & 1];	break;
+				}
+				image.set(x, y, colour);
+			}
+		}
+		codec.save(path, image, 0, 0, width, height);
+	};
+
+	std::filesystem::create_directories(directory / "tiles");
+	std::filesystem::create_directories(directory / "sprites");
+	write(directory / "tiles" / "0.png", TileWidth, TileHeight, 0);
+	write(directory / "sprites" / "0.png", 64, 32, 0);
+	write(directory / "sprites" / "1.png", 48, 24, 1);
+	write(directory / "sprites" / "2.png", 32, 32, 2);
+	write(directory / "sprites" / "3.png", 40, 32, 3);
+	write(directory / "sprites" / "4.png", 14, 9, 0);
+}
+
+/// @returns The 8-bit registers among A, D and E named by @c operand, directly or as part of a pair.
+std::set<std::string> registers_in(const std::string &operand) {
+	std::set<std::string> result;
+	for(const auto &name: {"a", "d", "e"}) {
+		if(operand == name) result.insert(name);
+	}
+	if(operand == "de" || operand == "(de)") {
+		result.insert("d");
+		result.insert("e");
+	}
+	if(operand == "af") {
+		result.insert("a");
+	}
+	return result;
+}
+
+/// Checks every sprite routine in @c source: that no register is loaded and then overwritten or abandoned
+/// without being read, and that HL is never moved twice without output in between.
+void check_sprites(const std::string &source) {
+	std::istringstream lines(source);
+	std::string line;
+	std::string routine;
+	std::map<std::string, std::string> unread;	// Register to the instruction that loaded it.
+	bool moved = false;
+	size_t runs_pushed = 0;
+
+	while(std::getline(lines, line)) {
+		const auto first = line.find_first_not_of('\t');
+		if(first == std::string::npos || line[first] == ';') continue;
+		line = line.substr(first);
+
+		if(line.back() == ':') {
+			routine = line.rfind("sprite_", 0) == 0 ? line.substr(0, line.size() - 1) : "";
+			unread.clear();
+			moved = false;
+			continue;
+		}
+		if(routine.empty()) continue;
+
+		// Split into mnemonic and operands.
+		const auto space = line.find(' ');
+		const auto mnemonic = line.substr(0, space);
+		std::vector<std::string> operands;
+		if(space != std::string::npos) {
+			std::istringstream list(line.substr(space + 1));
+			std::string operand;
+			while(std::getline(list, operand, ',')) {
+				operands.push_back(operand.substr(operand.find_first_not_of(' ')));
+			}
+		}
+
+		std::set<std::string> reads, writes;
+		if(mnemonic == "ld" && operands.size() == 2) {
+			reads = registers_in(operands[1]);
+			if(operands[0][0] == '(') {
+				const auto pointer = registers_in(operands[0]);
+				reads.insert(pointer.begin(), pointer.end());
+			} else {
+				writes = registers_in(operands[0]);
+			}
+		} else if(mnemonic == "push") {
+			reads = registers_in(operands[0]);
+		} else if(mnemonic == "inc" || mnemonic == "dec") {
+			reads = writes = registers_in(operands[0]);
+		} else if(mnemonic == "rrca" || mnemonic == "rlca" || mnemonic == "cpl") {
+			reads = writes = {"a"};
+		} else if(mnemonic == "add" || mnemonic == "adc" || mnemonic == "sub" || mnemonic == "sbc" ||
+			mnemonic == "and" || mnemonic == "or" || mnemonic == "xor") {
+			if(operands.size() == 1) operands.insert(operands.begin(), "a");
+			reads = registers_in(operands[0]);
+			const auto source = registers_in(operands[1]);
+			reads.insert(source.begin(), source.end());
+			writes = registers_in(operands[0]);
+		} else {
+			reads = {"a", "d", "e"};
+		}
+
+		for(const auto &reg: reads) {
+			unread.erase(reg);
+		}
+		for(const auto &reg: writes) {
+			if(const auto load = unread.find(reg); load != unread.end()) {
+				fail(routine + ": '" + load->second + "' is overwritten without being read");
+			}
+			unread[reg] = line;
+		}
+
+		if(mnemonic == "ret") {
+			for(const auto &[reg, load]: unread) {
+				fail(routine + ": '" + load + "' is never read");
+			}
+			routine.clear();
+			continue;
+		}
+
+		if(line == "add hl, bc") {
+			if(moved) {
+				fail(routine + ": HL is moved twice in succession");
+			}
+			moved = true;
+		}
+		if(mnemonic == "push") {
+			runs_pushed += operands[0] == "bc" || operands[0] == "de";
+		}
+		if(mnemonic == "push" || line.rfind("ld (hl)", 0) == 0) {
+			moved = false;
+		}
+	}
+
+	if(!runs_pushed) {
+		fail("No sprite output was pushed, so the stack path went untested");
+	}
+}
+
+}
+
+int main() {
+	try {
+		PNGCodec codec;
+		const TemporaryDirectory corpus("sprite-tests-");
+		write_corpus(codec, corpus.path());
+
+		Encoder encoder(codec, EncoderOptions{.threads = 1});
+		encoder.encode(corpus.path());
+
+		std::ifstream file(corpus.path() / "sprites.z80s");
+		std::stringstream source;
+		source << file.rdbuf();
+		check_sprites(source.str());
+
+		for(const auto &verification: encoder.verify(corpus.path())) {
+			if(!verification.error.empty()) {
+				fail(verification.routine + ": " + verification.error);
+			}
+		}
+	} catch(const std::exception &exception) {
+		fail(exception.what());
+	}
+
+	return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
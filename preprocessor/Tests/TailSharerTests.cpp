@@ -0,0 +1,182 @@
+//
+//  TailSharerTests.cpp
+//  Map Preprocessor Tests
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#include "TailSharer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Name = Register::Name;
+using Type = Operation::Type;
+
+bool all_passed = true;
+
+void fail(const std::string &message) {
+	std::fprintf(stderr, "%s\n", message.c_str());
+	all_passed = false;
+}
+
+/// The number of instructions in the tail appended by routine().
+constexpr size_t TailLength = 17;
+
+/// @returns A routine labelled @c name that runs @c body and then a tail worth sharing: a row of
+/// stores of A, the last of which immediately precedes an exit.
+std::vector<Operation> routine(const char *name, std::vector<Operation> body) {
+	std::vector<Operation> result{Operation::label(name)};
+	result.insert(result.end(), body.begin(), body.end());
+	for(int c = 0; c < 8; c++) {
+		result.push_back(Operation::unary(Type::INC, Name::L));
+		result.push_back(Operation::ld(Operand::indirect(Name::HL), Operand::direct(Name::A)));
+	}
+	result.push_back(Operation::jp(uint16_t(0x8000)));
+	return result;
+}
+
+/// @returns The label that @c routine now ends by jumping to, or an empty string if it doesn't.
+std::string jump_target(const std::vector<Operation> &routine) {
+	const auto last = std::find_if(routine.rbegin(), routine.rend(), [](const Operation &operation) {
+		return operation.type != Type::BLANK_LINE && operation.type != Type::NONE;
+	});
+	if(last == routine.rend() || last->type != Type::JP || last->destination->type != Operand::Type::Label) {
+		return "";
+	}
+	return std::get<Label>(last->destination->value).str();
+}
+
+bool has_label(const std::vector<Operation> &routine, const std::string &name) {
+	return std::any_of(routine.begin(), routine.end(), [&](const Operation &operation) {
+		return operation.type == Type::LABEL && std::get<Label>(operation.destination->value).str() == name;
+	});
+}
+
+/// Shares tails between @c first and @c second, in that order, and checks whether @c second now jumps into
+/// @c first, and that if so it still ends with the same tail.
+void expect_join(const char *name, std::vector<Operation> first, std::vector<Operation> second, bool should_join) {
+	const auto original = second;
+	TailSharer sharer;
+	sharer.share({&first, &second});
+
+	const auto target = jump_target(second);
+	if(target.empty() == should_join) {
+		fail(std::string(name) + (should_join ? ": tails weren't joined" : ": tails were joined"));
+		return;
+	}
+	if(!should_join) {
+		if(sharer.saved()) {
+			fail(std::string(name) + ": space was reported saved without a join");
+		}
+		return;
+	}
+
+	if(!has_label(first, target)) {
+		fail(std::string(name) + ": the first routine has no label " + target);
+	}
+	if(!sharer.saved()) {
+		fail(std::string(name) + ": no space was reported saved");
+	}
+
+	// Ignoring the jump and labels, the linked routine should end with the same instructions as the original.
+	std::vector<std::string> expected, linked;
+	for(const auto &operation: original) {
+		if(operation.type != Type::LABEL) expected.push_back(operation.text());
+	}
+	for(const auto &operation: sharer.linked(second)) {
+		if(operation.type == Type::LABEL || operation.type == Type::BLANK_LINE) continue;
+		if(operation.type == Type::JP && operation.destination->type == Operand::Type::Label) continue;
+		linked.push_back(operation.text());
+	}
+	if(
+		linked.size() < TailLength ||
+		!std::equal(expected.end() - TailLength, expected.end(), linked.end() - TailLength)
+	) {
+		fail(std::string(name) + ": the linked routine doesn't end as the original did");
+	}
+}
+
+}
+
+int main() {
+	const auto load_a = [](uint8_t value) {
+		return Operation::ld(Operand::direct(Name::A), Operand::immediate(value));
+	};
+
+	// A holds the same value at the join, however it got there.
+	expect_join("equal registers",
+		routine("first", {load_a(0x12)}),
+		routine("second", {load_a(0x11), Operation::unary(Type::INC, Name::A)}),
+		true);
+
+	// The tails are textually identical, but store a different value.
+	expect_join("differing registers",
+		routine("first", {load_a(0x12)}),
+		routine("second", {load_a(0x34)}),
+		false);
+
+	// A reference back to an earlier local label mustn't end up in the kept tail, where it would resolve
+	// to the other routine's label; so the join may only follow it.
+	{
+		const auto body = std::vector<Operation>{
+			Operation::label("@spot"),
+			load_a(0x12),
+			Operation::ld(Operand::label_indirect("@-spot+1"), Operand::direct(Name::HL)),
+		};
+		auto first = routine("first", body), second = routine("second", body);
+		TailSharer sharer;
+		sharer.share({&first, &second});
+		if(jump_target(second).empty()) {
+			fail("back-reference: tails weren't joined");
+		}
+		const bool kept = std::any_of(second.begin(), second.end(), [](const Operation &operation) {
+			return
+				operation.destination && operation.destination->type == Operand::Type::LabelIndirect &&
+				std::get<Label>(operation.destination->value).str() == "@-spot+1";
+		});
+		if(!kept) {
+			fail("back-reference: the join was made before the reference");
+		}
+	}
+
+	// Self-modification of an operand in the discarded tail must be redirected to the kept one.
+	{
+		auto first = routine("first", {
+			load_a(0x12),
+			Operation::label("@patch"),
+			Operation::ld(Operand::direct(Name::HL), Operand::immediate(uint16_t(0x4000))),
+		});
+		auto second = routine("second", {
+			load_a(0x12),
+			Operation::ld(Operand::label_indirect("@+patch+1"), Operand::direct(Name::DE)),
+			Operation::label("@patch"),
+			Operation::ld(Operand::direct(Name::HL), Operand::immediate(uint16_t(0x4000))),
+		});
+		TailSharer sharer;
+		sharer.share({&first, &second});
+
+		const auto target = jump_target(second);
+		if(target.empty()) {
+			fail("self-modification: tails weren't joined");
+		} else {
+			const auto store = std::find_if(second.begin(), second.end(), [](const Operation &operation) {
+				return operation.destination && operation.destination->type == Operand::Type::LabelIndirect;
+			});
+			const auto destination = std::get<Label>(store->destination->value).str();
+			if(destination != target + "+1") {
+				fail("self-modification: store is to " + destination + " rather than " + target + "+1");
+			}
+			if(!has_label(first, target)) {
+				fail("self-modification: the first routine has no label " + target);
+			}
+		}
+	}
+
+	return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,61 @@
+//
+//  TestSupport.h
+//  Map Preprocessor Tests
+//
+//  Created by Thomas Harte on 17/10/2026.
+//
+
+#pragma once
+
+#include "PixelAccessor.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// An image held in memory, from which test images are written.
+class BufferPixelAccessor: public PixelAccessor {
+public:
+	BufferPixelAccessor(size_t width, size_t height) : storage_(width * height) {
+		width_ = width;
+		height_ = height;
+		bytes_per_row_ = width * 4;
+		pixels_ = reinterpret_cast<uint8_t *>(storage_.data());
+	}
+
+	void set(size_t x, size_t y, uint32_t colour) {
+		*pixels(x, y) = colour;
+	}
+
+private:
+	std::vector<uint32_t> storage_;
+};
+
+/// A newly-created directory, unique to this process, that is removed along with its contents on destruction.
+class TemporaryDirectory {
+public:
+	explicit TemporaryDirectory(const std::string &prefix) {
+		std::random_device entropy;
+		std::uniform_int_distribution<uint64_t> suffix;
+		do {
+			char name[17];
+			snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(suffix(entropy)));
+			path_ = std::filesystem::temp_directory_path() / (prefix + name);
+		} while(!std::filesystem::create_directory(path_));
+	}
+	~TemporaryDirectory() {
+		std::error_code error;
+		std::filesystem::remove_all(path_, error);
+	}
+	TemporaryDirectory(const TemporaryDirectory &) = delete;
+	TemporaryDirectory &operator =(const TemporaryDirectory &) = delete;
+
+	const std::filesystem::path &path() const {	return path_;	}
+
+private:
+	std::filesystem::path path_;
+};